@@ -0,0 +1,110 @@
+/**
+  Measures RGBA to I420 conversion throughput per resolution, kernel and
+  thread count, and checks the SIMD kernel against the scalar one.
+    bench/convert_bench [iterations]
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+#include <cstdint>
+#include <cstdlib>
+
+#include "frame_converter.h"
+#include "worker_pool.h"
+
+namespace {
+
+struct Image {
+  int width;
+  int height;
+  std::vector<uint8_t> rgba;
+  std::vector<uint8_t> y;
+  std::vector<uint8_t> u;
+  std::vector<uint8_t> v;
+
+  Image(int width, int height)
+      : width(width), height(height),
+        rgba(static_cast<size_t>(width) * height * 4),
+        y(static_cast<size_t>(width) * height),
+        u(static_cast<size_t>(ChromaWidth()) * ChromaHeight()),
+        v(u.size()) {}
+
+  int ChromaWidth() const { return (width + 1) / 2; }
+  int ChromaHeight() const { return (height + 1) / 2; }
+
+  rigel::I420Planes Planes() {
+    return { y.data(), width, u.data(), ChromaWidth(),
+        v.data(), ChromaWidth() };
+  }
+};
+
+double MeasurePixelsPerSecond(rigel::RgbaToI420Converter *converter,
+    Image *image, int iterations) {
+  rigel::I420Planes planes = image->Planes();
+  auto begin = std::chrono::steady_clock::now();
+  for (int i = 0; i < iterations; i++) {
+    converter->Convert(image->rgba.data(), image->width * 4, planes,
+        image->width, 0, image->height);
+  }
+  auto end = std::chrono::steady_clock::now();
+  double seconds = std::chrono::duration<double>(end - begin).count();
+  return static_cast<double>(image->width) * image->height * iterations
+      / seconds;
+}
+
+}  // unnamed namespace
+
+int main(int argc, char *argv[]) {
+  int iterations = argc > 1 ? std::atoi(argv[1]) : 50;
+  rigel::WorkerPool *pool = rigel::WorkerPool::Shared();
+  std::vector<size_t> thread_counts = { 1, 2, 4 };
+  if (pool->Concurrency() > 4) thread_counts.push_back(pool->Concurrency());
+  const rigel::RgbaToI420Converter::Kernel kernels[] = {
+    rigel::RgbaToI420Converter::kKernelLibyuv,
+    rigel::RgbaToI420Converter::kKernelScalar,
+    rigel::RgbaToI420Converter::BestKernel(),
+  };
+  const int resolutions[][2] = { { 960, 544 }, { 1920, 1080 }, { 3840, 2160 } };
+  std::mt19937 random(1);
+  bool matched = true;
+  for (const auto &resolution : resolutions) {
+    Image image(resolution[0], resolution[1]);
+    for (auto &value : image.rgba) value = static_cast<uint8_t>(random());
+    // the SIMD kernel has to produce exactly the scalar output
+    Image reference(resolution[0], resolution[1]);
+    reference.rgba = image.rgba;
+    rigel::RgbaToI420Converter converter(pool);
+    converter.SetKernel(rigel::RgbaToI420Converter::kKernelScalar);
+    converter.Convert(reference.rgba.data(), reference.width * 4,
+        reference.Planes(), reference.width, 0, reference.height);
+    converter.SetKernel(rigel::RgbaToI420Converter::BestKernel());
+    converter.Convert(image.rgba.data(), image.width * 4, image.Planes(),
+        image.width, 0, image.height);
+    if (image.y != reference.y || image.u != reference.u ||
+        image.v != reference.v) {
+      std::cerr << "kernel mismatch at " << image.width << "x"
+          << image.height << std::endl;
+      matched = false;
+    }
+    for (size_t k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++) {
+      if (k == 2 && kernels[k] == kernels[0]) break;
+      converter.SetKernel(kernels[k]);
+      for (size_t threads : thread_counts) {
+        converter.SetMaxThreads(threads);
+        double rate = MeasurePixelsPerSecond(&converter, &image, iterations);
+        std::cout << std::setw(4) << image.width << "x" << std::setw(4)
+            << std::left << image.height << std::right << " "
+            << std::setw(6) << std::left
+            << rigel::RgbaToI420Converter::KernelName(converter.GetKernel())
+            << std::right << " threads " << std::setw(2) << threads << ": "
+            << std::fixed << std::setprecision(1) << rate / 1e6
+            << " Mpix/s" << std::endl;
+      }
+    }
+  }
+  return matched ? 0 : 1;
+}
@@ -0,0 +1,154 @@
+/**
+  Encodes a moving synthetic scene with every codec the encoder factory
+  offers and reports the CPU time per frame and the share of one core a
+  30 fps session costs, for a given thread budget.
+    bench/encoder_bench [threads] [frames]
+ */
+
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <cstdlib>
+
+extern "C" {
+#include <time.h>
+}
+
+#include "encoder_rtc.h"
+
+#include "api/video/i420_buffer.h"
+#include "api/video/video_frame.h"
+#include "api/video_codecs/video_codec.h"
+#include "api/video/video_bitrate_allocation.h"
+#include "modules/video_coding/include/video_codec_interface.h"
+
+namespace {
+
+constexpr int kWidth = 960;
+constexpr int kHeight = 544;
+constexpr int kFramerate = 30;
+constexpr uint32_t kBitrateBps = 2000000;
+
+int64_t ProcessCpuMicros() {
+  timespec time;
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &time);
+  return static_cast<int64_t>(time.tv_sec) * 1000000 + time.tv_nsec / 1000;
+}
+
+class ByteCounter : public webrtc::EncodedImageCallback {
+ public:
+  ByteCounter() : bytes_(0), frames_(0) {}
+
+  Result OnEncodedImage(const webrtc::EncodedImage &image,
+      const webrtc::CodecSpecificInfo *,
+      const webrtc::RTPFragmentationHeader *) override {
+    bytes_ += image.size();
+    frames_++;
+    return Result(Result::OK);
+  }
+
+  uint64_t bytes_;
+  uint64_t frames_;
+};
+
+webrtc::VideoCodec MakeCodec(webrtc::VideoCodecType type) {
+  webrtc::VideoCodec codec;
+  codec.codecType = type;
+  codec.width = kWidth;
+  codec.height = kHeight;
+  codec.maxFramerate = kFramerate;
+  codec.startBitrate = kBitrateBps / 1000;
+  codec.minBitrate = 100;
+  codec.maxBitrate = kBitrateBps / 1000;
+  codec.numberOfSimulcastStreams = 0;
+  switch (type) {
+    case webrtc::kVideoCodecVP8:
+      *codec.VP8() = webrtc::VideoEncoder::GetDefaultVp8Settings();
+      break;
+    case webrtc::kVideoCodecVP9:
+      *codec.VP9() = webrtc::VideoEncoder::GetDefaultVp9Settings();
+      break;
+    case webrtc::kVideoCodecH264:
+      *codec.H264() = webrtc::VideoEncoder::GetDefaultH264Settings();
+      break;
+    default:
+      break;
+  }
+  return codec;
+}
+
+// moving diagonal gradient so that every frame has motion
+void Paint(webrtc::I420Buffer *buffer, int frame) {
+  for (int y = 0; y < buffer->height(); y++) {
+    uint8_t *row = buffer->MutableDataY() + y * buffer->StrideY();
+    for (int x = 0; x < buffer->width(); x++) {
+      row[x] = static_cast<uint8_t>((x + y + frame * 4) & 0xff);
+    }
+  }
+  for (int y = 0; y < buffer->ChromaHeight(); y++) {
+    uint8_t *u = buffer->MutableDataU() + y * buffer->StrideU();
+    uint8_t *v = buffer->MutableDataV() + y * buffer->StrideV();
+    for (int x = 0; x < buffer->ChromaWidth(); x++) {
+      u[x] = static_cast<uint8_t>(128 + ((x + frame) & 0x1f));
+      v[x] = static_cast<uint8_t>(128 + ((y - frame) & 0x1f));
+    }
+  }
+}
+
+}  // unnamed namespace
+
+int main(int argc, char *argv[]) {
+  rigel::EncoderOptions options;
+  options.thread_budget = argc > 1 ? std::atoi(argv[1]) : 1;
+  // a single encoder runs at a time and takes the whole budget
+  options.max_encoders = 1;
+  const int frames = argc > 2 ? std::atoi(argv[2]) : 300;
+  rigel::RigelVideoEncoderFactory factory(options);
+  rtc::scoped_refptr<webrtc::I420Buffer> buffer =
+      webrtc::I420Buffer::Create(kWidth, kHeight);
+  for (const auto &format : factory.GetSupportedFormats()) {
+    std::unique_ptr<webrtc::VideoEncoder> encoder =
+        factory.CreateVideoEncoder(format);
+    if (encoder == nullptr) continue;
+    webrtc::VideoCodec codec =
+        MakeCodec(webrtc::PayloadStringToCodecType(format.name));
+    ByteCounter counter;
+    encoder->RegisterEncodeCompleteCallback(&counter);
+    if (encoder->InitEncode(&codec, options.thread_budget, 1200) != 0) {
+      std::cerr << format.ToString() << ": InitEncode failed" << std::endl;
+      continue;
+    }
+    webrtc::VideoBitrateAllocation allocation;
+    allocation.SetBitrate(0, 0, kBitrateBps);
+    encoder->SetRateAllocation(allocation, kFramerate);
+
+    // only the encode calls are timed, painting is not part of the cost
+    int64_t cpu = 0;
+    for (int i = 0; i < frames; i++) {
+      Paint(buffer.get(), i);
+      auto frame = webrtc::VideoFrame::Builder()
+          .set_video_frame_buffer(buffer)
+          .set_timestamp_rtp(static_cast<uint32_t>(i * 90000 / kFramerate))
+          .set_timestamp_us(i * 1000000 / kFramerate)
+          .build();
+      std::vector<webrtc::VideoFrameType> types(1, i == 0 ?
+          webrtc::kVideoFrameKey : webrtc::kVideoFrameDelta);
+      const int64_t begin = ProcessCpuMicros();
+      encoder->Encode(frame, &types);
+      cpu += ProcessCpuMicros() - begin;
+    }
+    encoder->Release();
+
+    double per_frame_ms = cpu / 1000.0 / frames;
+    std::cout << std::left << std::setw(40) << format.ToString()
+        << std::right << std::fixed << std::setprecision(2)
+        << per_frame_ms << " ms cpu/frame, "
+        << std::setprecision(1) << per_frame_ms * kFramerate / 10.0
+        << "% of a core at " << kFramerate << " fps, "
+        << counter.bytes_ * 8 / 1000 * kFramerate / std::max<uint64_t>(
+            counter.frames_, 1) << " kbps" << std::endl;
+  }
+  return 0;
+}
@@ -0,0 +1,125 @@
+/**
+  Measures input enqueue and drain throughput with a producer thread
+  standing in for the network thread and a consumer draining like
+  RenderInstancePrivate::Update.
+    bench/input_ring_bench [messages]
+ */
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <cstdint>
+#include <cstdlib>
+
+#include <boost/lockfree/queue.hpp>
+
+#include "spsc_ring.h"
+
+namespace {
+
+struct Message {
+  int x, y, z;
+  uint32_t sequence;
+  int64_t time_us;
+};
+
+struct Result {
+  double seconds;
+  uint64_t drained;
+  uint64_t rejected;
+  int64_t sum;
+};
+
+// Runs push in a producer thread for count messages while the calling
+// thread drains until the producer finished and nothing is left
+template <typename Push, typename Drain>
+Result Run(uint64_t count, Push push, Drain drain) {
+  std::atomic<bool> done(false);
+  Result result = {};
+  auto begin = std::chrono::steady_clock::now();
+  std::thread producer([&] {
+    for (uint64_t i = 0; i < count; i++) {
+      Message message = { 1, -1, 0, static_cast<uint32_t>(i + 1), 0 };
+      if (!push(message)) result.rejected++;
+    }
+    done.store(true, std::memory_order_release);
+  });
+  while (true) {
+    bool finished = done.load(std::memory_order_acquire);
+    drain(&result);
+    if (finished) break;
+    std::this_thread::yield();
+  }
+  producer.join();
+  drain(&result);
+  auto end = std::chrono::steady_clock::now();
+  result.seconds = std::chrono::duration<double>(end - begin).count();
+  return result;
+}
+
+void Print(const char *name, uint64_t count, const Result &result) {
+  std::cout << name << ": " << count / result.seconds / 1e6
+      << " M messages/s, drained " << result.drained
+      << ", rejected " << result.rejected
+      << ", sum " << result.sum << std::endl;
+}
+
+}  // unnamed namespace
+
+int main(int argc, char *argv[]) {
+  const uint64_t count = argc > 1 ?
+      std::strtoull(argv[1], nullptr, 10) : 10000000;
+  bool ok = true;
+
+  {
+    boost::lockfree::queue<Message> queue(128);
+    Result result = Run(count, [&](const Message &message) {
+      return queue.push(message);
+    }, [&](Result *result) {
+      Message message;
+      while (queue.pop(message)) {
+        result->drained++;
+        result->sum += message.x;
+      }
+    });
+    Print("boost::lockfree::queue", count, result);
+    ok &= result.sum == static_cast<int64_t>(result.drained);
+  }
+
+  {
+    static rigel::SpscRing<Message, 256> ring;
+    Result result = Run(count, [&](const Message &message) {
+      // spin like a producer that must not drop
+      while (!ring.Push(message)) std::this_thread::yield();
+      return true;
+    }, [&](Result *result) {
+      Message message;
+      while (ring.Pop(&message)) {
+        result->drained++;
+        result->sum += message.x;
+      }
+    });
+    Print("SpscRing", count, result);
+    ok &= result.drained == count && result.sum == static_cast<int64_t>(count);
+  }
+
+  {
+    // motion without sequence numbers is only summed
+    std::atomic<int> x(0);
+    std::atomic<bool> pending(false);
+    Result result = Run(count, [&](const Message &message) {
+      x.fetch_add(message.x, std::memory_order_relaxed);
+      pending.store(true, std::memory_order_release);
+      return true;
+    }, [&](Result *result) {
+      if (pending.exchange(false, std::memory_order_acquire)) {
+        result->drained++;
+        result->sum += x.exchange(0, std::memory_order_relaxed);
+      }
+    });
+    Print("coalesced", count, result);
+    ok &= result.sum == static_cast<int64_t>(count);
+  }
+  return ok ? 0 : 1;
+}
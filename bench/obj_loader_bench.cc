@@ -0,0 +1,115 @@
+/**
+  Compares the parallel OBJ parser against tiny_obj_loader on a
+  generated grid, or on the file given as the first argument.
+    bench/obj_loader_bench [file.obj] [threads]
+ */
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstdlib>
+#include <cmath>
+
+#include "obj_loader.h"
+
+namespace {
+
+// writes a textured grid of quads, about 100 bytes per vertex
+void WriteGrid(const std::string &path, int size) {
+  std::ofstream out(path);
+  for (int y = 0; y <= size; y++) {
+    for (int x = 0; x <= size; x++) {
+      out << "v " << x * 0.01 << " " << std::sin(x * 0.1) * std::cos(y * 0.1)
+          << " " << y * -0.01 << "\n";
+      out << "vt " << static_cast<double>(x) / size << " "
+          << static_cast<double>(y) / size << "\n";
+    }
+  }
+  out << "usemtl default\n";
+  for (int y = 0; y < size; y++) {
+    for (int x = 0; x < size; x++) {
+      int a = y * (size + 1) + x + 1;
+      int b = a + 1;
+      int c = a + size + 2;
+      int d = a + size + 1;
+      out << "f " << a << "/" << a << " " << b << "/" << b << " "
+          << c << "/" << c << " " << d << "/" << d << "\n";
+    }
+  }
+}
+
+// the layout the renderer used to build from tinyobj output
+size_t LoadTinyObj(const std::string &path) {
+  tinyobj::attrib_t attrib;
+  std::vector<tinyobj::shape_t> shapes;
+  std::vector<tinyobj::material_t> materials;
+  std::string warn;
+  std::string err;
+  if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err,
+      path.c_str(), "")) {
+    return 0;
+  }
+  std::vector<rigel::Vertex> vertices;
+  std::vector<uint32_t> indices;
+  for (const auto &shape : shapes) {
+    for (const auto &idx : shape.mesh.indices) {
+      rigel::Vertex vertex = {};
+      for (int i = 0; i < 3; i++) {
+        vertex.position[i] = attrib.vertices[idx.vertex_index * 3 + i];
+      }
+      if (idx.texcoord_index >= 0) {
+        vertex.uv[0] = attrib.texcoords[idx.texcoord_index * 2 + 0];
+        vertex.uv[1] = attrib.texcoords[idx.texcoord_index * 2 + 1];
+      }
+      indices.push_back(static_cast<uint32_t>(vertices.size()));
+      vertices.push_back(vertex);
+    }
+  }
+  return indices.size();
+}
+
+size_t LoadParallel(const std::string &path, size_t threads) {
+  rigel::ObjLoadOptions options;
+  options.thread_count = threads;
+  rigel::ObjModel model;
+  std::string err;
+  if (!rigel::LoadObjModel(path, "", options, &model, &err)) {
+    std::cerr << err << std::endl;
+    return 0;
+  }
+  return model.indices.size();
+}
+
+template <typename F>
+double Measure(F function, size_t *result) {
+  auto begin = std::chrono::steady_clock::now();
+  *result = function();
+  auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::milli>(end - begin).count();
+}
+
+}  // unnamed namespace
+
+int main(int argc, char *argv[]) {
+  std::string path = "/tmp/rigel_obj_bench.obj";
+  if (argc > 1) {
+    path = argv[1];
+  } else {
+    WriteGrid(path, 1500);
+  }
+  size_t threads = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 0;
+  size_t tiny_indices;
+  size_t parallel_indices;
+  double tiny = Measure([&] { return LoadTinyObj(path); }, &tiny_indices);
+  double parallel = Measure(
+      [&] { return LoadParallel(path, threads); }, &parallel_indices);
+  std::cout << path << std::endl;
+  std::cout << "tinyobj:  " << tiny << " ms, "
+      << tiny_indices << " indices" << std::endl;
+  std::cout << "parallel: " << parallel << " ms, "
+      << parallel_indices << " indices" << std::endl;
+  return tiny_indices == parallel_indices ? 0 : 1;
+}
@@ -0,0 +1,249 @@
+/**
+  Compares decoding and encoding signaling messages with the in-situ
+  JsonDocument and JsonWriter against the boost::property_tree path
+  they replaced, on an answer carrying a generated SDP and a batch of
+  ICE candidates.
+    bench/signaling_json_bench [iterations]
+ */
+
+#include <chrono>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstdlib>
+
+#include <boost/property_tree/ptree.hpp>
+#include <boost/property_tree/json_parser.hpp>
+#include <boost/algorithm/string/join.hpp>
+
+#include "json_codec.h"
+
+namespace {
+
+struct Candidate {
+  std::string sdp;
+  std::string mid;
+  int index;
+};
+
+// an SDP of a single video section, about 3KB like a browser answer
+std::string MakeSdp() {
+  std::string sdp = "v=0\r\no=- 4611731400430051336 2 IN IP4 127.0.0.1\r\n"
+      "s=-\r\nt=0 0\r\na=group:BUNDLE 0\r\n"
+      "m=video 9 UDP/TLS/RTP/SAVPF 96 97 98 99 100 101 102\r\n";
+  for (int i = 0; i < 40; i++) {
+    sdp += "a=rtcp-fb:" + std::to_string(96 + i % 7) +
+        " goog-remb transport-cc ccm fir nack pli\r\n";
+  }
+  sdp += "a=fingerprint:sha-256 7B:8B:F0:65:5F:78:E2:51:3B:AC:6F:F3:3F:46:"
+      "1B:35:DC:B8:5F:64:1A:24:C2:43:F0:A1:58:D0:A1:2C:19:08\r\n";
+  return sdp;
+}
+
+std::vector<Candidate> MakeCandidates() {
+  std::vector<Candidate> candidates;
+  for (int i = 0; i < 4; i++) {
+    candidates.push_back(Candidate {
+      "candidate:" + std::to_string(842163049 + i) + " 1 udp 1677729535 "
+          "203.0.113." + std::to_string(10 + i) + " " +
+          std::to_string(52000 + i) + " typ srflx raddr 0.0.0.0 rport 0 "
+          "generation 0 network-cost 999",
+      "0", 0 });
+  }
+  return candidates;
+}
+
+// the encoding of the previous dispatcher
+std::string TreeEncode(const std::string &method,
+    const std::string &parameter, const std::string &destination) {
+  boost::property_tree::ptree tree;
+  tree.put("method", method);
+  tree.put("parameter", parameter);
+  tree.put("source", "");
+  tree.put("destination", destination);
+  std::stringstream stream;
+  boost::property_tree::json_parser::write_json(stream, tree);
+  return stream.str();
+}
+
+std::string TreeEncodeCandidates(const std::vector<Candidate> &candidates,
+    const std::string &destination) {
+  std::vector<std::string> items;
+  for (const auto &v : candidates) {
+    boost::property_tree::ptree item;
+    item.put("candidate", v.sdp);
+    item.put("sdpMid", v.mid);
+    item.put("sdpMLineIndex", v.index);
+    std::stringstream stream;
+    boost::property_tree::json_parser::write_json(stream, item, false);
+    items.push_back(stream.str());
+  }
+  std::string array = "[" + boost::algorithm::join(items, ",") + "]";
+  return TreeEncode("candidate", array, destination);
+}
+
+void WriterEncode(rigel::JsonWriter *writer, const std::string &method,
+    absl::string_view parameter, const std::string &destination) {
+  writer->Reset();
+  writer->BeginObject();
+  writer->Key("method");
+  writer->String(method);
+  writer->Key("parameter");
+  writer->String(parameter);
+  writer->Key("source");
+  writer->String("");
+  writer->Key("destination");
+  writer->String(destination);
+  writer->EndObject();
+}
+
+void WriterEncodeCandidates(rigel::JsonWriter *writer,
+    rigel::JsonWriter *parameter, const std::vector<Candidate> &candidates,
+    const std::string &destination) {
+  parameter->Reset();
+  parameter->BeginArray();
+  for (const auto &v : candidates) {
+    parameter->BeginObject();
+    parameter->Key("candidate");
+    parameter->String(v.sdp);
+    parameter->Key("sdpMid");
+    parameter->String(v.mid);
+    parameter->Key("sdpMLineIndex");
+    parameter->Int(v.index);
+    parameter->EndObject();
+  }
+  parameter->EndArray();
+  WriterEncode(writer, "candidate", parameter->Data(), destination);
+}
+
+// sizes of the decoded fields, so both paths can be checked alike
+uint64_t TreeDecode(const std::string &message) {
+  boost::property_tree::ptree tree;
+  std::stringstream stream(message);
+  boost::property_tree::json_parser::read_json(stream, tree);
+  const auto method = tree.get<std::string>("method");
+  const auto parameter = tree.get<std::string>("parameter");
+  uint64_t sum = method.size() + parameter.size();
+  if (method != "candidate") return sum;
+  boost::property_tree::ptree candidates;
+  std::stringstream parameter_stream(parameter);
+  boost::property_tree::json_parser::read_json(parameter_stream, candidates);
+  for (const auto &v : candidates) {
+    sum += v.second.get<std::string>("candidate").size();
+    sum += v.second.get<std::string>("sdpMid").size();
+    sum += v.second.get<int>("sdpMLineIndex");
+  }
+  return sum;
+}
+
+uint64_t DocumentDecode(rigel::JsonDocument *document,
+    rigel::JsonDocument *embedded, std::string *buffer,
+    const std::string &message) {
+  // the websocket buffer is read in place, here it is refilled first
+  buffer->assign(message);
+  if (!document->Parse(&(*buffer)[0], buffer->size())) return 0;
+  const rigel::JsonValue root = document->Root();
+  const absl::string_view method = root.Find("method").String();
+  const rigel::JsonValue parameter = root.Find("parameter");
+  uint64_t sum = method.size() + parameter.String().size();
+  if (method != "candidate") return sum;
+  if (!embedded->ParseEmbedded(parameter)) return 0;
+  const rigel::JsonValue candidates = embedded->Root();
+  for (rigel::JsonValue v = candidates.First(); v.IsValid(); v = v.Next()) {
+    int64_t index = 0;
+    v.Find("sdpMLineIndex").ToInt(&index);
+    sum += v.Find("candidate").String().size();
+    sum += v.Find("sdpMid").String().size();
+    sum += static_cast<uint64_t>(index);
+  }
+  return sum;
+}
+
+template <typename F>
+double Measure(uint64_t iterations, F f) {
+  auto begin = std::chrono::steady_clock::now();
+  for (uint64_t i = 0; i < iterations; i++) f();
+  auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double>(end - begin).count();
+}
+
+void Print(const char *name, uint64_t iterations, uint64_t bytes,
+    double seconds) {
+  std::cout << name << ": " << iterations / seconds / 1e3
+      << " K messages/s, " << bytes / seconds / 1e6 << " MB/s" << std::endl;
+}
+
+}  // unnamed namespace
+
+int main(int argc, char *argv[]) {
+  const uint64_t iterations = argc > 1 ?
+      std::strtoull(argv[1], nullptr, 10) : 20000;
+  const std::string sdp = MakeSdp();
+  const std::vector<Candidate> candidates = MakeCandidates();
+  const std::string destination = "peer-0123456789";
+  bool ok = true;
+
+  // encoding
+  rigel::JsonWriter writer;
+  rigel::JsonWriter parameter;
+  std::string answer;
+  std::string candidate;
+  {
+    uint64_t bytes = 0;
+    double seconds = Measure(iterations, [&] {
+      answer = TreeEncode("answer", sdp, destination);
+      candidate = TreeEncodeCandidates(candidates, destination);
+      bytes += answer.size() + candidate.size();
+    });
+    Print("encode property_tree", iterations * 2, bytes, seconds);
+  }
+  {
+    uint64_t bytes = 0;
+    double seconds = Measure(iterations, [&] {
+      WriterEncode(&writer, "answer", sdp, destination);
+      bytes += writer.Data().size();
+      WriterEncodeCandidates(&writer, &parameter, candidates, destination);
+      bytes += writer.Data().size();
+    });
+    Print("encode JsonWriter", iterations * 2, bytes, seconds);
+  }
+
+  // decoding, both read the messages of the writer
+  WriterEncode(&writer, "answer", sdp, destination);
+  const std::string compact_answer = writer.Data();
+  WriterEncodeCandidates(&writer, &parameter, candidates, destination);
+  const std::string compact_candidate = writer.Data();
+  const uint64_t bytes =
+      (compact_answer.size() + compact_candidate.size()) * iterations;
+  uint64_t tree_sum = 0;
+  {
+    double seconds = Measure(iterations, [&] {
+      tree_sum += TreeDecode(compact_answer);
+      tree_sum += TreeDecode(compact_candidate);
+    });
+    Print("decode property_tree", iterations * 2, bytes, seconds);
+  }
+  uint64_t document_sum = 0;
+  rigel::JsonDocument document;
+  rigel::JsonDocument embedded;
+  std::string buffer;
+  {
+    double seconds = Measure(iterations, [&] {
+      document_sum += DocumentDecode(&document, &embedded, &buffer,
+          compact_answer);
+      document_sum += DocumentDecode(&document, &embedded, &buffer,
+          compact_candidate);
+    });
+    Print("decode JsonDocument", iterations * 2, bytes, seconds);
+  }
+  ok &= tree_sum == document_sum;
+  // messages of older encoders, pretty printed with quoted numbers
+  ok &= DocumentDecode(&document, &embedded, &buffer, answer) ==
+      TreeDecode(answer);
+  ok &= DocumentDecode(&document, &embedded, &buffer, candidate) ==
+      TreeDecode(candidate);
+  if (!ok) std::cout << "decoded fields differ" << std::endl;
+  return ok ? 0 : 1;
+}
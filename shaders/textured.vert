@@ -0,0 +1,22 @@
+#version 450
+
+layout (location = 0) in vec3 inPos;
+layout (location = 1) in vec3 inColor;
+layout (location = 2) in vec2 inUV;
+layout (location = 3) in mat4 inWorld;
+
+layout (location = 0) out vec2 outUV;
+
+out gl_PerVertex {
+	vec4 gl_Position;   
+};
+
+layout(push_constant) uniform PushConsts {
+	mat4 viewProj;
+} pushConsts;
+
+void main() 
+{
+	outUV = inUV;
+	gl_Position = pushConsts.viewProj * inWorld * vec4(inPos.xyz, 1.0);
+}
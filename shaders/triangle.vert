@@ -2,6 +2,7 @@
 
 layout (location = 0) in vec3 inPos;
 layout (location = 1) in vec3 inColor;
+layout (location = 3) in mat4 inWorld;
 
 layout (location = 0) out vec3 outColor;
 
@@ -10,11 +11,11 @@ out gl_PerVertex {
 };
 
 layout(push_constant) uniform PushConsts {
-	mat4 mvp;
+	mat4 viewProj;
 } pushConsts;
 
 void main() 
 {
 	outColor = inColor;
-	gl_Position = pushConsts.mvp * vec4(inPos.xyz, 1.0);
+	gl_Position = pushConsts.viewProj * inWorld * vec4(inPos.xyz, 1.0);
 }
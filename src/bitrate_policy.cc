@@ -0,0 +1,87 @@
+
+#include "bitrate_policy.h"
+
+#include <algorithm>
+
+#include "api/rtp_parameters.h"
+#include "api/transport/bitrate_settings.h"
+
+namespace rigel {
+
+namespace {
+
+constexpr int kMaxSimulcastLayers = 3;
+// share of the maximum bitrate per layer, lowest resolution first.
+// A layer has a quarter of the pixels of the next one
+constexpr double kLayerShares[kMaxSimulcastLayers][kMaxSimulcastLayers] = {
+  { 1.0, 0.0, 0.0 },
+  { 0.25, 0.75, 0.0 },
+  { 0.1, 0.3, 0.6 },
+};
+const char *const kLayerRids[kMaxSimulcastLayers] = { "q", "h", "f" };
+
+BitratePolicy MakePolicy(int min_bps, int start_bps, int max_bps) {
+  BitratePolicy policy;
+  policy.min_bitrate_bps = min_bps;
+  policy.start_bitrate_bps = start_bps;
+  policy.max_bitrate_bps = max_bps;
+  return policy;
+}
+
+}  // unnamed namespace
+
+BitratePolicy::BitratePolicy()
+    : min_bitrate_bps(300000),
+      start_bitrate_bps(1200000),
+      max_bitrate_bps(2500000),
+      simulcast_layers(1), maintain_resolution(false) {}
+
+webrtc::BitrateSettings BitratePolicy::ToBitrateSettings() const {
+  webrtc::BitrateSettings settings;
+  settings.min_bitrate_bps = min_bitrate_bps;
+  settings.start_bitrate_bps =
+      std::max(min_bitrate_bps, std::min(start_bitrate_bps, max_bitrate_bps));
+  settings.max_bitrate_bps = max_bitrate_bps;
+  return settings;
+}
+
+std::vector<webrtc::RtpEncodingParameters> BitratePolicy::ToEncodings() const {
+  const int layers = std::max(1, std::min(simulcast_layers,
+      kMaxSimulcastLayers));
+  std::vector<webrtc::RtpEncodingParameters> encodings(layers);
+  for (int i = 0; i < layers; i++) {
+    auto &encoding = encodings[i];
+    encoding.max_bitrate_bps =
+        static_cast<int>(max_bitrate_bps * kLayerShares[layers - 1][i]);
+    if (layers > 1) {
+      encoding.rid = kLayerRids[kMaxSimulcastLayers - layers + i];
+      encoding.scale_resolution_down_by =
+          static_cast<double>(1 << (layers - 1 - i));
+    }
+  }
+  // only the lowest layer has to keep going on a bad link
+  encodings[0].min_bitrate_bps = min_bitrate_bps;
+  return encodings;
+}
+
+BitratePolicies::BitratePolicies() : default_tier_("standard") {
+  policies_["basic"] = MakePolicy(150000, 600000, 1200000);
+  policies_["standard"] = MakePolicy(300000, 1200000, 2500000);
+  policies_["premium"] = MakePolicy(300000, 2000000, 4000000);
+}
+
+void BitratePolicies::Set(const std::string &tier,
+    const BitratePolicy &policy) {
+  policies_[tier] = policy;
+}
+
+BitratePolicy BitratePolicies::Get(const std::string &tier) const {
+  auto it = policies_.find(tier);
+  if (it == policies_.end()) {
+    it = policies_.find(default_tier_);
+  }
+  if (it == policies_.end()) return BitratePolicy();
+  return it->second;
+}
+
+}  // namespace rigel
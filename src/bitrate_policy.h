@@ -0,0 +1,58 @@
+
+#ifndef RIGEL_RTC_BITRATE_POLICY_H_
+#define RIGEL_RTC_BITRATE_POLICY_H_
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+namespace webrtc {
+struct BitrateSettings;
+struct RtpEncodingParameters;
+}  // namespace webrtc
+
+namespace rigel {
+
+// Bandwidth of the video sent to one peer. The start bitrate skips the
+// slow ramp-up of the bandwidth estimator, and the maximum caps what
+// a session may cost.
+struct BitratePolicy {
+  BitratePolicy();
+
+  int min_bitrate_bps;
+  int start_bitrate_bps;
+  int max_bitrate_bps;
+  // 1 sends a single stream. 2 or 3 send simulcast layers of a single
+  // render, each half the resolution of the next, for receivers
+  // forwarding the layer that suits each client
+  int simulcast_layers;
+  // lower the frame rate rather than the resolution when congested or
+  // overused, for encoders whose size is shared by several peers
+  bool maintain_resolution;
+
+  // for PeerConnectionInterface::SetBitrate
+  webrtc::BitrateSettings ToBitrateSettings() const;
+  // one encoding per layer, lowest resolution first, sharing the
+  // maximum bitrate
+  std::vector<webrtc::RtpEncodingParameters> ToEncodings() const;
+};
+
+// Policies by customer tier, configured by the operator.
+// Tiers requested by peers but not configured get the default one.
+class BitratePolicies {
+ public:
+  // "basic", "standard" and "premium", standard being the default
+  BitratePolicies();
+
+  void Set(const std::string &tier, const BitratePolicy &policy);
+  void SetDefaultTier(const std::string &tier) { default_tier_ = tier; }
+  BitratePolicy Get(const std::string &tier) const;
+
+ private:
+  std::unordered_map<std::string, BitratePolicy> policies_;
+  std::string default_tier_;
+};
+
+}  // namespace rigel
+
+#endif  // RIGEL_RTC_BITRATE_POLICY_H_
@@ -0,0 +1,286 @@
+
+#include "broadcast_rtc.h"
+#include "logging.inc"
+
+#include <algorithm>
+
+#include "api/video/video_frame.h"
+#include "modules/video_coding/include/video_error_codes.h"
+#include "rtc_base/critical_section.h"
+#include "absl/strings/match.h"
+
+namespace rigel {
+
+namespace {
+
+// state of one viewer encoder, guarded by the SharedVideoEncoder lock_
+struct SharedEncoderClient {
+  webrtc::EncodedImageCallback *callback;
+  webrtc::VideoBitrateAllocation allocation;
+  uint32_t framerate;
+};
+
+}  // unnamed namespace
+
+// Encodes each captured frame once for all attached clients.
+// The clients call Encode with the same frames, told apart by the id
+// the capturer numbers them with, so only the first call of a frame
+// reaches the encoder. Repeated frames get a new id and are encoded
+// again. Key frame requests are merged into the next encoded frame,
+// and the encoder runs at the lowest rate any client asked for so
+// the slowest viewer is not congested. The frame size is set by the
+// first client alone, the others adapting theirs would resize it for
+// everyone.
+// encoder_lock_ serializes the calls into the encoder and is taken
+// before lock_, which guards the clients. Encoded images are handed
+// to the clients without holding lock_.
+class SharedVideoEncoder : public webrtc::EncodedImageCallback {
+ public:
+  explicit SharedVideoEncoder(std::unique_ptr<webrtc::VideoEncoder> encoder)
+      : encoder_(std::move(encoder)), initialized_(false),
+        last_frame_id_(-1), last_timestamp_us_(-1),
+        key_frame_pending_(false) {
+    encoder_->RegisterEncodeCompleteCallback(this);
+  }
+
+  ~SharedVideoEncoder() override {
+    encoder_->Release();
+  }
+
+  int32_t Attach(SharedEncoderClient *client,
+      const webrtc::VideoCodec *codec_settings,
+      int32_t number_of_cores, size_t max_payload_size) {
+    rtc::CritScope encoder_lock(&encoder_lock_);
+    rtc::CritScope lock(&lock_);
+    if (std::find(clients_.begin(), clients_.end(), client) ==
+        clients_.end()) {
+      clients_.push_back(client);
+      RGL_INFO("broadcast encoder clients: " +
+          std::to_string(clients_.size()));
+    }
+    // The first client sets up the encoder, later ones join it at its
+    // size. Only the first one may change the size afterwards
+    const bool resized = codec_settings->width != settings_.width ||
+        codec_settings->height != settings_.height;
+    if (initialized_ && (!resized || client != clients_.front())) {
+      key_frame_pending_ = true;
+      return WEBRTC_VIDEO_CODEC_OK;
+    }
+    settings_ = *codec_settings;
+    int32_t result = encoder_->InitEncode(&settings_, number_of_cores,
+        max_payload_size);
+    initialized_ = result == WEBRTC_VIDEO_CODEC_OK;
+    last_frame_id_ = -1;
+    last_timestamp_us_ = -1;
+    ApplyRate();
+    return result;
+  }
+
+  void Detach(SharedEncoderClient *client) {
+    rtc::CritScope encoder_lock(&encoder_lock_);
+    rtc::CritScope lock(&lock_);
+    auto it = std::find(clients_.begin(), clients_.end(), client);
+    if (it == clients_.end()) return;
+    clients_.erase(it);
+    if (clients_.empty()) {
+      encoder_->Release();
+      initialized_ = false;
+      return;
+    }
+    ApplyRate();
+  }
+
+  void SetCallback(SharedEncoderClient *client,
+      webrtc::EncodedImageCallback *callback) {
+    rtc::CritScope lock(&lock_);
+    client->callback = callback;
+  }
+
+  void SetRate(SharedEncoderClient *client,
+      const webrtc::VideoBitrateAllocation &allocation, uint32_t framerate) {
+    rtc::CritScope encoder_lock(&encoder_lock_);
+    rtc::CritScope lock(&lock_);
+    client->allocation = allocation;
+    client->framerate = framerate;
+    ApplyRate();
+  }
+
+  int32_t Encode(const webrtc::VideoFrame &frame,
+      const std::vector<webrtc::VideoFrameType> *frame_types) {
+    rtc::CritScope encoder_lock(&encoder_lock_);
+    std::vector<webrtc::VideoFrameType> types;
+    {
+      rtc::CritScope lock(&lock_);
+      if (frame_types != nullptr) {
+        for (webrtc::VideoFrameType type : *frame_types) {
+          if (type == webrtc::VideoFrameType::kVideoFrameKey) {
+            key_frame_pending_ = true;
+          }
+        }
+      }
+      if (!initialized_) return WEBRTC_VIDEO_CODEC_UNINITIALIZED;
+      // already encoded for another client
+      if (!IsNewFrame(frame)) return WEBRTC_VIDEO_CODEC_OK;
+      types.assign(1, key_frame_pending_ ?
+          webrtc::VideoFrameType::kVideoFrameKey :
+          webrtc::VideoFrameType::kVideoFrameDelta);
+      key_frame_pending_ = false;
+    }
+    // the encoded image reaches OnEncodedImage with lock_ released
+    return encoder_->Encode(frame, &types);
+  }
+
+  webrtc::VideoEncoder::EncoderInfo GetEncoderInfo() const {
+    rtc::CritScope encoder_lock(&encoder_lock_);
+    return encoder_->GetEncoderInfo();
+  }
+
+  // EncodedImageCallback
+  Result OnEncodedImage(const webrtc::EncodedImage &image,
+      const webrtc::CodecSpecificInfo *info,
+      const webrtc::RTPFragmentationHeader *fragmentation) override {
+    // the callbacks packetize and may block on their transports
+    std::vector<webrtc::EncodedImageCallback *> callbacks;
+    {
+      rtc::CritScope lock(&lock_);
+      for (const SharedEncoderClient *client : clients_) {
+        if (client->callback != nullptr) {
+          callbacks.push_back(client->callback);
+        }
+      }
+    }
+    Result result(Result::ERROR_SEND_FAILED);
+    for (webrtc::EncodedImageCallback *callback : callbacks) {
+      Result sent = callback->OnEncodedImage(image, info, fragmentation);
+      if (sent.error == Result::OK) result = sent;
+    }
+    return result;
+  }
+
+ private:
+  // must hold both locks
+  void ApplyRate() {
+    if (!initialized_) return;
+    const SharedEncoderClient *lowest = nullptr;
+    for (const SharedEncoderClient *client : clients_) {
+      // paused clients do not hold back the others
+      if (client->allocation.get_sum_bps() == 0) continue;
+      if (lowest == nullptr || client->allocation.get_sum_bps() <
+          lowest->allocation.get_sum_bps()) {
+        lowest = client;
+      }
+    }
+    if (lowest == nullptr) {
+      encoder_->SetRateAllocation(webrtc::VideoBitrateAllocation(),
+          settings_.maxFramerate);
+      return;
+    }
+    encoder_->SetRateAllocation(lowest->allocation, lowest->framerate);
+  }
+
+  // must hold lock_, a new frame becomes the last one encoded
+  bool IsNewFrame(const webrtc::VideoFrame &frame) {
+    if (frame.id() != 0 && last_frame_id_ >= 0) {
+      if (static_cast<int16_t>(frame.id() - last_frame_id_) <= 0) {
+        return false;
+      }
+    } else if (frame.timestamp_us() <= last_timestamp_us_) {
+      return false;
+    }
+    last_frame_id_ = frame.id() != 0 ? frame.id() : -1;
+    last_timestamp_us_ = frame.timestamp_us();
+    return true;
+  }
+
+  rtc::CriticalSection encoder_lock_;
+  rtc::CriticalSection lock_;
+  std::unique_ptr<webrtc::VideoEncoder> encoder_;
+  std::vector<SharedEncoderClient *> clients_;
+  webrtc::VideoCodec settings_;
+  bool initialized_;
+  // ids wrap around, frames without one are told apart by timestamp
+  int32_t last_frame_id_;
+  int64_t last_timestamp_us_;
+  bool key_frame_pending_;
+};
+
+// The encoder webrtc sees for one viewer connection
+class BroadcastVideoEncoder : public webrtc::VideoEncoder {
+ public:
+  explicit BroadcastVideoEncoder(std::shared_ptr<SharedVideoEncoder> shared)
+      : shared_(std::move(shared)) {
+    client_.callback = nullptr;
+    client_.framerate = 0;
+  }
+
+  ~BroadcastVideoEncoder() override {
+    shared_->Detach(&client_);
+  }
+
+  int32_t InitEncode(const webrtc::VideoCodec *codec_settings,
+      int32_t number_of_cores, size_t max_payload_size) override {
+    return shared_->Attach(&client_, codec_settings, number_of_cores,
+        max_payload_size);
+  }
+
+  int32_t RegisterEncodeCompleteCallback(
+      webrtc::EncodedImageCallback *callback) override {
+    shared_->SetCallback(&client_, callback);
+    return WEBRTC_VIDEO_CODEC_OK;
+  }
+
+  int32_t Release() override {
+    shared_->Detach(&client_);
+    return WEBRTC_VIDEO_CODEC_OK;
+  }
+
+  int32_t Encode(const webrtc::VideoFrame &frame,
+      const std::vector<webrtc::VideoFrameType> *frame_types) override {
+    return shared_->Encode(frame, frame_types);
+  }
+
+  int32_t SetRateAllocation(const webrtc::VideoBitrateAllocation &allocation,
+      uint32_t framerate) override {
+    shared_->SetRate(&client_, allocation, framerate);
+    return WEBRTC_VIDEO_CODEC_OK;
+  }
+
+  EncoderInfo GetEncoderInfo() const override {
+    return shared_->GetEncoderInfo();
+  }
+
+ private:
+  std::shared_ptr<SharedVideoEncoder> shared_;
+  SharedEncoderClient client_;
+};
+
+BroadcastVideoEncoderFactory::BroadcastVideoEncoderFactory(
+    const EncoderOptions &options)
+    : factory_(options), format_(factory_.GetSupportedFormats().front()) {
+  RGL_INFO("broadcast encoder codec: " + format_.name);
+  shared_ = std::make_shared<SharedVideoEncoder>(
+      factory_.CreateVideoEncoder(format_));
+}
+
+BroadcastVideoEncoderFactory::~BroadcastVideoEncoderFactory() = default;
+
+std::vector<webrtc::SdpVideoFormat>
+BroadcastVideoEncoderFactory::GetSupportedFormats() const {
+  return std::vector<webrtc::SdpVideoFormat>(1, format_);
+}
+
+webrtc::VideoEncoderFactory::CodecInfo
+BroadcastVideoEncoderFactory::QueryVideoEncoder(
+    const webrtc::SdpVideoFormat &format) const {
+  return factory_.QueryVideoEncoder(format);
+}
+
+std::unique_ptr<webrtc::VideoEncoder>
+BroadcastVideoEncoderFactory::CreateVideoEncoder(
+    const webrtc::SdpVideoFormat &format) {
+  if (!absl::EqualsIgnoreCase(format.name, format_.name)) return nullptr;
+  return std::unique_ptr<webrtc::VideoEncoder>(
+      new BroadcastVideoEncoder(shared_));
+}
+
+}  // namespace rigel
@@ -0,0 +1,42 @@
+
+#ifndef RIGEL_RTC_BROADCAST_H_
+#define RIGEL_RTC_BROADCAST_H_
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "api/video_codecs/sdp_video_format.h"
+#include "api/video_codecs/video_encoder_factory.h"
+
+#include "encoder_rtc.h"
+
+namespace rigel {
+
+class SharedVideoEncoder;
+
+// Hands out encoders that all feed a single real encoder. Every peer
+// connection of a broadcast session gets one of them, the frame is encoded
+// by whichever of them sees it first and the encoded image is passed
+// to all of them to packetize. Only the most preferred codec is offered
+// since the viewers have to agree on it.
+class BroadcastVideoEncoderFactory : public webrtc::VideoEncoderFactory {
+ public:
+  explicit BroadcastVideoEncoderFactory(const EncoderOptions &options);
+  ~BroadcastVideoEncoderFactory() override;
+
+  std::vector<webrtc::SdpVideoFormat> GetSupportedFormats() const override;
+  CodecInfo QueryVideoEncoder(
+      const webrtc::SdpVideoFormat &format) const override;
+  std::unique_ptr<webrtc::VideoEncoder> CreateVideoEncoder(
+      const webrtc::SdpVideoFormat &format) override;
+
+ private:
+  RigelVideoEncoderFactory factory_;
+  webrtc::SdpVideoFormat format_;
+  std::shared_ptr<SharedVideoEncoder> shared_;
+};
+
+}  // namespace rigel
+
+#endif  // RIGEL_RTC_BROADCAST_H_
@@ -1,7 +1,9 @@
 
 #include <random>
+#include <algorithm>
 
 #include "capture_rtc.h"
+#include "worker_pool.h"
 #include "logging.inc"
 
 #include "api/video/i420_buffer.h"
@@ -11,39 +13,199 @@
 
 namespace rigel {
 
+namespace {
+
+// frames held by the encoder of each sink, besides the one being written
+constexpr size_t kFrameBuffersPerSink = 3;
+// frames between two latency reports
+constexpr uint64_t kTraceReportInterval = 300;
+
+}  // unnamed namespace
+
+VideoCapturer::VideoCapturer()
+    : pool_(1 + kFrameBuffersPerSink), converter_(WorkerPool::Shared()),
+      delivered_frames_(0), frame_id_(0), last_timestamp_us_(0) {}
+
 void VideoCapturer::Initialize() {
   constexpr int width = 960;
   constexpr int height = 544;
   // frame buffer
-  buffer_ = webrtc::I420Buffer::Create(width, height);
+  buffer_ = pool_.CreateBuffer(width, height);
   webrtc::I420Buffer::SetBlack(buffer_.get());
   // generate frame
   auto frame = webrtc::VideoFrame::Builder()
       .set_video_frame_buffer(buffer_)
+      .set_timestamp_us(rtc::TimeMicros())
       .build();
   OnFrame(frame);
 }
 
-void VideoCapturer::OnRenderFrame(const char *map, int w, int h, int r) {
-  int width = buffer_->width();
-  int height = buffer_->height();
-  const uint8_t *data = reinterpret_cast<const uint8_t *>(map);
-  webrtc::I420Buffer *buffer = buffer_.get();
-  libyuv::ConvertToI420(
-      data, CalcBufferSize(webrtc::VideoType::kARGB, width, height),
-      buffer->MutableDataY(), buffer->StrideY(),
-      buffer->MutableDataU(), buffer->StrideU(),
-      buffer->MutableDataV(), buffer->StrideV(),
-      0, 0,
-      width, height,
-      buffer->width(), buffer->height(),
-      libyuv::kRotate0,
-      libyuv::FOURCC_ABGR);
-  // generate frame
-  auto frame = webrtc::VideoFrame::Builder()
+FrameBufferPoolStats VideoCapturer::GetBufferPoolStats() const {
+  return pool_.GetStats();
+}
+
+void VideoCapturer::AddOrUpdateSink(
+    rtc::VideoSinkInterface<webrtc::VideoFrame> *sink,
+    const rtc::VideoSinkWants &wants) {
+  bool added = false;
+  {
+    rtc::CritScope lock(&sinks_lock_);
+    added = sinks_.insert(sink).second;
+    rtc::VideoBroadcaster::AddOrUpdateSink(sink, wants);
+    // peers joining a shared session hold frames of their own
+    size_t sinks = std::max<size_t>(1, sinks_.size());
+    pool_.SetMaxBuffers(1 + kFrameBuffersPerSink * sinks);
+  }
+  if (!added) return;
+  // The encoder of a sink added after rendering started would otherwise
+  // wait for the next tick, or start with the black frame
+  absl::optional<webrtc::VideoFrame> frame;
+  {
+    rtc::CritScope lock(&held_lock_);
+    frame = held_frame_;
+  }
+  if (frame) sink->OnFrame(*frame);
+}
+
+void VideoCapturer::RepeatLastFrame() {
+  absl::optional<webrtc::VideoFrame> frame;
+  {
+    rtc::CritScope lock(&held_lock_);
+    frame = held_frame_;
+  }
+  if (!frame) return;
+  rtc::CritScope lock(&deliver_lock_);
+  Stamp(&*frame, rtc::TimeMicros());
+  OnFrame(*frame);
+}
+
+void VideoCapturer::RemoveSink(
+    rtc::VideoSinkInterface<webrtc::VideoFrame> *sink) {
+  rtc::CritScope lock(&sinks_lock_);
+  sinks_.erase(sink);
+  rtc::VideoBroadcaster::RemoveSink(sink);
+  size_t sinks = std::max<size_t>(1, sinks_.size());
+  pool_.SetMaxBuffers(1 + kFrameBuffersPerSink * sinks);
+}
+
+void VideoCapturer::OnRenderFrame(const RenderFrame &rendered) {
+  rtc::scoped_refptr<webrtc::I420Buffer> buffer =
+      pool_.CreateBuffer(rendered.width, rendered.height);
+  if (buffer == nullptr) {
+    // The encoder is behind, drop the frame rather than overwrite one.
+    // The renderer diffs against the dropped frame from now on, so its
+    // tiles are kept for the next one
+    RGL_WARN("frame buffer pool exhausted");
+    AccumulateDirtyTiles(rendered);
+    return;
+  }
+  RenderFrame frame = rendered;
+  if (!pending_tiles_.empty()) {
+    AccumulateDirtyTiles(rendered);
+    frame.dirty_tiles = pending_tiles_.data();
+  }
+  I420Planes planes = {
+    buffer->MutableDataY(), buffer->StrideY(),
+    buffer->MutableDataU(), buffer->StrideU(),
+    buffer->MutableDataV(), buffer->StrideV(),
+  };
+  const uint8_t *data = reinterpret_cast<const uint8_t *>(frame.data);
+  if (buffer_ == nullptr || buffer_->width() != frame.width ||
+      buffer_->height() != frame.height) {
+    // nothing to carry over after a size change
+    converter_.Convert(data, frame.stride, planes,
+        frame.width, 0, frame.height);
+  } else {
+    // Only tile rows containing a changed tile are converted, the rest
+    // is copied from the previous frame. Consecutive dirty rows are
+    // merged into a single parallel conversion
+    CopyCleanRows(frame, buffer.get());
+    for (int row = 0; row < frame.tile_rows; row++) {
+      if (!frame.IsTileRowDirty(row)) continue;
+      int first = row;
+      while (row + 1 < frame.tile_rows && frame.IsTileRowDirty(row + 1)) {
+        row++;
+      }
+      int y = first * frame.tile_size;
+      int rows = std::min((row + 1) * frame.tile_size, frame.height) - y;
+      converter_.Convert(data, frame.stride, planes, frame.width, y, rows);
+    }
+  }
+  buffer_ = buffer;
+  pending_tiles_.clear();
+  FrameTrace trace = frame.trace;
+  // frames rendered outside a tick carry no trace
+  const bool traced = trace.id != 0;
+  if (!traced) trace.capture_time_us = rtc::TimeMicros();
+  trace.Mark(kFrameStageConverted);
+  // generate frame, stamped with the start of the tick that rendered it
+  auto video_frame = webrtc::VideoFrame::Builder()
       .set_video_frame_buffer(buffer_)
       .build();
-  OnFrame(frame);
+  {
+    rtc::CritScope lock(&deliver_lock_);
+    Stamp(&video_frame, trace.capture_time_us);
+    {
+      rtc::CritScope held_lock(&held_lock_);
+      held_frame_ = video_frame;
+    }
+    OnFrame(video_frame);
+  }
+  trace.Mark(kFrameStageDelivered);
+  if (!traced) return;
+  recorder_.Record(trace);
+  if (++delivered_frames_ % kTraceReportInterval == 0) {
+    RGL_INFO(recorder_.Report());
+  }
+}
+
+void VideoCapturer::Stamp(webrtc::VideoFrame *frame,
+    int64_t timestamp_us) {
+  timestamp_us = std::max(timestamp_us, last_timestamp_us_ + 1);
+  last_timestamp_us_ = timestamp_us;
+  frame->set_timestamp_us(timestamp_us);
+  if (++frame_id_ == 0) frame_id_ = 1;
+  frame->set_id(frame_id_);
+}
+
+void VideoCapturer::AccumulateDirtyTiles(const RenderFrame &frame) {
+  const size_t words = (frame.tile_columns * frame.tile_rows + 31) / 32;
+  if (pending_tiles_.size() != words) {
+    // the first drop, or a size change converting everything anyway
+    pending_tiles_.assign(frame.dirty_tiles, frame.dirty_tiles + words);
+    return;
+  }
+  for (size_t i = 0; i < words; i++) {
+    pending_tiles_[i] |= frame.dirty_tiles[i];
+  }
+}
+
+void VideoCapturer::CopyCleanRows(const RenderFrame &frame,
+    webrtc::I420Buffer *buffer) {
+  const webrtc::I420Buffer *previous = buffer_.get();
+  int chroma_width = (frame.width + 1) / 2;
+  for (int row = 0; row < frame.tile_rows; row++) {
+    if (frame.IsTileRowDirty(row)) continue;
+    int first = row;
+    while (row + 1 < frame.tile_rows && !frame.IsTileRowDirty(row + 1)) {
+      row++;
+    }
+    // tile sizes are even, so tile rows own whole chroma rows
+    int y = first * frame.tile_size;
+    int rows = std::min((row + 1) * frame.tile_size, frame.height) - y;
+    libyuv::CopyPlane(
+        previous->DataY() + y * previous->StrideY(), previous->StrideY(),
+        buffer->MutableDataY() + y * buffer->StrideY(), buffer->StrideY(),
+        frame.width, rows);
+    libyuv::CopyPlane(
+        previous->DataU() + y / 2 * previous->StrideU(), previous->StrideU(),
+        buffer->MutableDataU() + y / 2 * buffer->StrideU(), buffer->StrideU(),
+        chroma_width, (rows + 1) / 2);
+    libyuv::CopyPlane(
+        previous->DataV() + y / 2 * previous->StrideV(), previous->StrideV(),
+        buffer->MutableDataV() + y / 2 * buffer->StrideV(), buffer->StrideV(),
+        chroma_width, (rows + 1) / 2);
+  }
 }
 
 }  // namespace rigel
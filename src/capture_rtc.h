@@ -3,27 +3,77 @@
 #define RIGEL_RTC_CAPTURE_H_
 
 #include <memory>
+#include <vector>
+#include <set>
 
 #include "media/base/video_broadcaster.h"
 #include "api/video/i420_buffer.h"
+#include "api/video/video_frame.h"
+#include "absl/types/optional.h"
+#include "rtc_base/critical_section.h"
 #include "render.h"
+#include "frame_converter.h"
+#include "frame_buffer_pool.h"
+#include "frame_trace.h"
 
 namespace rigel {
 
 class VideoCapturer : public rtc::VideoBroadcaster,
     public RenderInstanceSink {
  public:
-  VideoCapturer() = default;
+  VideoCapturer();
   ~VideoCapturer() override = default;
 
   // VideoCapturer
   void Initialize();
 
+  FrameBufferPoolStats GetBufferPoolStats() const;
+
+  // Delivers the last rendered frame again, stamped now, to sinks that
+  // dropped it while their transport was not writable yet
+  void RepeatLastFrame();
+
+  // VideoSourceInterface, every sink gets its own share of buffers.
+  // New sinks are handed the last rendered frame right away
+  void AddOrUpdateSink(rtc::VideoSinkInterface<webrtc::VideoFrame> *sink,
+      const rtc::VideoSinkWants &wants) override;
+  void RemoveSink(rtc::VideoSinkInterface<webrtc::VideoFrame> *sink) override;
+  // stage latencies of the frames delivered by this capturer
+  const FrameTraceRecorder &GetTraceRecorder() const { return recorder_; }
+
   // RenderInstanceSink
-  void OnRenderFrame(const char *v, int w, int h, int r) override;
+  void OnRenderFrame(const RenderFrame &frame) override;
 
  private:
+  void CopyCleanRows(const RenderFrame &frame, webrtc::I420Buffer *buffer);
+  // folds the tiles of a frame into pending_tiles_
+  void AccumulateDirtyTiles(const RenderFrame &frame);
+  // Must hold deliver_lock_. Numbers the frame, and keeps timestamps
+  // increasing since sinks drop frames not newer than the last one
+  void Stamp(webrtc::VideoFrame *frame, int64_t timestamp_us);
+
+  FrameBufferPool pool_;
+  // the last delivered frame, the source of the rows that did not change
   rtc::scoped_refptr<webrtc::I420Buffer> buffer_;
+  // tiles changed by dropped frames since buffer_, converted with the
+  // next delivered frame. Empty when nothing was dropped
+  std::vector<uint32_t> pending_tiles_;
+  RgbaToI420Converter converter_;
+  FrameTraceRecorder recorder_;
+  uint64_t delivered_frames_;
+  // sinks as seen by this capturer, the broadcaster keeps its own
+  // list under a lock it does not share
+  rtc::CriticalSection sinks_lock_;
+  std::set<rtc::VideoSinkInterface<webrtc::VideoFrame> *> sinks_;
+  rtc::CriticalSection held_lock_;
+  // the last frame with rendered content
+  absl::optional<webrtc::VideoFrame> held_frame_;
+  // rendered and repeated frames are delivered one at a time, in the
+  // order they are stamped
+  rtc::CriticalSection deliver_lock_;
+  // id of the last delivered frame, 0 is left to the black frame
+  uint16_t frame_id_;
+  int64_t last_timestamp_us_;
 };
 
 }  // namespace rigel
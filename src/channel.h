@@ -4,13 +4,52 @@
 
 #include <string>
 #include <vector>
+#include <cstddef>
 
 #include "ice_candidate.h"
 
 namespace rigel {
 
+// requested by the "start" message
+struct SessionOptions {
+  SessionOptions() : device(0) {}
+
+  // Key of the session the peer starts or joins. Named sessions and
+  // broadcasts are kept apart by a prefix, and the private session of
+  // a peer starting neither is out of reach of any name a client sends
+  std::string SessionFor(const std::string &peer) const {
+    if (!broadcast.empty()) return "broadcast:" + broadcast;
+    if (!session.empty()) return "session:" + session;
+    return "peer:" + peer;
+  }
+
+  // the session to start or join by name, a private one when empty
+  std::string session;
+  // peers starting with the same non-empty identifier watch a single
+  // renderer, and its frames are encoded once for all of them
+  std::string broadcast;
+  // customer tier of a new session, setting the bitrate of all its
+  // peers. Only tiers the operator lets clients request are kept
+  std::string tier;
+  // GPU of a new session, assigned by admission control
+  size_t device;
+};
+
+// input a peer may send to the renderer of its session
+enum PeerInputPermission {
+  kPeerInputNone = 0,
+  kPeerInputMotion = 1 << 0,
+  kPeerInputZoom = 1 << 1,
+  kPeerInputAll = kPeerInputMotion | kPeerInputZoom,
+};
+
 struct PeerChannelInterface {
   virtual ~PeerChannelInterface() = default;
+  virtual const std::string &SessionIdentifier() const = 0;
+  // the peer that created the session, which grants input to the others
+  virtual bool OwnsSession() const = 0;
+  // a combination of PeerInputPermission flags
+  virtual void SetInputPermissions(int permissions) = 0;
   virtual void Offer() = 0;
   virtual void AcceptAnswer(const std::string &answer) = 0;
   virtual void Acquire() = 0;
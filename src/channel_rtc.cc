@@ -3,14 +3,62 @@
 #include "logging.inc"
 #include "capture_track_source.h"
 #include "render.h"
-#include <boost/tokenizer.hpp>
-#include <boost/lexical_cast.hpp>
+#include "input_protocol.h"
+#include "frame_trace.h"
+
+#include "rtc_base/critical_section.h"
+#include "rtc_base/location.h"
 
 namespace rigel {
 
+namespace {
+
+rtc::CriticalSection first_frame_lock;
+LatencyHistogram first_frame_histogram;
+
+}  // unnamed namespace
+
+// Another sink of the session capturer, noting when the first frame with
+// rendered content reaches the peer. The black frame pushed before
+// rendering starts carries no frame id.
+class FirstFrameProbe : public rtc::VideoSinkInterface<webrtc::VideoFrame> {
+ public:
+  FirstFrameProbe(const std::string &identifier, int64_t start_time_us)
+      : identifier_(identifier), start_time_us_(start_time_us),
+        done_(false) {}
+
+  void OnFrame(const webrtc::VideoFrame &frame) override {
+    if (frame.id() == 0 || done_.exchange(true)) return;
+    const int64_t elapsed_us = FrameTraceNowMicros() - start_time_us_;
+    LatencySummary summary;
+    {
+      rtc::CritScope lock(&first_frame_lock);
+      first_frame_histogram.Add(elapsed_us);
+      summary = first_frame_histogram.Summarize();
+    }
+    RGL_INFO("time to first frame of " + identifier_ + ": " +
+        std::to_string(elapsed_us / 1000) + "ms, p50 " +
+        std::to_string(summary.p50_us / 1000) + "ms p95 " +
+        std::to_string(summary.p95_us / 1000) + "ms");
+  }
+
+ private:
+  std::string identifier_;
+  int64_t start_time_us_;
+  // the capturer thread and a newly added sink may race
+  std::atomic<bool> done_;
+};
+
+LatencySummary RTCPeerChannel::GetTimeToFirstFrame() {
+  rtc::CritScope lock(&first_frame_lock);
+  return first_frame_histogram.Summarize();
+}
+
 RTCPeerChannel::RTCPeerChannel(const std::string &identifier,
-    SignalingMessageInterface *messaging)
-    : identifier_(identifier), messaging_(messaging), ice_buffering_(true),
+    SignalingMessageInterface *messaging, int64_t start_time_us)
+    : identifier_(identifier), messaging_(messaging),
+      start_time_us_(start_time_us), owner_(false),
+      input_permissions_(kPeerInputNone), ice_buffering_(true),
       create_session_observer_(
           new rtc::RefCountedObject<CreateSessionDescriptionObserver>(this)),
       set_offer_observer_(
@@ -21,38 +69,112 @@ RTCPeerChannel::RTCPeerChannel(const std::string &identifier,
               this, webrtc::SdpType::kAnswer)) {}
 
 RTCPeerChannel::~RTCPeerChannel() {
-  if (render_instance_) {
-    render_instance_->StopRendering();
-    render_instance_ = nullptr;
+  if (first_frame_probe_) {
+    // sinks of the session source change on the worker thread, like
+    // the ones of the tracks
+    RTCSession *session = session_.get();
+    FirstFrameProbe *probe = first_frame_probe_.get();
+    session->Group()->WorkerThread()->Invoke<void>(RTC_FROM_HERE,
+        [session, probe] { session->TrackSource()->RemoveSink(probe); });
+  }
+  if (session_) {
+    session_->Group()->RemoveChannel();
   }
 }
 
 void RTCPeerChannel::Initialize(
     rtc::scoped_refptr<webrtc::PeerConnectionInterface> &&connection,
-    rtc::scoped_refptr<webrtc::PeerConnectionFactoryInterface> &factory,
-    RenderInstanceFactoryInterface *render_instance_factory) {
+    std::shared_ptr<RTCSession> &&session, bool owner) {
+  const BitratePolicy &policy = session->Policy();
   // data channel
   webrtc::DataChannelInit init;
   data_channel_ = connection->CreateDataChannel("data_channel", &init);
   data_channel_->RegisterObserver(this);
-  // video capturer
-  video_capturer_ = new VideoCapturer();
-  // renderer
-  render_instance_ = render_instance_factory->CreateInstance(video_capturer_);
-  // capture source
-  std::unique_ptr<
-      rtc::VideoSourceInterface<webrtc::VideoFrame>> source(video_capturer_);
-  track_source_ = CapturerTrackSource::Create(std::move(source));
-  // create track
+  // Optional channel for motion input. Lost messages are not resent and
+  // later ones are not held back, so stale motion never delays new input
+  webrtc::DataChannelInit input_init;
+  input_init.ordered = false;
+  input_init.maxRetransmits = 0;
+  input_channel_ = connection->CreateDataChannel("input", &input_init);
+  input_channel_->RegisterObserver(this);
+  // create track, another sink of the session capturer
   rtc::scoped_refptr<webrtc::VideoTrackInterface> video_track(
-      factory->CreateVideoTrack("track0", track_source_));
+      session->Factory()->CreateVideoTrack("track0", session->TrackSource()));
+  AddVideoTrack(connection, video_track, policy);
+  first_frame_probe_.reset(
+      new FirstFrameProbe(identifier_, start_time_us_));
+  RTCSession *shared = session.get();
+  FirstFrameProbe *probe = first_frame_probe_.get();
+  shared->Group()->WorkerThread()->Invoke<void>(RTC_FROM_HERE,
+      [shared, probe] {
+        shared->TrackSource()->AddOrUpdateSink(probe, rtc::VideoSinkWants());
+      });
+  // the bandwidth estimation starts from the start bitrate
+  webrtc::RTCError error = connection->SetBitrate(policy.ToBitrateSettings());
+  if (!error.ok()) {
+    RGL_WARN(std::string("SetBitrate failed: ") + error.message());
+  }
+  // setup complete
+  session->Group()->AddChannel();
+  session_ = std::move(session);
+  owner_ = owner;
+  input_permissions_ = owner ? kPeerInputAll : kPeerInputNone;
+  connection_ = connection;
+}
+
+void RTCPeerChannel::AddVideoTrack(
+    webrtc::PeerConnectionInterface *connection,
+    const rtc::scoped_refptr<webrtc::VideoTrackInterface> &track,
+    const BitratePolicy &policy) {
+  std::vector<webrtc::RtpEncodingParameters> encodings =
+      policy.ToEncodings();
+  if (encodings.size() > 1) {
+    // Simulcast layers are negotiated by rid on a transceiver, which
+    // the connection was configured with Unified Plan for
+    webrtc::RtpTransceiverInit init;
+    init.direction = webrtc::RtpTransceiverDirection::kSendOnly;
+    init.send_encodings = encodings;
+    auto result = connection->AddTransceiver(track, init);
+    if (result.ok()) return;
+    RGL_WARN(std::string("simulcast unavailable: ") +
+        result.error().message());
+    BitratePolicy single = policy;
+    single.simulcast_layers = 1;
+    init.send_encodings = single.ToEncodings();
+    result = connection->AddTransceiver(track, init);
+    if (!result.ok()) {
+      RGL_WARN(std::string("AddTransceiver failed: ") +
+          result.error().message());
+    }
+    return;
+  }
   // create video sender
   rtc::scoped_refptr<webrtc::RtpSenderInterface> sender(
       connection->CreateSender(
           webrtc::MediaStreamTrackInterface::kVideoKind, "video"));
-  sender->SetTrack(video_track);
-  // setup complete
-  connection_ = connection;
+  sender->SetTrack(track);
+  webrtc::RtpParameters parameters = sender->GetParameters();
+  if (parameters.encodings.empty()) return;
+  parameters.encodings[0].min_bitrate_bps = encodings[0].min_bitrate_bps;
+  parameters.encodings[0].max_bitrate_bps = encodings[0].max_bitrate_bps;
+  if (policy.maintain_resolution) {
+    parameters.degradation_preference =
+        webrtc::DegradationPreference::MAINTAIN_RESOLUTION;
+  }
+  webrtc::RTCError error = sender->SetParameters(parameters);
+  if (!error.ok()) {
+    RGL_WARN(std::string("SetParameters failed: ") + error.message());
+  }
+}
+
+const std::string &RTCPeerChannel::SessionIdentifier() const {
+  return session_->Identifier();
+}
+
+void RTCPeerChannel::SetInputPermissions(int permissions) {
+  RGL_INFO("input permissions of " + identifier_ + ": " +
+      std::to_string(permissions));
+  input_permissions_ = permissions;
 }
 
 void RTCPeerChannel::Offer() {
@@ -60,6 +182,9 @@ void RTCPeerChannel::Offer() {
   Options options;
   options.offer_to_receive_video = Options::kOfferToReceiveMediaTrue;
   connection_->CreateOffer(create_session_observer_, options);
+  // The renderer is set up and draws its first frames while ICE and
+  // DTLS negotiate, instead of after the connection is up
+  session_->Acquire();
 }
 
 void RTCPeerChannel::AcceptAnswer(const std::string &answer) {
@@ -88,8 +213,8 @@ void RTCPeerChannel::ReceiveICECandidates(
 }
 
 void RTCPeerChannel::Acquire() {
-  video_capturer_->Initialize();
-  render_instance_->StartRendering();
+  // already rendering since the offer, kept for older clients
+  session_->Acquire();
 }
 
 void RTCPeerChannel::OnCreateSessionDescriptionSuccess(
@@ -128,39 +253,54 @@ void RTCPeerChannel::OnIceCandidate(
   }
 }
 
+void RTCPeerChannel::OnConnectionChange(
+    webrtc::PeerConnectionInterface::PeerConnectionState new_state) {
+  using State = webrtc::PeerConnectionInterface::PeerConnectionState;
+  if (new_state != State::kConnected) return;
+  // The encoder drops frames until the transport is writable, so the
+  // held frame is sent again for the first key frame to show content
+  // without waiting for the next tick
+  session_->RepeatLastFrame();
+}
+
 void RTCPeerChannel::OnIceGatheringChange(
     webrtc::PeerConnectionInterface::IceGatheringState new_state) {}
 
 void RTCPeerChannel::OnMessage(const webrtc::DataBuffer& buffer) {
-  std::string message(buffer.data.data<char>(), buffer.data.size());
-  boost::char_separator<char> sep(",");
-  boost::tokenizer<boost::char_separator<char> > tokens(message, sep);
-  std::vector<std::string> v;
-  std::copy(tokens.begin(), tokens.end(), std::back_inserter(v));
-  if (v.size() == 0) return;
-  const auto &command = v[0];
-  // Move XY
-  if (command == "m") {
-    if (v.size() < 3) return;
-    int x, y;
-    try {
-      x = boost::lexical_cast<int>(v[1]);
-      y = boost::lexical_cast<int>(v[2]);
-    } catch (boost::bad_lexical_cast const &e) {
-        return;
+  const int permissions = input_permissions_.load(std::memory_order_relaxed);
+  if (permissions == kPeerInputNone) return;
+  auto permitted = [permissions](InputEventType type) {
+    return (permissions & (type == kInputEventMotion ?
+        kPeerInputMotion : kPeerInputZoom)) != 0;
+  };
+  RenderInstanceInterface *renderer = session_->Renderer();
+  const int64_t now = FrameTraceNowMicros();
+  const uint8_t *data = buffer.data.data<uint8_t>();
+  const size_t size = buffer.data.size();
+  if (buffer.binary) {
+    InputBatchReader reader(data, size);
+    if (!reader.Valid()) return;
+    RenderInputEvent events[kInputBatchMaxEvents];
+    size_t count = 0;
+    InputEvent event;
+    while (reader.Next(&event)) {
+      if (!permitted(event.type)) continue;
+      events[count++] = RenderInputEvent {
+        event.x, event.y, event.z, event.sequence, now - event.offset_us };
     }
-    render_instance_->InputXYAxis(x, y);
+    if (count > 0) renderer->InputEvents(events, count);
+    return;
   }
-  // Wheel
-  if (command == "w") {
-    if (v.size() < 2) return;
-    int z;
-    try {
-      z = boost::lexical_cast<int>(v[1]);
-    } catch (boost::bad_lexical_cast const &e) {
-        return;
-    }
-    render_instance_->InputZAxis(z);
+  // text messages of older clients
+  InputEvent event;
+  if (!ParseInputText(reinterpret_cast<const char *>(data), size, &event)) {
+    return;
+  }
+  if (!permitted(event.type)) return;
+  if (event.type == kInputEventMotion) {
+    renderer->InputXYAxis(event.x, event.y, event.sequence);
+  } else {
+    renderer->InputZAxis(event.z, event.sequence);
   }
 }
 
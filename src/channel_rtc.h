@@ -11,26 +11,35 @@
 #include "message_signaling.h"
 #include "observer_rtc.h"
 #include "ice_candidate.h"
-#include "capture_rtc.h"
-#include "capture_track_source.h"
-#include "render_instance.h"
+#include "session_rtc.h"
+#include "bitrate_policy.h"
+#include "frame_trace.h"
+
+#include <atomic>
+#include <memory>
 
 namespace rigel {
 
+class FirstFrameProbe;
+
 class RTCPeerChannel : public PeerChannelInterface,
     public CreateSessionDescriptionSink,
     public SetSessionDescriptionSink,
     public webrtc::PeerConnectionObserver,
     public webrtc::DataChannelObserver {
  public:
-  explicit RTCPeerChannel(const std::string &identifier,
-      SignalingMessageInterface *messaging);
+  RTCPeerChannel(const std::string &identifier,
+      SignalingMessageInterface *messaging, int64_t start_time_us);
 
   ~RTCPeerChannel() override;
 
+  // the owner of the session is granted all input, other peers none
   void Initialize(rtc::scoped_refptr<webrtc::PeerConnectionInterface> &&,
-      rtc::scoped_refptr<webrtc::PeerConnectionFactoryInterface> &,
-      RenderInstanceFactoryInterface *);
+      std::shared_ptr<RTCSession> &&session, bool owner);
+
+  // from when "start" arrived, queueing and admission included, to the
+  // first rendered frame delivered to the tracks of the channels
+  static LatencySummary GetTimeToFirstFrame();
 
   void OnCreateSessionDescriptionSuccess(
       webrtc::SessionDescriptionInterface* desc) override;
@@ -38,6 +47,9 @@ class RTCPeerChannel : public PeerChannelInterface,
   void OnSetSessionDescriptionSuccess(webrtc::SdpType sdp_type) override;
 
   // PeerChannelInterface
+  const std::string &SessionIdentifier() const override;
+  bool OwnsSession() const override { return owner_; }
+  void SetInputPermissions(int permissions) override;
   void Offer() override;
   void AcceptAnswer(const std::string &answer) override;
   void ReceiveICECandidates(
@@ -73,6 +85,10 @@ class RTCPeerChannel : public PeerChannelInterface,
   void OnIceConnectionChange(
       webrtc::PeerConnectionInterface::IceConnectionState new_state) override {}
 
+  // Called any time the PeerConnectionState changes.
+  void OnConnectionChange(
+      webrtc::PeerConnectionInterface::PeerConnectionState new_state) override;
+
   // Called any time the IceGatheringState changes.
   void OnIceGatheringChange(
       webrtc::PeerConnectionInterface::IceGatheringState new_state) override;
@@ -82,16 +98,26 @@ class RTCPeerChannel : public PeerChannelInterface,
       const webrtc::IceCandidateInterface* candidate) override;
 
  private:
+  void AddVideoTrack(webrtc::PeerConnectionInterface *connection,
+      const rtc::scoped_refptr<webrtc::VideoTrackInterface> &track,
+      const BitratePolicy &policy);
+
   std::string identifier_;
   SignalingMessageInterface *messaging_;
+  int64_t start_time_us_;
+  // released after the connection, which holds a sink of its capturer
+  std::shared_ptr<RTCSession> session_;
+  std::unique_ptr<FirstFrameProbe> first_frame_probe_;
+  bool owner_;
+  // written by the signaling messages, read by the data channels
+  std::atomic<int> input_permissions_;
   rtc::scoped_refptr<webrtc::PeerConnectionInterface> connection_;
   rtc::scoped_refptr<webrtc::DataChannelInterface> data_channel_;
+  // unordered, unreliable
+  rtc::scoped_refptr<webrtc::DataChannelInterface> input_channel_;
   rtc::scoped_refptr<CreateSessionDescriptionObserver> create_session_observer_;
   rtc::scoped_refptr<SetSessionDescriptionObserver> set_offer_observer_;
   rtc::scoped_refptr<SetSessionDescriptionObserver> set_answer_observer_;
-  rtc::scoped_refptr<CapturerTrackSource> track_source_;
-  VideoCapturer *video_capturer_;
-  std::unique_ptr<RenderInstanceInterface> render_instance_;
   // gathered ICE candidates so far
   std::vector<ICECandidate> ice_candidates_;
   bool ice_buffering_;
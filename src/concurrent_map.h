@@ -0,0 +1,107 @@
+
+#ifndef RIGEL_BASE_CONCURRENT_MAP_H_
+#define RIGEL_BASE_CONCURRENT_MAP_H_
+
+#include <unordered_map>
+#include <functional>
+#include <utility>
+#include <cstddef>
+
+extern "C" {
+#include <pthread.h>
+}
+
+namespace rigel {
+
+// Hash map split into shards locked on their own, so threads touching
+// different keys rarely wait for each other. Values are copied out, and
+// removed ones are destroyed outside the lock, so they are meant to be
+// cheap handles such as shared pointers.
+template <typename Key, typename Value, typename Hash = std::hash<Key>>
+class ConcurrentMap {
+ public:
+  ConcurrentMap() {
+    for (auto &shard : shards_) {
+      pthread_mutex_init(&shard.mutex, nullptr);
+    }
+  }
+  explicit ConcurrentMap(const ConcurrentMap &) = delete;
+  ~ConcurrentMap() {
+    for (auto &shard : shards_) {
+      pthread_mutex_destroy(&shard.mutex);
+    }
+  }
+
+  // copies the value of key to value, false when absent
+  bool Find(const Key &key, Value *value) {
+    Shard &shard = ShardOf(key);
+    pthread_mutex_lock(&shard.mutex);
+    const auto it = shard.map.find(key);
+    const bool found = it != shard.map.end();
+    if (found) *value = it->second;
+    pthread_mutex_unlock(&shard.mutex);
+    return found;
+  }
+
+  // inserts or replaces, the replaced value is released after unlocking
+  void Insert(const Key &key, Value value) {
+    Shard &shard = ShardOf(key);
+    pthread_mutex_lock(&shard.mutex);
+    std::swap(shard.map[key], value);
+    pthread_mutex_unlock(&shard.mutex);
+  }
+
+  // moves the removed value to value when not null, false when absent
+  bool Erase(const Key &key, Value *value = nullptr) {
+    Shard &shard = ShardOf(key);
+    Value removed;
+    pthread_mutex_lock(&shard.mutex);
+    const auto it = shard.map.find(key);
+    const bool found = it != shard.map.end();
+    if (found) {
+      removed = std::move(it->second);
+      shard.map.erase(it);
+    }
+    pthread_mutex_unlock(&shard.mutex);
+    if (found && value != nullptr) *value = std::move(removed);
+    return found;
+  }
+
+  size_t Size() {
+    size_t size = 0;
+    for (auto &shard : shards_) {
+      pthread_mutex_lock(&shard.mutex);
+      size += shard.map.size();
+      pthread_mutex_unlock(&shard.mutex);
+    }
+    return size;
+  }
+
+  // the values are released shard by shard after unlocking
+  void Clear() {
+    for (auto &shard : shards_) {
+      std::unordered_map<Key, Value, Hash> removed;
+      pthread_mutex_lock(&shard.mutex);
+      removed.swap(shard.map);
+      pthread_mutex_unlock(&shard.mutex);
+    }
+  }
+
+ private:
+  static constexpr size_t kShardCount = 16;
+
+  struct Shard {
+    pthread_mutex_t mutex;
+    std::unordered_map<Key, Value, Hash> map;
+  };
+
+  Shard &ShardOf(const Key &key) {
+    return shards_[Hash()(key) % kShardCount];
+  }
+
+  Shard shards_[kShardCount];
+};
+
+}  // namespace rigel
+
+#endif  // RIGEL_BASE_CONCURRENT_MAP_H_
@@ -0,0 +1,221 @@
+
+#include "encoder_rtc.h"
+#include "frame_trace.h"
+#include "logging.inc"
+
+#include <algorithm>
+#include <atomic>
+
+#include "api/video_codecs/builtin_video_encoder_factory.h"
+#include "api/video/video_frame.h"
+#include "absl/strings/match.h"
+
+extern "C" {
+#include <unistd.h>
+}
+
+namespace rigel {
+
+namespace {
+
+// encoded frames between two latency reports
+constexpr uint64_t kEncodeReportInterval = 300;
+
+}  // unnamed namespace
+
+// Gives every encoder a fixed share of the thread budget, split by the
+// encoders expected at once, so the encoders already running never
+// need to be reconfigured. Encoders beyond that number get a smaller
+// share, only then may the total exceed the budget.
+// One instance per process, set up by the first factory.
+class EncoderThreadBudget {
+ public:
+  EncoderThreadBudget(int budget, int max_encoders)
+      : budget_(budget), max_encoders_(std::max(1, max_encoders)),
+        encoders_(0) {}
+
+  static EncoderThreadBudget *Process(int budget, int max_encoders) {
+    static EncoderThreadBudget *instance =
+        new EncoderThreadBudget(budget, max_encoders);
+    return instance;
+  }
+
+  void Join() { encoders_++; }
+  void Leave() { encoders_--; }
+
+  int Share() const {
+    int encoders = std::max(max_encoders_, encoders_.load());
+    return std::max(1, budget_ / encoders);
+  }
+
+ private:
+  const int budget_;
+  const int max_encoders_;
+  std::atomic<int> encoders_;
+};
+
+// Forwards to the built-in encoder, adjusting its settings and
+// timing the frames it outputs
+class RigelVideoEncoder : public webrtc::VideoEncoder,
+    public webrtc::EncodedImageCallback {
+ public:
+  RigelVideoEncoder(std::unique_ptr<webrtc::VideoEncoder> encoder,
+      const std::string &codec, EncoderContent content,
+      EncoderThreadBudget *budget)
+      : encoder_(std::move(encoder)), codec_(codec), content_(content),
+        budget_(budget), joined_(false), callback_(nullptr),
+        encoded_frames_(0) {}
+
+  ~RigelVideoEncoder() override {
+    Release();
+  }
+
+  int32_t InitEncode(const webrtc::VideoCodec *codec_settings,
+      int32_t number_of_cores, size_t max_payload_size) override {
+    if (!joined_) {
+      budget_->Join();
+      joined_ = true;
+    }
+    webrtc::VideoCodec settings = *codec_settings;
+    ApplyContent(&settings);
+    int32_t cores = std::min(number_of_cores, budget_->Share());
+    RGL_INFO("encoder " + codec_ + " using " + std::to_string(cores) +
+        " threads");
+    return encoder_->InitEncode(&settings, cores, max_payload_size);
+  }
+
+  int32_t RegisterEncodeCompleteCallback(
+      webrtc::EncodedImageCallback *callback) override {
+    callback_ = callback;
+    return encoder_->RegisterEncodeCompleteCallback(this);
+  }
+
+  int32_t Release() override {
+    if (joined_) {
+      budget_->Leave();
+      joined_ = false;
+    }
+    return encoder_->Release();
+  }
+
+  int32_t Encode(const webrtc::VideoFrame &frame,
+      const std::vector<webrtc::VideoFrameType> *frame_types) override {
+    return encoder_->Encode(frame, frame_types);
+  }
+
+  int32_t SetRateAllocation(const webrtc::VideoBitrateAllocation &allocation,
+      uint32_t framerate) override {
+    return encoder_->SetRateAllocation(allocation, framerate);
+  }
+
+  EncoderInfo GetEncoderInfo() const override {
+    return encoder_->GetEncoderInfo();
+  }
+
+  // EncodedImageCallback
+  Result OnEncodedImage(const webrtc::EncodedImage &image,
+      const webrtc::CodecSpecificInfo *info,
+      const webrtc::RTPFragmentationHeader *fragmentation) override {
+    // capture_time_ms_ comes from the VideoFrame timestamp,
+    // which is the capture timestamp of the frame trace
+    if (image.capture_time_ms_ > 0) {
+      const int64_t now = FrameTraceNowMicros();
+      recorder_.RecordStage(kFrameStageEncoded,
+          image.capture_time_ms_ * 1000, now);
+      if (++encoded_frames_ % kEncodeReportInterval == 0) {
+        RGL_INFO(codec_ + " " + recorder_.Report());
+      }
+    }
+    if (callback_ == nullptr) return Result(Result::ERROR_SEND_FAILED);
+    return callback_->OnEncodedImage(image, info, fragmentation);
+  }
+
+ private:
+  void ApplyContent(webrtc::VideoCodec *settings) const {
+    const bool screen = content_ == kEncoderContentScreen;
+    settings->mode = screen ? webrtc::VideoCodecMode::kScreensharing :
+        webrtc::VideoCodecMode::kRealtimeVideo;
+    switch (settings->codecType) {
+      case webrtc::kVideoCodecVP8:
+        settings->VP8()->denoisingOn = false;
+        settings->VP8()->automaticResizeOn = !screen;
+        settings->VP8()->frameDroppingOn = true;
+        break;
+      case webrtc::kVideoCodecVP9:
+        settings->VP9()->denoisingOn = false;
+        settings->VP9()->automaticResizeOn = !screen;
+        settings->VP9()->frameDroppingOn = true;
+        break;
+      case webrtc::kVideoCodecH264:
+        settings->H264()->frameDroppingOn = true;
+        break;
+      default:
+        break;
+    }
+  }
+
+  std::unique_ptr<webrtc::VideoEncoder> encoder_;
+  std::string codec_;
+  EncoderContent content_;
+  EncoderThreadBudget *budget_;
+  bool joined_;
+  webrtc::EncodedImageCallback *callback_;
+  FrameTraceRecorder recorder_;
+  uint64_t encoded_frames_;
+};
+
+EncoderOptions::EncoderOptions()
+    : codec_preference({ "VP8", "VP9", "H264" }),
+      thread_budget(0),
+      max_encoders(8),
+      content(kEncoderContentRealtime) {}
+
+RigelVideoEncoderFactory::RigelVideoEncoderFactory(
+    const EncoderOptions &options)
+    : options_(options),
+      builtin_(webrtc::CreateBuiltinVideoEncoderFactory()) {
+  int budget = options.thread_budget;
+  if (budget <= 0) {
+    budget = std::max(1, static_cast<int>(sysconf(_SC_NPROCESSORS_ONLN)));
+  }
+  budget_ = EncoderThreadBudget::Process(budget, options.max_encoders);
+}
+
+RigelVideoEncoderFactory::~RigelVideoEncoderFactory() = default;
+
+std::vector<webrtc::SdpVideoFormat>
+RigelVideoEncoderFactory::GetSupportedFormats() const {
+  std::vector<webrtc::SdpVideoFormat> formats = builtin_->GetSupportedFormats();
+  auto rank = [this](const webrtc::SdpVideoFormat &format) {
+    const auto &preference = options_.codec_preference;
+    for (size_t i = 0; i < preference.size(); i++) {
+      if (absl::EqualsIgnoreCase(format.name, preference[i])) return i;
+    }
+    return preference.size();
+  };
+  // payload types follow this order, and so does the offer
+  std::stable_sort(formats.begin(), formats.end(),
+      [&rank](const webrtc::SdpVideoFormat &a,
+          const webrtc::SdpVideoFormat &b) {
+        return rank(a) < rank(b);
+      });
+  return formats;
+}
+
+webrtc::VideoEncoderFactory::CodecInfo
+RigelVideoEncoderFactory::QueryVideoEncoder(
+    const webrtc::SdpVideoFormat &format) const {
+  return builtin_->QueryVideoEncoder(format);
+}
+
+std::unique_ptr<webrtc::VideoEncoder>
+RigelVideoEncoderFactory::CreateVideoEncoder(
+    const webrtc::SdpVideoFormat &format) {
+  std::unique_ptr<webrtc::VideoEncoder> encoder =
+      builtin_->CreateVideoEncoder(format);
+  if (encoder == nullptr) return nullptr;
+  return std::unique_ptr<webrtc::VideoEncoder>(new RigelVideoEncoder(
+      std::move(encoder), format.name, options_.content, budget_));
+}
+
+}  // namespace rigel
@@ -0,0 +1,41 @@
+#ifndef RIGEL_RTC_ENCODER_H_
+#define RIGEL_RTC_ENCODER_H_
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "api/video_codecs/sdp_video_format.h"
+#include "api/video_codecs/video_encoder.h"
+#include "api/video_codecs/video_encoder_factory.h"
+
+#include "rtc_options.h"
+
+namespace rigel {
+
+class EncoderThreadBudget;
+
+// Wraps the built-in encoder factory. Formats are offered in the
+// configured preference order, and every encoder is initialized with
+// its fixed share of the process thread budget and the content settings.
+// Encoders also record the encode stage latency of the frames they see.
+class RigelVideoEncoderFactory : public webrtc::VideoEncoderFactory {
+ public:
+  explicit RigelVideoEncoderFactory(const EncoderOptions &options);
+  ~RigelVideoEncoderFactory() override;
+
+  std::vector<webrtc::SdpVideoFormat> GetSupportedFormats() const override;
+  CodecInfo QueryVideoEncoder(
+      const webrtc::SdpVideoFormat &format) const override;
+  std::unique_ptr<webrtc::VideoEncoder> CreateVideoEncoder(
+      const webrtc::SdpVideoFormat &format) override;
+
+ private:
+  EncoderOptions options_;
+  std::unique_ptr<webrtc::VideoEncoderFactory> builtin_;
+  EncoderThreadBudget *budget_;
+};
+
+}  // namespace rigel
+
+#endif  // RIGEL_RTC_ENCODER_H_
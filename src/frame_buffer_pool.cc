@@ -0,0 +1,66 @@
+
+#include "frame_buffer_pool.h"
+
+#include <algorithm>
+
+namespace rigel {
+
+FrameBufferPool::FrameBufferPool(size_t max_buffers)
+    : max_buffers_(std::max<size_t>(1, max_buffers)),
+      width_(0),
+      height_(0),
+      allocations_(0),
+      reuses_(0),
+      exhaustions_(0),
+      buffer_count_(0) {
+  buffers_.reserve(max_buffers_);
+}
+
+void FrameBufferPool::SetMaxBuffers(size_t max_buffers) {
+  max_buffers_ = std::max<size_t>(1, max_buffers);
+}
+
+rtc::scoped_refptr<webrtc::I420Buffer> FrameBufferPool::CreateBuffer(
+    int width, int height) {
+  if (width != width_ || height != height_) {
+    // buffers of the previous size are freed once the encoder drops them
+    buffers_.clear();
+    width_ = width;
+    height_ = height;
+  }
+  for (auto &buffer : buffers_) {
+    // the pool holds the only reference
+    if (buffer->HasOneRef()) {
+      reuses_++;
+      return buffer;
+    }
+  }
+  if (buffers_.size() >= max_buffers_.load(std::memory_order_relaxed)) {
+    exhaustions_++;
+    return nullptr;
+  }
+  rtc::scoped_refptr<PooledBuffer> buffer(new PooledBuffer(width, height));
+  buffers_.push_back(buffer);
+  allocations_++;
+  buffer_count_ = buffers_.size();
+  return buffer;
+}
+
+void FrameBufferPool::Release() {
+  buffers_.erase(std::remove_if(buffers_.begin(), buffers_.end(),
+      [](const rtc::scoped_refptr<PooledBuffer> &buffer) {
+        return buffer->HasOneRef();
+      }), buffers_.end());
+  buffer_count_ = buffers_.size();
+}
+
+FrameBufferPoolStats FrameBufferPool::GetStats() const {
+  FrameBufferPoolStats stats;
+  stats.allocations = allocations_;
+  stats.reuses = reuses_;
+  stats.exhaustions = exhaustions_;
+  stats.buffers = buffer_count_;
+  return stats;
+}
+
+}  // namespace rigel
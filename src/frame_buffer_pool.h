@@ -0,0 +1,61 @@
+
+#ifndef RIGEL_RTC_FRAME_BUFFER_POOL_H_
+#define RIGEL_RTC_FRAME_BUFFER_POOL_H_
+
+#include <atomic>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#include "api/scoped_refptr.h"
+#include "api/video/i420_buffer.h"
+#include "rtc_base/ref_counted_object.h"
+
+namespace rigel {
+
+struct FrameBufferPoolStats {
+  // buffers allocated since creation, including size changes
+  uint64_t allocations;
+  // requests served by a buffer the encoder had released
+  uint64_t reuses;
+  // requests refused because every buffer was still referenced
+  uint64_t exhaustions;
+  size_t buffers;
+};
+
+// Bounded set of I420 buffers of a single size. A buffer goes back to the
+// pool once every VideoFrame referencing it has been released, so the
+// producer never writes into a frame the encoder is still reading.
+// After the first frames no allocation happens while the size is stable.
+// CreateBuffer must be called from a single thread, stats and the limit
+// from any.
+class FrameBufferPool {
+ public:
+  explicit FrameBufferPool(size_t max_buffers);
+  explicit FrameBufferPool(const FrameBufferPool &) = delete;
+
+  // returns nullptr when all max_buffers buffers are in use
+  rtc::scoped_refptr<webrtc::I420Buffer> CreateBuffer(int width, int height);
+  // drops the buffers that are not referenced outside the pool
+  void Release();
+  // buffers in use beyond a lowered limit are kept until released
+  void SetMaxBuffers(size_t max_buffers);
+
+  FrameBufferPoolStats GetStats() const;
+
+ private:
+  typedef rtc::RefCountedObject<webrtc::I420Buffer> PooledBuffer;
+
+  std::atomic<size_t> max_buffers_;
+  int width_;
+  int height_;
+  std::vector<rtc::scoped_refptr<PooledBuffer>> buffers_;
+  std::atomic<uint64_t> allocations_;
+  std::atomic<uint64_t> reuses_;
+  std::atomic<uint64_t> exhaustions_;
+  std::atomic<size_t> buffer_count_;
+};
+
+}  // namespace rigel
+
+#endif  // RIGEL_RTC_FRAME_BUFFER_POOL_H_
@@ -0,0 +1,308 @@
+
+#include "frame_converter.h"
+#include "worker_pool.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define RGL_CONVERT_X86 1
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define RGL_CONVERT_NEON 1
+#endif
+
+#include "third_party/libyuv/include/libyuv.h"
+
+namespace rigel {
+
+namespace {
+
+// bands smaller than this are not worth a task
+constexpr int kMinBandRows = 32;
+
+inline uint8_t RgbToY(int r, int g, int b) {
+  return static_cast<uint8_t>((66 * r + 129 * g + 25 * b + 0x1080) >> 8);
+}
+
+inline uint8_t RgbToU(int r, int g, int b) {
+  return static_cast<uint8_t>((112 * b - 74 * g - 38 * r + 0x8080) >> 8);
+}
+
+inline uint8_t RgbToV(int r, int g, int b) {
+  return static_cast<uint8_t>((112 * r - 94 * g - 18 * b + 0x8080) >> 8);
+}
+
+void YRowScalar(const uint8_t *src, uint8_t *dst_y, int width) {
+  for (int x = 0; x < width; x++) {
+    dst_y[x] = RgbToY(src[0], src[1], src[2]);
+    src += 4;
+  }
+}
+
+// averages 2x2 blocks, an odd last column is averaged vertically only
+void UVRowScalar(const uint8_t *src0, const uint8_t *src1,
+    uint8_t *dst_u, uint8_t *dst_v, int width) {
+  for (int x = 0; x < width; x += 2) {
+    int next = x + 1 < width ? 4 : 0;
+    int r = (src0[0] + src0[next + 0] + src1[0] + src1[next + 0] + 2) >> 2;
+    int g = (src0[1] + src0[next + 1] + src1[1] + src1[next + 1] + 2) >> 2;
+    int b = (src0[2] + src0[next + 2] + src1[2] + src1[next + 2] + 2) >> 2;
+    dst_u[x / 2] = RgbToU(r, g, b);
+    dst_v[x / 2] = RgbToV(r, g, b);
+    src0 += 8;
+    src1 += 8;
+  }
+}
+
+// Converts two source rows into two luma rows and one chroma row.
+// Returns the number of leading pixels handled, always even.
+typedef int (*RowPairKernel)(const uint8_t *src0, const uint8_t *src1,
+    uint8_t *dst_y0, uint8_t *dst_y1, uint8_t *dst_u, uint8_t *dst_v,
+    int width);
+
+int RowPairNone(const uint8_t *, const uint8_t *, uint8_t *, uint8_t *,
+    uint8_t *, uint8_t *, int) {
+  return 0;
+}
+
+#if defined(RGL_CONVERT_X86)
+__attribute__((target("avx2")))
+inline void YRowAVX2(const uint8_t *src, uint8_t *dst_y,
+    const __m256i &coefficients, const __m256i &permute) {
+  __m256i pixels = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src));
+  __m256i lo = _mm256_cvtepu8_epi16(_mm256_castsi256_si128(pixels));
+  __m256i hi = _mm256_cvtepu8_epi16(_mm256_extracti128_si256(pixels, 1));
+  // lane 0 holds pixels 0, 1, 4, 5 and lane 1 pixels 2, 3, 6, 7
+  __m256i sum = _mm256_hadd_epi32(_mm256_madd_epi16(lo, coefficients),
+      _mm256_madd_epi16(hi, coefficients));
+  sum = _mm256_srai_epi32(
+      _mm256_add_epi32(sum, _mm256_set1_epi32(0x1080)), 8);
+  sum = _mm256_permutevar8x32_epi32(sum, permute);
+  __m128i words = _mm_packus_epi32(_mm256_castsi256_si128(sum),
+      _mm256_extracti128_si256(sum, 1));
+  _mm_storel_epi64(reinterpret_cast<__m128i *>(dst_y),
+      _mm_packus_epi16(words, words));
+}
+
+// sums of the four channels of two horizontally adjacent pixels
+// of both rows, in the low 64 bits of each lane
+__attribute__((target("avx2")))
+inline __m256i SumPairsAVX2(__m128i row0, __m128i row1) {
+  __m256i sum = _mm256_add_epi16(_mm256_cvtepu8_epi16(row0),
+      _mm256_cvtepu8_epi16(row1));
+  return _mm256_add_epi16(sum, _mm256_srli_si256(sum, 8));
+}
+
+__attribute__((target("avx2")))
+int RowPairAVX2(const uint8_t *src0, const uint8_t *src1,
+    uint8_t *dst_y0, uint8_t *dst_y1, uint8_t *dst_u, uint8_t *dst_v,
+    int width) {
+  const __m256i y_coefficients = _mm256_setr_epi16(
+      66, 129, 25, 0, 66, 129, 25, 0, 66, 129, 25, 0, 66, 129, 25, 0);
+  const __m256i u_coefficients = _mm256_setr_epi16(
+      -38, -74, 112, 0, -38, -74, 112, 0,
+      -38, -74, 112, 0, -38, -74, 112, 0);
+  const __m256i v_coefficients = _mm256_setr_epi16(
+      112, -94, -18, 0, 112, -94, -18, 0,
+      112, -94, -18, 0, 112, -94, -18, 0);
+  const __m256i y_permute = _mm256_setr_epi32(0, 1, 4, 5, 2, 3, 6, 7);
+  const __m256i uv_permute = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+  int x = 0;
+  for (; x + 8 <= width; x += 8) {
+    YRowAVX2(src0, dst_y0 + x, y_coefficients, y_permute);
+    YRowAVX2(src1, dst_y1 + x, y_coefficients, y_permute);
+
+    __m256i row0 = _mm256_loadu_si256(
+        reinterpret_cast<const __m256i *>(src0));
+    __m256i row1 = _mm256_loadu_si256(
+        reinterpret_cast<const __m256i *>(src1));
+    __m256i lo = SumPairsAVX2(_mm256_castsi256_si128(row0),
+        _mm256_castsi256_si128(row1));
+    __m256i hi = SumPairsAVX2(_mm256_extracti128_si256(row0, 1),
+        _mm256_extracti128_si256(row1, 1));
+    // lane 0 holds blocks 0, 2 and lane 1 blocks 1, 3
+    __m256i average = _mm256_srli_epi16(_mm256_add_epi16(
+        _mm256_unpacklo_epi64(lo, hi), _mm256_set1_epi16(2)), 2);
+    __m256i uv = _mm256_hadd_epi32(
+        _mm256_madd_epi16(average, u_coefficients),
+        _mm256_madd_epi16(average, v_coefficients));
+    uv = _mm256_srai_epi32(
+        _mm256_add_epi32(uv, _mm256_set1_epi32(0x8080)), 8);
+    uv = _mm256_permutevar8x32_epi32(uv, uv_permute);
+    __m128i words = _mm_packus_epi32(_mm256_castsi256_si128(uv),
+        _mm256_extracti128_si256(uv, 1));
+    __m128i bytes = _mm_packus_epi16(words, words);
+    int32_t u = _mm_cvtsi128_si32(bytes);
+    int32_t v = _mm_cvtsi128_si32(_mm_srli_si128(bytes, 4));
+    memcpy(dst_u + x / 2, &u, sizeof(u));
+    memcpy(dst_v + x / 2, &v, sizeof(v));
+    src0 += 32;
+    src1 += 32;
+  }
+  return x;
+}
+#endif  // RGL_CONVERT_X86
+
+#if defined(RGL_CONVERT_NEON)
+inline uint8x8_t YNEON(uint8x8_t r, uint8x8_t g, uint8x8_t b) {
+  uint16x8_t y = vmull_u8(r, vdup_n_u8(66));
+  y = vmlal_u8(y, g, vdup_n_u8(129));
+  y = vmlal_u8(y, b, vdup_n_u8(25));
+  return vshrn_n_u16(vaddq_u16(y, vdupq_n_u16(0x1080)), 8);
+}
+
+int RowPairNEON(const uint8_t *src0, const uint8_t *src1,
+    uint8_t *dst_y0, uint8_t *dst_y1, uint8_t *dst_u, uint8_t *dst_v,
+    int width) {
+  int x = 0;
+  for (; x + 16 <= width; x += 16) {
+    uint8x16x4_t row0 = vld4q_u8(src0);
+    uint8x16x4_t row1 = vld4q_u8(src1);
+    vst1_u8(dst_y0 + x, YNEON(vget_low_u8(row0.val[0]),
+        vget_low_u8(row0.val[1]), vget_low_u8(row0.val[2])));
+    vst1_u8(dst_y0 + x + 8, YNEON(vget_high_u8(row0.val[0]),
+        vget_high_u8(row0.val[1]), vget_high_u8(row0.val[2])));
+    vst1_u8(dst_y1 + x, YNEON(vget_low_u8(row1.val[0]),
+        vget_low_u8(row1.val[1]), vget_low_u8(row1.val[2])));
+    vst1_u8(dst_y1 + x + 8, YNEON(vget_high_u8(row1.val[0]),
+        vget_high_u8(row1.val[1]), vget_high_u8(row1.val[2])));
+    // (sum + 2) >> 2 over each 2x2 block
+    uint16x8_t r = vrshrq_n_u16(vaddq_u16(vpaddlq_u8(row0.val[0]),
+        vpaddlq_u8(row1.val[0])), 2);
+    uint16x8_t g = vrshrq_n_u16(vaddq_u16(vpaddlq_u8(row0.val[1]),
+        vpaddlq_u8(row1.val[1])), 2);
+    uint16x8_t b = vrshrq_n_u16(vaddq_u16(vpaddlq_u8(row0.val[2]),
+        vpaddlq_u8(row1.val[2])), 2);
+    // the offset keeps the final sums positive, so wrapping
+    // intermediates are harmless
+    uint16x8_t u = vmulq_n_u16(b, 112);
+    u = vmlsq_n_u16(u, g, 74);
+    u = vmlsq_n_u16(u, r, 38);
+    vst1_u8(dst_u + x / 2,
+        vshrn_n_u16(vaddq_u16(u, vdupq_n_u16(0x8080)), 8));
+    uint16x8_t v = vmulq_n_u16(r, 112);
+    v = vmlsq_n_u16(v, g, 94);
+    v = vmlsq_n_u16(v, b, 18);
+    vst1_u8(dst_v + x / 2,
+        vshrn_n_u16(vaddq_u16(v, vdupq_n_u16(0x8080)), 8));
+    src0 += 64;
+    src1 += 64;
+  }
+  return x;
+}
+#endif  // RGL_CONVERT_NEON
+
+RowPairKernel GetRowPairKernel(RgbaToI420Converter::Kernel kernel) {
+  switch (kernel) {
+#if defined(RGL_CONVERT_X86)
+    case RgbaToI420Converter::kKernelAVX2:
+      return RowPairAVX2;
+#endif
+#if defined(RGL_CONVERT_NEON)
+    case RgbaToI420Converter::kKernelNEON:
+      return RowPairNEON;
+#endif
+    default:
+      return RowPairNone;
+  }
+}
+
+void ConvertBand(RowPairKernel kernel, const uint8_t *src, int src_stride,
+    const I420Planes &dst, int width, int y, int height) {
+  for (int row = y; row < y + height; row += 2) {
+    // an odd last row is paired with itself
+    int next = row + 1 < y + height ? row + 1 : row;
+    const uint8_t *src0 = src + static_cast<ptrdiff_t>(row) * src_stride;
+    const uint8_t *src1 = src + static_cast<ptrdiff_t>(next) * src_stride;
+    uint8_t *dst_y0 = dst.y + static_cast<ptrdiff_t>(row) * dst.stride_y;
+    uint8_t *dst_y1 = dst.y + static_cast<ptrdiff_t>(next) * dst.stride_y;
+    uint8_t *dst_u = dst.u + static_cast<ptrdiff_t>(row / 2) * dst.stride_u;
+    uint8_t *dst_v = dst.v + static_cast<ptrdiff_t>(row / 2) * dst.stride_v;
+    int x = kernel(src0, src1, dst_y0, dst_y1, dst_u, dst_v, width);
+    YRowScalar(src0 + x * 4, dst_y0 + x, width - x);
+    YRowScalar(src1 + x * 4, dst_y1 + x, width - x);
+    UVRowScalar(src0 + x * 4, src1 + x * 4,
+        dst_u + x / 2, dst_v + x / 2, width - x);
+  }
+}
+
+}  // unnamed namespace
+
+RgbaToI420Converter::RgbaToI420Converter(WorkerPool *pool)
+    : pool_(pool), kernel_(BestKernel()), max_threads_(0) {}
+
+RgbaToI420Converter::Kernel RgbaToI420Converter::BestKernel() {
+#if defined(RGL_CONVERT_X86)
+  if (__builtin_cpu_supports("avx2")) return kKernelAVX2;
+#endif
+#if defined(RGL_CONVERT_NEON)
+  return kKernelNEON;
+#endif
+  return kKernelLibyuv;
+}
+
+const char *RgbaToI420Converter::KernelName(Kernel kernel) {
+  switch (kernel) {
+    case kKernelLibyuv:
+      return "libyuv";
+    case kKernelScalar:
+      return "scalar";
+    case kKernelAVX2:
+      return "avx2";
+    case kKernelNEON:
+      return "neon";
+  }
+  return "unknown";
+}
+
+void RgbaToI420Converter::SetKernel(Kernel kernel) {
+  // kernels the processor cannot run fall back to libyuv
+  bool supported = kernel == kKernelLibyuv || kernel == kKernelScalar;
+#if defined(RGL_CONVERT_X86)
+  supported |= kernel == kKernelAVX2 && __builtin_cpu_supports("avx2");
+#endif
+#if defined(RGL_CONVERT_NEON)
+  supported |= kernel == kKernelNEON;
+#endif
+  kernel_ = supported ? kernel : kKernelLibyuv;
+}
+
+void RgbaToI420Converter::Convert(const uint8_t *src, int src_stride,
+    const I420Planes &dst, int width, int y, int height) {
+  if (height <= 0 || width <= 0) return;
+  size_t threads = pool_ != nullptr ? pool_->Concurrency() : 1;
+  if (max_threads_ > 0) threads = std::min(threads, max_threads_);
+  size_t bands = std::max<size_t>(1,
+      std::min<size_t>(threads, height / kMinBandRows));
+  // bands start on even rows so that they own whole chroma rows
+  int band_rows = static_cast<int>((height + bands - 1) / bands + 1) & ~1;
+  const Kernel kernel = kernel_;
+  auto convert_band = [&](size_t band) {
+    int band_y = y + static_cast<int>(band) * band_rows;
+    int rows = std::min(band_rows, y + height - band_y);
+    if (rows <= 0) return;
+    if (kernel == kKernelLibyuv) {
+      libyuv::ABGRToI420(
+          src + static_cast<ptrdiff_t>(band_y) * src_stride, src_stride,
+          dst.y + static_cast<ptrdiff_t>(band_y) * dst.stride_y, dst.stride_y,
+          dst.u + static_cast<ptrdiff_t>(band_y / 2) * dst.stride_u,
+          dst.stride_u,
+          dst.v + static_cast<ptrdiff_t>(band_y / 2) * dst.stride_v,
+          dst.stride_v,
+          width, rows);
+    } else {
+      ConvertBand(GetRowPairKernel(kernel), src, src_stride, dst,
+          width, band_y, rows);
+    }
+  };
+  if (bands == 1 || pool_ == nullptr) {
+    for (size_t band = 0; band < bands; band++) convert_band(band);
+  } else {
+    pool_->ParallelFor(bands, convert_band);
+  }
+}
+
+}  // namespace rigel
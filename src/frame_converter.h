@@ -0,0 +1,58 @@
+
+#ifndef RIGEL_RTC_FRAME_CONVERTER_H_
+#define RIGEL_RTC_FRAME_CONVERTER_H_
+
+#include <cstdint>
+#include <cstddef>
+
+namespace rigel {
+
+class WorkerPool;
+
+struct I420Planes {
+  uint8_t *y;
+  int stride_y;
+  uint8_t *u;
+  int stride_u;
+  uint8_t *v;
+  int stride_v;
+};
+
+// Converts RGBA frames (libyuv ABGR) to I420 with BT.601 limited range
+// coefficients. The rows are split into bands converted in parallel on
+// a worker pool, each band writing straight into the destination planes.
+class RgbaToI420Converter {
+ public:
+  enum Kernel {
+    kKernelLibyuv = 0,
+    kKernelScalar,
+    kKernelAVX2,
+    kKernelNEON,
+  };
+
+  explicit RgbaToI420Converter(WorkerPool *pool);
+  explicit RgbaToI420Converter(const RgbaToI420Converter &) = delete;
+
+  // the fastest kernel supported by the running processor
+  static Kernel BestKernel();
+  static const char *KernelName(Kernel kernel);
+
+  void SetKernel(Kernel kernel);
+  Kernel GetKernel() const { return kernel_; }
+  // 0 uses every thread of the pool
+  void SetMaxThreads(size_t max_threads) { max_threads_ = max_threads; }
+
+  // converts the rows [y, y + height) of the source into the same rows
+  // of the destination. y must be even
+  void Convert(const uint8_t *src, int src_stride, const I420Planes &dst,
+      int width, int y, int height);
+
+ private:
+  WorkerPool *pool_;
+  Kernel kernel_;
+  size_t max_threads_;
+};
+
+}  // namespace rigel
+
+#endif  // RIGEL_RTC_FRAME_CONVERTER_H_
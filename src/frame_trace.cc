@@ -0,0 +1,202 @@
+
+#include "frame_trace.h"
+
+#include <sstream>
+#include <algorithm>
+#include <cstring>
+
+extern "C" {
+#include <time.h>
+#include <pthread.h>
+}
+
+namespace rigel {
+
+int64_t FrameTraceNowMicros() {
+  timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return static_cast<int64_t>(time.tv_sec) * 1000000 + time.tv_nsec / 1000;
+}
+
+const char *FrameStageName(FrameStage stage) {
+  switch (stage) {
+    case kFrameStageRenderSubmit:
+      return "submit";
+    case kFrameStageGpuComplete:
+      return "gpu";
+    case kFrameStageReadback:
+      return "readback";
+    case kFrameStageConverted:
+      return "convert";
+    case kFrameStageDelivered:
+      return "deliver";
+    case kFrameStageEncoded:
+      return "encode";
+    case kFrameStageCount:
+      break;
+  }
+  return "unknown";
+}
+
+constexpr size_t LatencyHistogram::kBucketCount;
+
+LatencyHistogram::LatencyHistogram() {
+  Reset();
+}
+
+size_t LatencyHistogram::BucketOf(int64_t latency_us) {
+  if (latency_us < 16) return static_cast<size_t>(std::max<int64_t>(
+      latency_us, 0));
+  uint64_t value = static_cast<uint64_t>(latency_us);
+  int exponent = 63 - __builtin_clzll(value);
+  size_t sub = (value >> (exponent - 3)) & 7;
+  size_t bucket = 16 + static_cast<size_t>(exponent - 4) * 8 + sub;
+  return std::min(bucket, kBucketCount - 1);
+}
+
+int64_t LatencyHistogram::LowerBoundOf(size_t bucket) {
+  if (bucket < 16) return static_cast<int64_t>(bucket);
+  int exponent = static_cast<int>((bucket - 16) / 8) + 4;
+  int64_t sub = static_cast<int64_t>((bucket - 16) % 8);
+  return (8 + sub) << (exponent - 3);
+}
+
+void LatencyHistogram::Add(int64_t latency_us) {
+  buckets_[BucketOf(latency_us)]++;
+  count_++;
+}
+
+void LatencyHistogram::Reset() {
+  memset(buckets_, 0, sizeof(buckets_));
+  count_ = 0;
+}
+
+int64_t LatencyHistogram::Percentile(double percentile) const {
+  if (count_ == 0) return 0;
+  uint64_t rank = static_cast<uint64_t>(
+      percentile / 100.0 * static_cast<double>(count_ - 1)) + 1;
+  uint64_t seen = 0;
+  for (size_t bucket = 0; bucket < kBucketCount; bucket++) {
+    seen += buckets_[bucket];
+    if (seen >= rank) return LowerBoundOf(bucket);
+  }
+  return LowerBoundOf(kBucketCount - 1);
+}
+
+LatencySummary LatencyHistogram::Summarize() const {
+  LatencySummary summary;
+  summary.count = count_;
+  summary.p50_us = Percentile(50);
+  summary.p95_us = Percentile(95);
+  summary.p99_us = Percentile(99);
+  return summary;
+}
+
+class FrameTraceRecorderState {
+ public:
+  FrameTraceRecorderState() : input_sequence_(0) {
+    pthread_mutex_init(&mutex_, nullptr);
+  }
+
+  ~FrameTraceRecorderState() {
+    pthread_mutex_destroy(&mutex_);
+  }
+
+  void Record(const FrameTrace &trace) {
+    pthread_mutex_lock(&mutex_);
+    for (int stage = 0; stage < kFrameStageCount; stage++) {
+      if (trace.stage_time_us[stage] == 0) continue;
+      histograms_[stage].Add(
+          trace.stage_time_us[stage] - trace.capture_time_us);
+    }
+    const int64_t delivered = trace.stage_time_us[kFrameStageDelivered];
+    if (trace.input_sequence != 0 && trace.input_sequence != input_sequence_ &&
+        delivered != 0) {
+      input_.Add(delivered - trace.input_time_us);
+      input_sequence_ = trace.input_sequence;
+    }
+    pthread_mutex_unlock(&mutex_);
+  }
+
+  void RecordStage(FrameStage stage, int64_t latency_us) {
+    pthread_mutex_lock(&mutex_);
+    histograms_[stage].Add(latency_us);
+    pthread_mutex_unlock(&mutex_);
+  }
+
+  LatencySummary GetSummary(FrameStage stage) {
+    pthread_mutex_lock(&mutex_);
+    LatencySummary summary = histograms_[stage].Summarize();
+    pthread_mutex_unlock(&mutex_);
+    return summary;
+  }
+
+  LatencySummary GetInputSummary() {
+    pthread_mutex_lock(&mutex_);
+    LatencySummary summary = input_.Summarize();
+    pthread_mutex_unlock(&mutex_);
+    return summary;
+  }
+
+  void Reset() {
+    pthread_mutex_lock(&mutex_);
+    for (auto &histogram : histograms_) histogram.Reset();
+    input_.Reset();
+    pthread_mutex_unlock(&mutex_);
+  }
+
+ private:
+  pthread_mutex_t mutex_;
+  LatencyHistogram histograms_[kFrameStageCount];
+  // input arrival to delivery of the first frame reflecting it
+  LatencyHistogram input_;
+  uint32_t input_sequence_;
+};
+
+FrameTraceRecorder::FrameTraceRecorder()
+    : state_(new FrameTraceRecorderState()) {}
+
+FrameTraceRecorder::~FrameTraceRecorder() {
+  delete state_;
+}
+
+void FrameTraceRecorder::Record(const FrameTrace &trace) {
+  state_->Record(trace);
+}
+
+void FrameTraceRecorder::RecordStage(FrameStage stage,
+    int64_t capture_time_us, int64_t stage_time_us) {
+  state_->RecordStage(stage, stage_time_us - capture_time_us);
+}
+
+LatencySummary FrameTraceRecorder::GetSummary(FrameStage stage) const {
+  return state_->GetSummary(stage);
+}
+
+LatencySummary FrameTraceRecorder::GetInputSummary() const {
+  return state_->GetInputSummary();
+}
+
+std::string FrameTraceRecorder::Report() const {
+  std::ostringstream out;
+  for (int stage = 0; stage <= kFrameStageCount; stage++) {
+    // the input latency follows the stages
+    bool input = stage == kFrameStageCount;
+    LatencySummary summary = input ? GetInputSummary() :
+        GetSummary(static_cast<FrameStage>(stage));
+    if (summary.count == 0) continue;
+    if (out.tellp() > 0) out << "\n";
+    out << (input ? "input" : FrameStageName(static_cast<FrameStage>(stage)))
+        << " p50 " << summary.p50_us / 1000.0
+        << " ms, p95 " << summary.p95_us / 1000.0
+        << " ms, p99 " << summary.p99_us / 1000.0
+        << " ms (" << summary.count << " frames)";
+  }
+  return out.str();
+}
+
+void FrameTraceRecorder::Reset() {
+  state_->Reset();
+}
+
+}  // namespace rigel
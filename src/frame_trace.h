@@ -0,0 +1,100 @@
+
+#ifndef RIGEL_BASE_FRAME_TRACE_H_
+#define RIGEL_BASE_FRAME_TRACE_H_
+
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+namespace rigel {
+
+class FrameTraceRecorderState;
+
+// pipeline stages a frame goes through after its tick started
+enum FrameStage {
+  kFrameStageRenderSubmit = 0,
+  kFrameStageGpuComplete,
+  kFrameStageReadback,
+  kFrameStageConverted,
+  kFrameStageDelivered,
+  kFrameStageEncoded,
+  kFrameStageCount,
+};
+
+// CLOCK_MONOTONIC microseconds, the clock rtc::TimeMicros uses on Linux
+int64_t FrameTraceNowMicros();
+const char *FrameStageName(FrameStage stage);
+
+// Timestamps of a single frame, carried along with it from the tick
+// that rendered it to the encoder. Stages not reached are zero.
+struct FrameTrace {
+  uint64_t id;
+  int64_t capture_time_us;
+  int64_t stage_time_us[kFrameStageCount];
+  // latest client input consumed by the frame, 0 for none,
+  // and when the server received it
+  uint32_t input_sequence;
+  int64_t input_time_us;
+
+  void Mark(FrameStage stage) { stage_time_us[stage] = FrameTraceNowMicros(); }
+};
+
+struct LatencySummary {
+  uint64_t count;
+  int64_t p50_us;
+  int64_t p95_us;
+  int64_t p99_us;
+};
+
+// Log-linear histogram of latencies in microseconds, eight buckets per
+// power of two, so percentiles are exact to within 12.5%.
+// Adding a sample never allocates.
+class LatencyHistogram {
+ public:
+  LatencyHistogram();
+
+  void Add(int64_t latency_us);
+  void Reset();
+  uint64_t Count() const { return count_; }
+  // percentile in [0, 100], 0 when empty
+  int64_t Percentile(double percentile) const;
+  LatencySummary Summarize() const;
+
+ private:
+  static constexpr size_t kBucketCount = 16 + 40 * 8;
+  static size_t BucketOf(int64_t latency_us);
+  static int64_t LowerBoundOf(size_t bucket);
+
+  uint64_t buckets_[kBucketCount];
+  uint64_t count_;
+};
+
+// Per-session latency of every stage relative to the capture timestamp.
+// Record is called by the producing threads, summaries can be read from
+// any thread.
+class FrameTraceRecorder {
+ public:
+  FrameTraceRecorder();
+  explicit FrameTraceRecorder(const FrameTraceRecorder &) = delete;
+  ~FrameTraceRecorder();
+
+  // adds every stage the trace reached, and the time from input arrival
+  // to delivery when the frame is the first to reflect its input
+  void Record(const FrameTrace &trace);
+  // adds a stage observed after the trace was recorded
+  void RecordStage(FrameStage stage, int64_t capture_time_us,
+      int64_t stage_time_us);
+
+  LatencySummary GetSummary(FrameStage stage) const;
+  LatencySummary GetInputSummary() const;
+  // one line per stage with samples
+  std::string Report() const;
+  void Reset();
+
+ private:
+  FrameTraceRecorderState *state_;
+};
+
+}  // namespace rigel
+
+#endif  // RIGEL_BASE_FRAME_TRACE_H_
@@ -0,0 +1,151 @@
+
+#include "input_protocol.h"
+
+#include <algorithm>
+#include <limits>
+
+namespace rigel {
+
+namespace {
+
+inline uint16_t ReadU16(const uint8_t *p) {
+  return static_cast<uint16_t>(p[0] | (p[1] << 8));
+}
+
+inline uint32_t ReadU32(const uint8_t *p) {
+  return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+      (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+inline void WriteU16(uint8_t *p, uint16_t value) {
+  p[0] = static_cast<uint8_t>(value);
+  p[1] = static_cast<uint8_t>(value >> 8);
+}
+
+inline void WriteU32(uint8_t *p, uint32_t value) {
+  for (int i = 0; i < 4; i++) p[i] = static_cast<uint8_t>(value >> (i * 8));
+}
+
+// parses a decimal integer field ending at a comma or the end
+bool ParseField(const char **cursor, const char *end, int64_t *value) {
+  const char *p = *cursor;
+  bool negative = false;
+  if (p < end && (*p == '-' || *p == '+')) {
+    negative = *p == '-';
+    p++;
+  }
+  if (p == end || *p < '0' || *p > '9') return false;
+  int64_t result = 0;
+  for (; p < end && *p >= '0' && *p <= '9'; p++) {
+    result = result * 10 + (*p - '0');
+    if (result > std::numeric_limits<uint32_t>::max()) return false;
+  }
+  if (p < end) {
+    if (*p != ',') return false;
+    p++;
+  }
+  *value = negative ? -result : result;
+  *cursor = p;
+  return true;
+}
+
+bool FitsInt(int64_t value) {
+  return value >= std::numeric_limits<int>::min() &&
+      value <= std::numeric_limits<int>::max();
+}
+
+}  // unnamed namespace
+
+InputBatchReader::InputBatchReader(const uint8_t *data, size_t size)
+    : data_(data), count_(0), index_(0), sequence_(0), offset_us_(0),
+      valid_(false) {
+  if (size < kInputBatchHeaderSize || data[0] != kInputProtocolVersion) {
+    return;
+  }
+  count_ = data[1];
+  if (size < kInputBatchHeaderSize + count_ * kInputEventSize) return;
+  sequence_ = ReadU32(data + 4);
+  data_ = data + kInputBatchHeaderSize;
+  // offsets are counted back from the last event
+  for (size_t i = 1; i < count_; i++) {
+    offset_us_ += ReadU16(data_ + i * kInputEventSize + 2);
+  }
+  valid_ = true;
+}
+
+bool InputBatchReader::Next(InputEvent *event) {
+  while (valid_ && index_ < count_) {
+    const uint8_t *p = data_ + index_ * kInputEventSize;
+    if (index_ > 0) offset_us_ -= ReadU16(p + 2);
+    uint32_t sequence = sequence_ != 0 ?
+        sequence_ + static_cast<uint32_t>(index_) : 0;
+    index_++;
+    const int a = static_cast<int16_t>(ReadU16(p + 4));
+    const int b = static_cast<int16_t>(ReadU16(p + 6));
+    if (p[0] == kInputEventMotion) {
+      *event = InputEvent { kInputEventMotion, a, b, 0, sequence, offset_us_ };
+      return true;
+    }
+    if (p[0] == kInputEventWheel) {
+      *event = InputEvent { kInputEventWheel, 0, 0, a, sequence, offset_us_ };
+      return true;
+    }
+  }
+  return false;
+}
+
+size_t WriteInputBatch(const InputEvent *events, size_t count,
+    const uint32_t *delta_us, uint8_t *out, size_t capacity) {
+  const size_t size = kInputBatchHeaderSize + count * kInputEventSize;
+  if (count > kInputBatchMaxEvents || capacity < size) return 0;
+  out[0] = kInputProtocolVersion;
+  out[1] = static_cast<uint8_t>(count);
+  WriteU16(out + 2, 0);
+  WriteU32(out + 4, count > 0 ? events[0].sequence : 0);
+  for (size_t i = 0; i < count; i++) {
+    uint8_t *p = out + kInputBatchHeaderSize + i * kInputEventSize;
+    const InputEvent &event = events[i];
+    const bool wheel = event.type == kInputEventWheel;
+    p[0] = static_cast<uint8_t>(event.type);
+    p[1] = 0;
+    WriteU16(p + 2, static_cast<uint16_t>(
+        std::min<uint32_t>(delta_us[i], 0xffff)));
+    WriteU16(p + 4, static_cast<uint16_t>(static_cast<int16_t>(
+        wheel ? event.z : event.x)));
+    WriteU16(p + 6, static_cast<uint16_t>(static_cast<int16_t>(
+        wheel ? 0 : event.y)));
+  }
+  return size;
+}
+
+bool ParseInputText(const char *data, size_t size, InputEvent *event) {
+  if (size < 2 || data[1] != ',') return false;
+  const char *end = data + size;
+  const char *cursor = data + 2;
+  int64_t values[3] = { 0, 0, 0 };
+  size_t count = 0;
+  while (cursor < end && count < 3) {
+    if (!ParseField(&cursor, end, &values[count])) return false;
+    count++;
+  }
+  if (cursor != end) return false;
+  InputEvent parsed = {};
+  if (data[0] == 'm' && count >= 2) {
+    parsed.type = kInputEventMotion;
+    parsed.x = static_cast<int>(values[0]);
+    parsed.y = static_cast<int>(values[1]);
+    if (!FitsInt(values[0]) || !FitsInt(values[1])) return false;
+    if (count == 3) parsed.sequence = static_cast<uint32_t>(values[2]);
+  } else if (data[0] == 'w' && count >= 1 && count <= 2) {
+    parsed.type = kInputEventWheel;
+    parsed.z = static_cast<int>(values[0]);
+    if (!FitsInt(values[0])) return false;
+    if (count == 2) parsed.sequence = static_cast<uint32_t>(values[1]);
+  } else {
+    return false;
+  }
+  *event = parsed;
+  return true;
+}
+
+}  // namespace rigel
@@ -0,0 +1,68 @@
+
+#ifndef RIGEL_BASE_INPUT_PROTOCOL_H_
+#define RIGEL_BASE_INPUT_PROTOCOL_H_
+
+#include <cstdint>
+#include <cstddef>
+
+namespace rigel {
+
+// Binary input messages, little endian, version 1:
+//   u8 version, u8 event count, u16 reserved,
+//   u32 sequence of the first event, 0 for unsequenced events,
+//   then per event
+//   u8 type, u8 reserved, u16 microseconds since the previous event,
+//   i16 x, i16 y (the wheel delta is in x).
+// Events of a batch are numbered consecutively from the first sequence.
+// Text messages "m,x,y[,sequence]" and "w,z[,sequence]" are still
+// accepted for older clients.
+constexpr uint8_t kInputProtocolVersion = 1;
+constexpr size_t kInputBatchHeaderSize = 8;
+constexpr size_t kInputEventSize = 8;
+constexpr size_t kInputBatchMaxEvents = 255;
+
+enum InputEventType {
+  kInputEventMotion = 1,
+  kInputEventWheel = 2,
+};
+
+struct InputEvent {
+  InputEventType type;
+  int x;
+  int y;
+  int z;
+  uint32_t sequence;
+  // how long before the last event of its batch the event happened
+  uint32_t offset_us;
+};
+
+// Walks the events of a binary batch in place, without allocating
+class InputBatchReader {
+ public:
+  InputBatchReader(const uint8_t *data, size_t size);
+
+  // false when the message is not a supported batch
+  bool Valid() const { return valid_; }
+  size_t Count() const { return count_; }
+  // unknown event types are skipped
+  bool Next(InputEvent *event);
+
+ private:
+  const uint8_t *data_;
+  size_t count_;
+  size_t index_;
+  uint32_t sequence_;
+  uint32_t offset_us_;
+  bool valid_;
+};
+
+// returns the number of bytes written, 0 when capacity is too small
+size_t WriteInputBatch(const InputEvent *events, size_t count,
+    const uint32_t *delta_us, uint8_t *out, size_t capacity);
+
+// parses one legacy text message without allocating
+bool ParseInputText(const char *data, size_t size, InputEvent *event);
+
+}  // namespace rigel
+
+#endif  // RIGEL_BASE_INPUT_PROTOCOL_H_
@@ -0,0 +1,45 @@
+
+#include "input_watermark.h"
+
+namespace rigel {
+
+namespace {
+
+constexpr uint32_t kSyncBits = 0x2u;
+
+uint32_t Check(uint32_t sequence) {
+  return (sequence ^ (sequence >> 6) ^ (sequence >> 12) ^ (sequence >> 18))
+      & 0x3f;
+}
+
+}  // unnamed namespace
+
+uint32_t EncodeInputWatermark(uint32_t sequence) {
+  sequence &= kInputWatermarkSequenceMask;
+  return (kSyncBits << 30) | (sequence << 6) | Check(sequence);
+}
+
+bool DecodeInputWatermark(const uint8_t *luma, int stride,
+    int width, int height, uint32_t *sequence) {
+  if (width < kInputWatermarkCells * kInputWatermarkCellSize ||
+      height < kInputWatermarkCellSize) {
+    return false;
+  }
+  // average a 2x2 block at the center of each cell
+  const int center = kInputWatermarkCellSize / 2;
+  uint32_t pattern = 0;
+  for (int cell = 0; cell < kInputWatermarkCells; cell++) {
+    const uint8_t *p = luma + (center - 1) * stride +
+        cell * kInputWatermarkCellSize + center - 1;
+    int value = (p[0] + p[1] + p[stride] + p[stride + 1]) / 4;
+    pattern = (pattern << 1) | (value >= 128 ? 1u : 0u);
+  }
+  uint32_t decoded = (pattern >> 6) & kInputWatermarkSequenceMask;
+  if ((pattern >> 30) != kSyncBits || (pattern & 0x3f) != Check(decoded)) {
+    return false;
+  }
+  *sequence = decoded;
+  return true;
+}
+
+}  // namespace rigel
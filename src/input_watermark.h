@@ -0,0 +1,29 @@
+
+#ifndef RIGEL_BASE_INPUT_WATERMARK_H_
+#define RIGEL_BASE_INPUT_WATERMARK_H_
+
+#include <cstdint>
+
+namespace rigel {
+
+// The frame that first reflects an input event carries the sequence
+// number of the event as a strip of black and white square cells in its
+// top left corner. Cells are large enough to survive chroma subsampling
+// and lossy encoding, so clients can read them back from the decoded
+// luma plane and compute input-to-photon latency.
+//
+// Cell i shows bit 31 - i of the pattern: two sync bits (1, 0),
+// 24 sequence bits and a 6-bit check, most significant bit first.
+constexpr int kInputWatermarkCellSize = 8;
+constexpr int kInputWatermarkCells = 32;
+constexpr uint32_t kInputWatermarkSequenceMask = 0xffffff;
+
+// sequences are truncated to 24 bits
+uint32_t EncodeInputWatermark(uint32_t sequence);
+// reads the strip from a luma plane, false when there is none
+bool DecodeInputWatermark(const uint8_t *luma, int stride,
+    int width, int height, uint32_t *sequence);
+
+}  // namespace rigel
+
+#endif  // RIGEL_BASE_INPUT_WATERMARK_H_
@@ -3,79 +3,213 @@
 #include "instance_rtc.h"
 #include "logging.inc"
 
+#include <algorithm>
+
+extern "C" {
+#include <unistd.h>
+}
+
 namespace rigel {
 
+namespace {
+
+// setup threads when not configured, renderers constructed on a pool
+// miss should not hold back the setups of every other peer
+constexpr size_t kMinSetupThreads = 4;
+// setups between two executor reports
+constexpr uint64_t kSetupReportInterval = 20;
+// seconds between two attempts to admit the queued requests
+constexpr double kAdmissionPollInterval = 1.0;
+
+size_t SetupThreadCount(const RTCThreadOptions &options) {
+  if (options.setup_threads > 0) return options.setup_threads;
+  const long processors = sysconf(_SC_NPROCESSORS_ONLN);
+  return std::max(kMinSetupThreads,
+      static_cast<size_t>(std::max(1L, processors)));
+}
+
+}  // unnamed namespace
+
 SignalingInstance::SignalingInstance(
-    std::unique_ptr<SignalingControlInterface> control)
-    : control_(std::move(control)),
+    std::unique_ptr<SignalingControlInterface> control,
+    const RTCOptions &rtc_options)
+    : rtc_options_(rtc_options), rtc_(nullptr),
+      control_(std::move(control)), released_(false),
       message_dispatcher_(new SignalingMessageDispatcher(this, this)),
-      render_context_(new RenderContext()) {}
+      render_context_(new RenderContext()),
+      admission_(new SessionAdmissionController(render_context_.get())),
+      executor_(new SetupExecutor(SetupThreadCount(rtc_options.threads))) {
+  pthread_mutex_init(&mutex_, nullptr);
+  admission_timer_.reset(new IntervalTimer(kAdmissionPollInterval,
+      [=](double) {
+    this->ApplyAdmissionUpdates(this->admission_->Poll());
+  }));
+}
 
 void SignalingInstance::Initialize() {
-  rtc_ = new RTCInstance();
+  rtc_ = new RTCInstance(rtc_options_.encoder, rtc_options_.threads);
+  for (const auto &v : rtc_options_.bitrate_policies) {
+    rtc_->SetBitratePolicy(v.first, v.second);
+  }
 }
 
 SignalingInstance::~SignalingInstance() {
+  admission_timer_ = nullptr;
+  // nothing is sent through the closing connection anymore
+  pthread_mutex_lock(&mutex_);
+  released_ = true;
+  pthread_mutex_unlock(&mutex_);
+  // waits for the setups in progress, which may still post
+  executor_->Stop();
   // destruct all channels in advance
-  channel_map_.clear();
+  channels_.Clear();
   // threads are ready to be released
   delete rtc_;
   rtc_ = nullptr;
+  pthread_mutex_destroy(&mutex_);
 }
 
-void SignalingInstance::ReceiveMessage(const std::string &message) {
-  message_dispatcher_->DispatchMessage(message);
+void SignalingInstance::ReceiveMessage(char *message, size_t size) {
+  message_dispatcher_->DispatchMessage(message, size);
 }
 
-// SignalingMessageIncomingSink
-void SignalingInstance::OnStart(const std::string &source) {
-  auto channel = rtc_->CreateChannel(source,
-      message_dispatcher_.get(), render_context_.get());
+std::shared_ptr<PeerChannelInterface> SignalingInstance::FindChannel(
+    const std::string &source) {
+  std::shared_ptr<PeerChannelInterface> channel;
+  if (!channels_.Find(source, &channel)) {
+    RGL_INFO("channel not found: " + source);
+  }
+  return channel;
+}
+
+void SignalingInstance::StartChannel(const std::string &source,
+    const SessionOptions &options, int64_t start_time_us) {
+  const int64_t started_us = FrameTraceNowMicros();
+  std::shared_ptr<PeerChannelInterface> channel(rtc_->CreateChannel(
+      source, message_dispatcher_.get(), render_context_.get(), options,
+      start_time_us));
   channel->Offer();
-  channel_map_[source] = std::move(channel);
+  channels_.Insert(source, channel);
+  const SetupExecutorStats stats = executor_->GetStats();
+  RGL_INFO("setup of " + source + " took " +
+      std::to_string((FrameTraceNowMicros() - started_us) / 1000) +
+      "ms, queue depth " + std::to_string(stats.depth));
+  if ((stats.executed + 1) % kSetupReportInterval == 0) {
+    RGL_INFO("setup executor: max depth " +
+        std::to_string(stats.max_depth) + ", wait p50 " +
+        std::to_string(stats.wait.p50_us / 1000) + "ms p95 " +
+        std::to_string(stats.wait.p95_us / 1000) + "ms, latency p50 " +
+        std::to_string(stats.latency.p50_us / 1000) + "ms p95 " +
+        std::to_string(stats.latency.p95_us / 1000) + "ms");
+  }
 }
 
-void SignalingInstance::OnClose(const std::string &source) {
-  const auto it = channel_map_.find(source);
-  if (it == channel_map_.end()) {
-    RGL_INFO("channel not found: " + source);
-    return;
+void SignalingInstance::ApplyAdmissionUpdates(
+    const std::vector<SessionAdmissionUpdate> &updates) {
+  for (const auto &update : updates) {
+    message_dispatcher_->SendAdmission(update.peer, update.admission);
+    if (update.admission.result != kSessionAdmitted) continue;
+    const std::string peer = update.peer;
+    const SessionOptions options = update.admission.options;
+    executor_->Post(peer, [=] {
+      int64_t start_time_us = 0;
+      if (!start_times_.Erase(peer, &start_time_us)) {
+        start_time_us = FrameTraceNowMicros();
+      }
+      // the peer may have closed since it was admitted
+      if (!admission_->Admitted(peer)) return;
+      StartChannel(peer, options, start_time_us);
+    });
+  }
+}
+
+// SignalingMessageIncomingSink
+void SignalingInstance::OnStart(const std::string &source,
+    const SessionOptions &requested) {
+  SessionOptions options = requested;
+  const auto &tiers = rtc_options_.requestable_tiers;
+  if (!options.tier.empty() &&
+      std::find(tiers.begin(), tiers.end(), options.tier) == tiers.end()) {
+    RGL_WARN(source + " requested tier " + options.tier + ", not allowed");
+    options.tier.clear();
   }
-  channel_map_.erase(it);
+  // time to first frame counts the wait for the executor and admission
+  const int64_t start_time_us = FrameTraceNowMicros();
+  executor_->Post(source, [=] {
+    const SessionAdmission admission = admission_->Request(source, options);
+    if (admission.result != kSessionAdmitted) {
+      // a repeated start keeps the time of the first
+      int64_t queued_us = 0;
+      if (admission.result == kSessionQueued &&
+          !start_times_.Find(source, &queued_us)) {
+        start_times_.Insert(source, start_time_us);
+      }
+      message_dispatcher_->SendAdmission(source, admission);
+      return;
+    }
+    StartChannel(source, admission.options, start_time_us);
+  });
+}
+
+void SignalingInstance::OnClose(const std::string &source) {
+  executor_->Post(source, [=] {
+    std::shared_ptr<PeerChannelInterface> channel;
+    if (!channels_.Erase(source, &channel)) {
+      RGL_INFO("channel not found: " + source);
+    }
+    start_times_.Erase(source);
+    // the connection is closed before its capacity is handed on
+    channel = nullptr;
+    ApplyAdmissionUpdates(admission_->Release(source));
+  });
 }
 
 void SignalingInstance::OnAcceptAnswer(const std::string &source,
       const std::string &sdp) {
-  const auto it = channel_map_.find(source);
-  if (it == channel_map_.end()) {
-    RGL_INFO("channel not found: " + source);
-    return;
-  }
-  it->second->AcceptAnswer(sdp);
+  executor_->Post(source, [=] {
+    auto channel = FindChannel(source);
+    if (channel) channel->AcceptAnswer(sdp);
+  });
 }
 
 void SignalingInstance::OnICECandidates(const std::string &source,
     const std::vector<ICECandidate> &candidates) {
-  const auto it = channel_map_.find(source);
-  if (it == channel_map_.end()) {
-    RGL_INFO("channel not found: " + source);
-    return;
-  }
-  it->second->ReceiveICECandidates(candidates);
+  executor_->Post(source, [=] {
+    auto channel = FindChannel(source);
+    if (channel) channel->ReceiveICECandidates(candidates);
+  });
 }
 
 void SignalingInstance::OnAcquire(const std::string &source) {
-  const auto it = channel_map_.find(source);
-  if (it == channel_map_.end()) {
-    RGL_INFO("channel not found: " + source);
-    return;
-  }
-  it->second->Acquire();
+  executor_->Post(source, [=] {
+    auto channel = FindChannel(source);
+    if (channel) channel->Acquire();
+  });
+}
+
+void SignalingInstance::OnPermitInput(const std::string &source,
+    const std::string &peer, int permissions) {
+  // ordered with the setup and teardown of the peer it applies to
+  executor_->Post(peer, [=] {
+    auto channel = FindChannel(source);
+    auto peer_channel = FindChannel(peer);
+    if (!channel || !peer_channel) return;
+    // only the owner grants input, and only within its own session
+    if (!channel->OwnsSession() ||
+        channel->SessionIdentifier() != peer_channel->SessionIdentifier()) {
+      RGL_WARN("input permission denied: " + source);
+      return;
+    }
+    peer_channel->SetInputPermissions(permissions);
+  });
 }
 
 // SignalingMessageOutgoingSink
 void SignalingInstance::SendMessage(const std::string &message) {
-  control_->SendMessage(message);
+  // called from the setup threads and the RTC signaling threads
+  pthread_mutex_lock(&mutex_);
+  if (!released_) control_->SendMessage(message);
+  pthread_mutex_unlock(&mutex_);
 }
 
 
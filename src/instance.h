@@ -4,13 +4,22 @@
 
 #include <string>
 #include <memory>
-#include <unordered_map>
+#include <vector>
 
 #include "signaling_strategy.h"
 #include "signaling_sink.h"
 #include "channel.h"
 #include "message_signaling.h"
 #include "render.h"
+#include "render_timer.h"
+#include "setup_executor.h"
+#include "session_admission.h"
+#include "concurrent_map.h"
+#include "rtc_options.h"
+
+extern "C" {
+#include <pthread.h>
+}
 
 namespace rigel {
 
@@ -20,27 +29,53 @@ class SignalingInstance: public SignalingInstanceInterface,
     SignalingMessageIncomingSink,
     SignalingMessageOutgoingSink {
  public:
-  explicit SignalingInstance(
-      std::unique_ptr<SignalingControlInterface> control);
+  SignalingInstance(std::unique_ptr<SignalingControlInterface> control,
+      const RTCOptions &rtc_options);
   explicit SignalingInstance(const SignalingInstance &) = delete;
   virtual ~SignalingInstance();
 
   // SignalingInstanceInterface
   void Initialize() override;
-  void ReceiveMessage(const std::string &message) override;
+  void ReceiveMessage(char *message, size_t size) override;
 
  private:
+  std::shared_ptr<PeerChannelInterface> FindChannel(const std::string &source);
+  // on the executor, for an admitted peer whose start arrived at
+  // start_time_us
+  void StartChannel(const std::string &source,
+      const SessionOptions &options, int64_t start_time_us);
+  // starts the peers admitted from the queue, tells the others
+  void ApplyAdmissionUpdates(
+      const std::vector<SessionAdmissionUpdate> &updates);
+
+  const RTCOptions rtc_options_;
   RTCInstance *rtc_;
   std::unique_ptr<SignalingControlInterface> control_;
-  std::unordered_map<std::string,
-      std::unique_ptr<PeerChannelInterface>> channel_map_;
+  // guards control_ once released
+  pthread_mutex_t mutex_;
+  bool released_;
+  ConcurrentMap<std::string, std::shared_ptr<PeerChannelInterface>> channels_;
+  // when the start of each queued peer arrived
+  ConcurrentMap<std::string, int64_t> start_times_;
   std::unique_ptr<SignalingMessageDispatcher> message_dispatcher_;
   std::unique_ptr<RenderContext> render_context_;
+  // decides the GPU of new sessions, and holds back the ones that
+  // would overload every device
+  std::unique_ptr<SessionAdmissionController> admission_;
+  // Messages are parsed on the I/O thread, and what they ask for runs
+  // here one at a time per peer, so a session being set up does not
+  // hold back the signaling of the others
+  std::unique_ptr<SetupExecutor> executor_;
+  // retries the queue as the frame time of the devices recovers
+  std::unique_ptr<IntervalTimer> admission_timer_;
 
   // SignalingMessageIncomingSink
-  void OnStart(const std::string &source) override;
+  void OnStart(const std::string &source,
+      const SessionOptions &requested) override;
   void OnClose(const std::string &source) override;
   void OnAcquire(const std::string &source) override;
+  void OnPermitInput(const std::string &source,
+      const std::string &peer, int permissions) override;
   void OnAcceptAnswer(const std::string &source,
       const std::string &sdp) override;
   void OnICECandidates(const std::string &source,
@@ -1,66 +1,119 @@
 
 #include "instance_rtc.h"
 #include "channel_rtc.h"
+#include "encoder_rtc.h"
+#include "broadcast_rtc.h"
 #include "logging.inc"
 
-#include "api/create_peerconnection_factory.h"
-#include "api/video_codecs/builtin_video_encoder_factory.h"
-#include "api/video_codecs/builtin_video_decoder_factory.h"
-#include "api/audio_codecs/builtin_audio_encoder_factory.h"
-#include "api/audio_codecs/builtin_audio_decoder_factory.h"
+#include <algorithm>
 
-static webrtc::PeerConnectionInterface::RTCConfiguration MakeConfiguration() {
+extern "C" {
+#include <unistd.h>
+}
+
+static webrtc::PeerConnectionInterface::RTCConfiguration MakeConfiguration(
+    const rigel::BitratePolicy &policy) {
   webrtc::PeerConnectionInterface::RTCConfiguration configuration;
   webrtc::PeerConnectionInterface::IceServer ice_server;
   ice_server.uri = "stun:stun.l.google.com:19302";
   configuration.servers.push_back(ice_server);
+  // rid based simulcast needs transceivers
+  if (policy.simulcast_layers > 1) {
+    configuration.sdp_semantics = webrtc::SdpSemantics::kUnifiedPlan;
+  }
   return configuration;
 }
 
 namespace rigel {
 
-RTCInstance::RTCInstance() {
-  RGL_INFO("Creating RTCInstance");
-  // Network Thread
-  network_thread_ = rtc::Thread::CreateWithSocketServer();
-  network_thread_->Start();
-  // Worker Thread
-  worker_thread_ = rtc::Thread::Create();
-  worker_thread_->Start();
-  // Signaling Thread
-  signaling_thread_ = rtc::Thread::Create();
-  signaling_thread_->Start();
-  // Peer Connection
-  factory_ = webrtc::CreatePeerConnectionFactory(
-    network_thread_.get(),
-    worker_thread_.get(),
-    signaling_thread_.get(),
-    nullptr,
-    webrtc::CreateBuiltinAudioEncoderFactory(),
-    webrtc::CreateBuiltinAudioDecoderFactory(),
-    webrtc::CreateBuiltinVideoEncoderFactory(),
-    webrtc::CreateBuiltinVideoDecoderFactory(),
-    nullptr,
-    nullptr);
+RTCInstance::RTCInstance() : RTCInstance(EncoderOptions()) {}
+
+RTCInstance::RTCInstance(const EncoderOptions &encoder_options,
+    const RTCThreadOptions &thread_options)
+    : encoder_options_(encoder_options), thread_options_(thread_options),
+      next_group_(0) {
+  size_t count = thread_options.groups;
+  if (count == 0) {
+    long processors = sysconf(_SC_NPROCESSORS_ONLN);
+    count = std::max<size_t>(1, static_cast<size_t>(processors / 2));
+  }
+  RGL_INFO("Creating RTCInstance with " + std::to_string(count) +
+      " thread groups");
+  for (size_t i = 0; i < count; i++) {
+    // network and worker threads of a group take two processors
+    int pin_cpu = thread_options.pin_threads ? static_cast<int>(i * 2) : -1;
+    groups_.emplace_back(new RTCThreadGroup(i, encoder_options, pin_cpu));
+  }
 }
 
 RTCInstance::~RTCInstance() {
-  factory_ = nullptr;
-  network_thread_->Stop();
-  worker_thread_->Stop();
-  signaling_thread_->Stop();
+  groups_.clear();
 }
 
 std::unique_ptr<PeerChannelInterface> RTCInstance::CreateChannel(
     const std::string &identifier,
     SignalingMessageInterface *messaging,
-    RenderInstanceFactoryInterface *render_instance_factory) {
-  auto *channel = new RTCPeerChannel(identifier, messaging);
-  auto configuration = MakeConfiguration();
-  auto connection = factory_->CreatePeerConnection(
+    RenderInstanceFactoryInterface *render_instance_factory,
+    const SessionOptions &options, int64_t start_time_us) {
+  const std::string session_identifier = options.SessionFor(identifier);
+  // Joining peers attach to the capturer of the running session.
+  // Broadcast sessions get a factory of their own, so the frames are
+  // also encoded once for all of their peers
+  bool owner = false;
+  std::shared_ptr<RTCSession> session;
+  {
+    // peers of the same session may be set up in parallel
+    rtc::CritScope lock(&lock_);
+    session = sessions_.Find(session_identifier);
+    if (session == nullptr) {
+      RTCThreadGroup *group = SelectGroup();
+      auto factory = group->Factory();
+      BitratePolicy policy = bitrate_policies_.Get(options.tier);
+      if (!options.broadcast.empty()) {
+        factory = group->CreateFactory(
+            std::unique_ptr<webrtc::VideoEncoderFactory>(
+                new BroadcastVideoEncoderFactory(encoder_options_)));
+        // the shared encoder serves a single layer, at the one size
+        // every viewer is sent
+        policy.simulcast_layers = 1;
+        policy.maintain_resolution = true;
+      }
+      session = std::make_shared<RTCSession>(session_identifier, group,
+          factory, policy, render_instance_factory, options.device);
+      sessions_.Add(session);
+      owner = true;
+    }
+  }
+  if (!owner) {
+    RGL_INFO(identifier + " joining session " + session_identifier);
+  }
+  auto *channel = new RTCPeerChannel(identifier, messaging, start_time_us);
+  auto configuration = MakeConfiguration(session->Policy());
+  auto connection = session->Factory()->CreatePeerConnection(
       configuration, nullptr, nullptr, channel);
-  channel->Initialize(std::move(connection), factory_, render_instance_factory);
+  channel->Initialize(std::move(connection), std::move(session), owner);
   return std::unique_ptr<PeerChannelInterface>(std::move(channel));
 }
 
+void RTCInstance::SetBitratePolicy(const std::string &tier,
+    const BitratePolicy &policy) {
+  rtc::CritScope lock(&lock_);
+  bitrate_policies_.Set(tier, policy);
+}
+
+// must hold the lock
+RTCThreadGroup *RTCInstance::SelectGroup() {
+  // every peer of a session runs on the group of the session
+  if (thread_options_.assignment == kRTCThreadAssignmentRoundRobin) {
+    RTCThreadGroup *group = groups_[next_group_].get();
+    next_group_ = (next_group_ + 1) % groups_.size();
+    return group;
+  }
+  RTCThreadGroup *least = groups_.front().get();
+  for (const auto &group : groups_) {
+    if (group->Channels() < least->Channels()) least = group.get();
+  }
+  return least;
+}
+
 }  // namespace rigel
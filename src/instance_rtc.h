@@ -4,11 +4,18 @@
 
 #include "observer_rtc.h"
 #include "channel.h"
+#include "encoder_rtc.h"
+#include "session_rtc.h"
+#include "bitrate_policy.h"
+#include "thread_group_rtc.h"
+
+#include <memory>
+#include <string>
+#include <vector>
 
-#include "rtc_base/thread.h"
-#include "pc/video_track_source.h"
 #include "api/scoped_refptr.h"
 #include "api/peer_connection_interface.h"
+#include "rtc_base/critical_section.h"
 
 namespace rigel {
 
@@ -18,19 +25,33 @@ struct RenderInstanceFactoryInterface;
 class RTCInstance {
  public:
   RTCInstance();
+  explicit RTCInstance(const EncoderOptions &encoder_options,
+      const RTCThreadOptions &thread_options = RTCThreadOptions());
   ~RTCInstance();
 
+  // safe to call from several threads. start_time_us is when the peer
+  // asked to start, the time to its first frame is measured from it
   std::unique_ptr<PeerChannelInterface> CreateChannel(
       const std::string &identifier,
       SignalingMessageInterface *messaging,
-      RenderInstanceFactoryInterface *render_instance_factory);
+      RenderInstanceFactoryInterface *render_instance_factory,
+      const SessionOptions &options, int64_t start_time_us);
+
+  // policy of the sessions created with the tier from now on
+  void SetBitratePolicy(const std::string &tier, const BitratePolicy &policy);
 
  private:
-  rtc::scoped_refptr<webrtc::PeerConnectionFactoryInterface> factory_;
-  rtc::scoped_refptr<webrtc::VideoTrackSource> video_source_;
-  std::unique_ptr<rtc::Thread> network_thread_;
-  std::unique_ptr<rtc::Thread> worker_thread_;
-  std::unique_ptr<rtc::Thread> signaling_thread_;
+  // the thread group a new session runs on
+  RTCThreadGroup *SelectGroup();
+
+  EncoderOptions encoder_options_;
+  RTCThreadOptions thread_options_;
+  std::vector<std::unique_ptr<RTCThreadGroup>> groups_;
+  // guards the members below
+  rtc::CriticalSection lock_;
+  size_t next_group_;
+  RTCSessionRegistry sessions_;
+  BitratePolicies bitrate_policies_;
 };
 
 }  // namespace rigel
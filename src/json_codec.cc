@@ -0,0 +1,461 @@
+
+#include "json_codec.h"
+
+#include <limits>
+#include <cstring>
+
+namespace rigel {
+
+namespace {
+
+// nesting the reader accepts, and the writer can track
+constexpr int kJsonMaxDepth = 64;
+
+void SkipSpace(char **cursor, char *end) {
+  char *p = *cursor;
+  while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) {
+    p++;
+  }
+  *cursor = p;
+}
+
+bool IsDigit(char c) {
+  return c >= '0' && c <= '9';
+}
+
+int HexValue(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+bool ReadHex4(const char *p, const char *end, uint32_t *value) {
+  if (end - p < 4) return false;
+  uint32_t result = 0;
+  for (int i = 0; i < 4; i++) {
+    int digit = HexValue(p[i]);
+    if (digit < 0) return false;
+    result = (result << 4) | static_cast<uint32_t>(digit);
+  }
+  *value = result;
+  return true;
+}
+
+// at most four bytes, never more than the six of the escape it replaces
+char *WriteUtf8(uint32_t code, char *out) {
+  if (code < 0x80) {
+    *out++ = static_cast<char>(code);
+  } else if (code < 0x800) {
+    *out++ = static_cast<char>(0xc0 | (code >> 6));
+    *out++ = static_cast<char>(0x80 | (code & 0x3f));
+  } else if (code < 0x10000) {
+    *out++ = static_cast<char>(0xe0 | (code >> 12));
+    *out++ = static_cast<char>(0x80 | ((code >> 6) & 0x3f));
+    *out++ = static_cast<char>(0x80 | (code & 0x3f));
+  } else {
+    *out++ = static_cast<char>(0xf0 | (code >> 18));
+    *out++ = static_cast<char>(0x80 | ((code >> 12) & 0x3f));
+    *out++ = static_cast<char>(0x80 | ((code >> 6) & 0x3f));
+    *out++ = static_cast<char>(0x80 | (code & 0x3f));
+  }
+  return out;
+}
+
+bool ParseInteger(absl::string_view text, int64_t *value) {
+  size_t i = 0;
+  bool negative = false;
+  if (i < text.size() && text[i] == '-') {
+    negative = true;
+    i++;
+  }
+  if (i == text.size()) return false;
+  uint64_t magnitude = 0;
+  const uint64_t limit = negative ?
+      static_cast<uint64_t>(std::numeric_limits<int64_t>::max()) + 1 :
+      static_cast<uint64_t>(std::numeric_limits<int64_t>::max());
+  for (; i < text.size(); i++) {
+    if (!IsDigit(text[i])) return false;
+    const uint64_t digit = static_cast<uint64_t>(text[i] - '0');
+    if (magnitude > (limit - digit) / 10) return false;
+    magnitude = magnitude * 10 + digit;
+  }
+  *value = negative ? static_cast<int64_t>(0 - magnitude) :
+      static_cast<int64_t>(magnitude);
+  return true;
+}
+
+}  // unnamed namespace
+
+// JsonValue
+
+const JsonNode &JsonValue::Node() const {
+  return document_->nodes_[index_];
+}
+
+JsonType JsonValue::Type() const {
+  return Node().type;
+}
+
+absl::string_view JsonValue::String() const {
+  if (!IsString()) return absl::string_view();
+  const JsonNode &node = Node();
+  return absl::string_view(node.data, node.size);
+}
+
+absl::string_view JsonValue::Key() const {
+  if (!IsValid()) return absl::string_view();
+  const JsonNode &node = Node();
+  return absl::string_view(node.key_data, node.key_size);
+}
+
+bool JsonValue::ToInt(int64_t *value) const {
+  if (!IsValid()) return false;
+  const JsonNode &node = Node();
+  if (node.type != kJsonNumber && node.type != kJsonString) return false;
+  return ParseInteger(absl::string_view(node.data, node.size), value);
+}
+
+bool JsonValue::ToBool(bool *value) const {
+  if (!IsValid() || Type() != kJsonBool) return false;
+  *value = Node().data[0] == 't';
+  return true;
+}
+
+size_t JsonValue::Size() const {
+  if (!IsValid()) return 0;
+  return Node().count;
+}
+
+JsonValue JsonValue::First() const {
+  if (Size() == 0) return JsonValue();
+  return JsonValue(document_, index_ + 1, Node().end);
+}
+
+JsonValue JsonValue::Next() const {
+  if (!IsValid()) return JsonValue();
+  const uint32_t next = Node().end;
+  if (next >= parent_end_) return JsonValue();
+  return JsonValue(document_, next, parent_end_);
+}
+
+JsonValue JsonValue::Find(absl::string_view key) const {
+  if (!IsObject()) return JsonValue();
+  for (JsonValue member = First(); member.IsValid();
+      member = member.Next()) {
+    if (member.Key() == key) return member;
+  }
+  return JsonValue();
+}
+
+// JsonDocument
+
+JsonDocument::JsonDocument() : parsed_(false) {}
+
+bool JsonDocument::Parse(char *data, size_t size) {
+  nodes_.clear();
+  parsed_ = false;
+  char *cursor = data;
+  char *end = data + size;
+  if (!ParseValue(&cursor, end, 0)) return false;
+  SkipSpace(&cursor, end);
+  parsed_ = cursor == end;
+  return parsed_;
+}
+
+bool JsonDocument::ParseEmbedded(const JsonValue &value) {
+  if (!value.IsString()) {
+    nodes_.clear();
+    parsed_ = false;
+    return false;
+  }
+  const JsonNode &node = value.Node();
+  // read before the nodes are reused, value may be of this document
+  char *data = node.data;
+  size_t size = node.size;
+  return Parse(data, size);
+}
+
+JsonValue JsonDocument::Root() const {
+  if (!parsed_) return JsonValue();
+  return JsonValue(this, 0, static_cast<uint32_t>(nodes_.size()));
+}
+
+uint32_t JsonDocument::AddNode(JsonType type) {
+  JsonNode node = {};
+  node.type = type;
+  nodes_.push_back(node);
+  return static_cast<uint32_t>(nodes_.size() - 1);
+}
+
+bool JsonDocument::ParseString(char **cursor, char *end, char **data,
+    uint32_t *size) {
+  // the opening quote is at the cursor
+  char *read = *cursor + 1;
+  char *write = read;
+  *data = read;
+  while (true) {
+    if (read >= end) return false;
+    char c = *read;
+    if (c == '"') break;
+    if (static_cast<unsigned char>(c) < 0x20) return false;
+    if (c != '\\') {
+      *write++ = *read++;
+      continue;
+    }
+    if (++read >= end) return false;
+    switch (*read++) {
+    case '"': *write++ = '"'; break;
+    case '\\': *write++ = '\\'; break;
+    case '/': *write++ = '/'; break;
+    case 'b': *write++ = '\b'; break;
+    case 'f': *write++ = '\f'; break;
+    case 'n': *write++ = '\n'; break;
+    case 'r': *write++ = '\r'; break;
+    case 't': *write++ = '\t'; break;
+    case 'u': {
+      uint32_t code;
+      if (!ReadHex4(read, end, &code)) return false;
+      read += 4;
+      if (code >= 0xd800 && code < 0xdc00) {
+        // high surrogate, the low one has to follow
+        uint32_t low;
+        if (end - read < 6 || read[0] != '\\' || read[1] != 'u' ||
+            !ReadHex4(read + 2, end, &low) || low < 0xdc00 || low > 0xdfff) {
+          return false;
+        }
+        read += 6;
+        code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+      } else if (code >= 0xdc00 && code < 0xe000) {
+        return false;
+      }
+      write = WriteUtf8(code, write);
+      break;
+    }
+    default:
+      return false;
+    }
+  }
+  *size = static_cast<uint32_t>(write - *data);
+  *cursor = read + 1;
+  return true;
+}
+
+bool JsonDocument::ParseValue(char **cursor, char *end, int depth) {
+  if (depth >= kJsonMaxDepth) return false;
+  SkipSpace(cursor, end);
+  if (*cursor >= end) return false;
+  char *p = *cursor;
+  switch (*p) {
+  case '{':
+  case '[': {
+    const bool object = *p == '{';
+    const char close = object ? '}' : ']';
+    const uint32_t index = AddNode(object ? kJsonObject : kJsonArray);
+    uint32_t count = 0;
+    *cursor = p + 1;
+    SkipSpace(cursor, end);
+    if (*cursor < end && **cursor == close) {
+      (*cursor)++;
+    } else {
+      while (true) {
+        char *key_data = nullptr;
+        uint32_t key_size = 0;
+        if (object) {
+          SkipSpace(cursor, end);
+          if (*cursor >= end || **cursor != '"') return false;
+          if (!ParseString(cursor, end, &key_data, &key_size)) return false;
+          SkipSpace(cursor, end);
+          if (*cursor >= end || **cursor != ':') return false;
+          (*cursor)++;
+        }
+        const uint32_t child = static_cast<uint32_t>(nodes_.size());
+        if (!ParseValue(cursor, end, depth + 1)) return false;
+        nodes_[child].key_data = key_data;
+        nodes_[child].key_size = key_size;
+        count++;
+        SkipSpace(cursor, end);
+        if (*cursor >= end) return false;
+        if (**cursor == ',') {
+          (*cursor)++;
+          continue;
+        }
+        if (**cursor != close) return false;
+        (*cursor)++;
+        break;
+      }
+    }
+    nodes_[index].count = count;
+    nodes_[index].end = static_cast<uint32_t>(nodes_.size());
+    return true;
+  }
+  case '"': {
+    const uint32_t index = AddNode(kJsonString);
+    char *data;
+    uint32_t size;
+    if (!ParseString(cursor, end, &data, &size)) return false;
+    nodes_[index].data = data;
+    nodes_[index].size = size;
+    nodes_[index].end = index + 1;
+    return true;
+  }
+  case 't':
+  case 'f':
+  case 'n': {
+    const char *literal = *p == 't' ? "true" : *p == 'f' ? "false" : "null";
+    const size_t length = strlen(literal);
+    if (static_cast<size_t>(end - p) < length ||
+        memcmp(p, literal, length) != 0) {
+      return false;
+    }
+    const uint32_t index = AddNode(*p == 'n' ? kJsonNull : kJsonBool);
+    nodes_[index].data = p;
+    nodes_[index].size = static_cast<uint32_t>(length);
+    nodes_[index].end = index + 1;
+    *cursor = p + length;
+    return true;
+  }
+  default: {
+    // -?(0|[1-9][0-9]*)(\.[0-9]+)?([eE][+-]?[0-9]+)?
+    char *q = p;
+    if (q < end && *q == '-') q++;
+    if (q >= end || !IsDigit(*q)) return false;
+    if (*q == '0') {
+      q++;
+    } else {
+      while (q < end && IsDigit(*q)) q++;
+    }
+    if (q < end && *q == '.') {
+      q++;
+      if (q >= end || !IsDigit(*q)) return false;
+      while (q < end && IsDigit(*q)) q++;
+    }
+    if (q < end && (*q == 'e' || *q == 'E')) {
+      q++;
+      if (q < end && (*q == '+' || *q == '-')) q++;
+      if (q >= end || !IsDigit(*q)) return false;
+      while (q < end && IsDigit(*q)) q++;
+    }
+    const uint32_t index = AddNode(kJsonNumber);
+    nodes_[index].data = p;
+    nodes_[index].size = static_cast<uint32_t>(q - p);
+    nodes_[index].end = index + 1;
+    *cursor = q;
+    return true;
+  }
+  }
+}
+
+// JsonWriter
+
+JsonWriter::JsonWriter() : has_value_(0), depth_(0), after_key_(false) {}
+
+void JsonWriter::Reset() {
+  buffer_.clear();
+  has_value_ = 0;
+  depth_ = 0;
+  after_key_ = false;
+}
+
+void JsonWriter::Separate() {
+  if (after_key_) {
+    after_key_ = false;
+    return;
+  }
+  if (depth_ == 0) return;
+  const uint64_t bit = 1ull << (depth_ - 1);
+  if (has_value_ & bit) buffer_ += ',';
+  has_value_ |= bit;
+}
+
+void JsonWriter::BeginObject() {
+  Separate();
+  buffer_ += '{';
+  depth_++;
+  has_value_ &= ~(1ull << (depth_ - 1));
+}
+
+void JsonWriter::EndObject() {
+  depth_--;
+  buffer_ += '}';
+}
+
+void JsonWriter::BeginArray() {
+  Separate();
+  buffer_ += '[';
+  depth_++;
+  has_value_ &= ~(1ull << (depth_ - 1));
+}
+
+void JsonWriter::EndArray() {
+  depth_--;
+  buffer_ += ']';
+}
+
+void JsonWriter::Key(absl::string_view key) {
+  Separate();
+  AppendJsonString(key, &buffer_);
+  buffer_ += ':';
+  after_key_ = true;
+}
+
+void JsonWriter::String(absl::string_view value) {
+  Separate();
+  AppendJsonString(value, &buffer_);
+}
+
+void JsonWriter::Int(int64_t value) {
+  Separate();
+  char digits[24];
+  char *p = digits + sizeof(digits);
+  uint64_t magnitude = value < 0 ?
+      0 - static_cast<uint64_t>(value) : static_cast<uint64_t>(value);
+  do {
+    *--p = static_cast<char>('0' + magnitude % 10);
+    magnitude /= 10;
+  } while (magnitude != 0);
+  if (value < 0) *--p = '-';
+  buffer_.append(p, digits + sizeof(digits) - p);
+}
+
+void JsonWriter::Bool(bool value) {
+  Separate();
+  buffer_ += value ? "true" : "false";
+}
+
+void JsonWriter::Raw(absl::string_view json) {
+  Separate();
+  buffer_.append(json.data(), json.size());
+}
+
+void AppendJsonString(absl::string_view value, std::string *output) {
+  static const char kHex[] = "0123456789abcdef";
+  output->reserve(output->size() + value.size() + 2);
+  *output += '"';
+  size_t run = 0;
+  for (size_t i = 0; i < value.size(); i++) {
+    const unsigned char c = static_cast<unsigned char>(value[i]);
+    if (c >= 0x20 && c != '"' && c != '\\') continue;
+    // unescaped characters are appended a run at a time
+    output->append(value.data() + run, i - run);
+    run = i + 1;
+    switch (c) {
+    case '"': *output += "\\\""; break;
+    case '\\': *output += "\\\\"; break;
+    case '\n': *output += "\\n"; break;
+    case '\r': *output += "\\r"; break;
+    case '\t': *output += "\\t"; break;
+    case '\b': *output += "\\b"; break;
+    case '\f': *output += "\\f"; break;
+    default: {
+      const char escape[] = { '\\', 'u', '0', '0', kHex[c >> 4], kHex[c & 15] };
+      output->append(escape, sizeof(escape));
+      break;
+    }
+    }
+  }
+  output->append(value.data() + run, value.size() - run);
+  *output += '"';
+}
+
+}  // namespace rigel
@@ -0,0 +1,146 @@
+
+#ifndef RIGEL_BASE_JSON_CODEC_H_
+#define RIGEL_BASE_JSON_CODEC_H_
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#include "absl/strings/string_view.h"
+
+namespace rigel {
+
+class JsonDocument;
+
+enum JsonType {
+  kJsonNull = 0,
+  kJsonBool,
+  kJsonNumber,
+  kJsonString,
+  kJsonArray,
+  kJsonObject,
+};
+
+// parsed value, the text of strings and numbers points into the input
+struct JsonNode {
+  JsonType type;
+  char *data;
+  uint32_t size;
+  // members of an object, empty otherwise
+  char *key_data;
+  uint32_t key_size;
+  // children of an array or object
+  uint32_t count;
+  // index past the last node of the subtree
+  uint32_t end;
+};
+
+// Handle to a node of a document, valid until it parses again.
+// Accessors of the wrong type return empty values.
+class JsonValue {
+ public:
+  JsonValue() : document_(nullptr), index_(0), parent_end_(0) {}
+  JsonValue(const JsonDocument *document, uint32_t index,
+      uint32_t parent_end)
+      : document_(document), index_(index), parent_end_(parent_end) {}
+
+  bool IsValid() const { return document_ != nullptr; }
+  JsonType Type() const;
+  bool IsString() const { return IsValid() && Type() == kJsonString; }
+  bool IsArray() const { return IsValid() && Type() == kJsonArray; }
+  bool IsObject() const { return IsValid() && Type() == kJsonObject; }
+
+  // unescaped text of a string
+  absl::string_view String() const;
+  // the key of an object member
+  absl::string_view Key() const;
+  // an integral number, or a string holding one as older encoders
+  // wrote every value as a string
+  bool ToInt(int64_t *value) const;
+  bool ToBool(bool *value) const;
+
+  // children of an array or object
+  size_t Size() const;
+  JsonValue First() const;
+  // the next sibling, invalid after the last one
+  JsonValue Next() const;
+  // the member named key of an object, invalid when absent
+  JsonValue Find(absl::string_view key) const;
+
+ private:
+  const JsonNode &Node() const;
+
+  const JsonDocument *document_;
+  uint32_t index_;
+  // where the siblings end
+  uint32_t parent_end_;
+  friend class JsonDocument;
+};
+
+// In-situ JSON reader. The input is modified while parsing, as escaped
+// strings are decoded in place, and the values point into it, so it
+// has to outlive them. The nodes are kept in a flat array reused by
+// the next parse, which then allocates nothing once it has grown.
+class JsonDocument {
+ public:
+  JsonDocument();
+  explicit JsonDocument(const JsonDocument &) = delete;
+
+  // false on malformed input, the root is invalid then
+  bool Parse(char *data, size_t size);
+  // parses the JSON text held by a string value of another document,
+  // in place within the input of that document
+  bool ParseEmbedded(const JsonValue &value);
+  JsonValue Root() const;
+
+ private:
+  bool ParseValue(char **cursor, char *end, int depth);
+  bool ParseString(char **cursor, char *end, char **data, uint32_t *size);
+  uint32_t AddNode(JsonType type);
+
+  std::vector<JsonNode> nodes_;
+  bool parsed_;
+  friend class JsonValue;
+};
+
+// Single pass JSON writer appending to a buffer kept across messages.
+// Separators are placed by the writer, calls only have to nest right,
+// at most 64 levels deep.
+class JsonWriter {
+ public:
+  JsonWriter();
+  explicit JsonWriter(const JsonWriter &) = delete;
+
+  // empties the buffer, keeping its capacity
+  void Reset();
+  void BeginObject();
+  void EndObject();
+  void BeginArray();
+  void EndArray();
+  // names the next value of an object
+  void Key(absl::string_view key);
+  void String(absl::string_view value);
+  void Int(int64_t value);
+  void Bool(bool value);
+  // JSON text written as it is
+  void Raw(absl::string_view json);
+
+  const std::string &Data() const { return buffer_; }
+
+ private:
+  void Separate();
+
+  std::string buffer_;
+  // one bit per open container, set once it has a value
+  uint64_t has_value_;
+  int depth_;
+  bool after_key_;
+};
+
+// escapes value as a JSON string, quotes included, onto output
+void AppendJsonString(absl::string_view value, std::string *output);
+
+}  // namespace rigel
+
+#endif  // RIGEL_BASE_JSON_CODEC_H_
@@ -6,8 +6,12 @@ int main() {
   rigel::InitializeLogger();
   rigel::InitializeSSL();
   {
+    // the defaults shard peer connections over a thread group per two
+    // processors and encode with the built-in codecs
+    rigel::RTCOptions rtc_options;
     std::unique_ptr<rigel::SignalingContext> context(
-        new rigel::SignalingContext("127.0.0.1", "8080", "/wssrv"));
+        new rigel::SignalingContext("127.0.0.1", "8080", "/wssrv",
+            rtc_options));
     context->Run();
   }
   rigel::CleanupSSL();
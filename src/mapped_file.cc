@@ -0,0 +1,45 @@
+
+#include "mapped_file.h"
+
+extern "C" {
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+}
+
+namespace rigel {
+
+MappedFile::MappedFile() : data_(nullptr), size_(0) {}
+
+MappedFile::~MappedFile() {
+  Close();
+}
+
+bool MappedFile::Open(const std::string &path) {
+  Close();
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) return false;
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+    close(fd);
+    return false;
+  }
+  size_t size = static_cast<size_t>(st.st_size);
+  void *data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  // the mapping stays valid after the descriptor is closed
+  close(fd);
+  if (data == MAP_FAILED) return false;
+  data_ = static_cast<const char *>(data);
+  size_ = size;
+  return true;
+}
+
+void MappedFile::Close() {
+  if (data_ == nullptr) return;
+  munmap(const_cast<char *>(data_), size_);
+  data_ = nullptr;
+  size_ = 0;
+}
+
+}  // namespace rigel
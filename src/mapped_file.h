@@ -0,0 +1,32 @@
+
+#ifndef RIGEL_BASE_MAPPED_FILE_H_
+#define RIGEL_BASE_MAPPED_FILE_H_
+
+#include <string>
+#include <cstddef>
+
+namespace rigel {
+
+// Read-only memory mapping of a whole file.
+// Pages are faulted in lazily by the kernel on first access.
+class MappedFile {
+ public:
+  MappedFile();
+  explicit MappedFile(const MappedFile &) = delete;
+  ~MappedFile();
+
+  bool Open(const std::string &path);
+  void Close();
+
+  bool IsOpen() const { return data_ != nullptr; }
+  const char *Data() const { return data_; }
+  size_t Size() const { return size_; }
+
+ private:
+  const char *data_;
+  size_t size_;
+};
+
+}  // namespace rigel
+
+#endif  // RIGEL_BASE_MAPPED_FILE_H_
@@ -1,197 +1,231 @@
 
 #include "message_signaling.h"
+#include "message_storage.h"
 #include "logging.inc"
 
-#include <sstream>
-#include <boost/property_tree/ptree.hpp>
-#include <boost/property_tree/json_parser.hpp>
-#include <boost/algorithm/string/join.hpp>
-
 namespace rigel {
 
 namespace {
-struct Message {
-  std::string method;
-  std::string parameter;
-  std::string source;
-  std::string destination;
-
-  static boost::optional<Message> Decode(const std::string &message) {
-    boost::property_tree::ptree tree;
-    try {
-      std::stringstream stream(message);
-      boost::property_tree::json_parser::read_json(stream, tree);
-    } catch (const boost::property_tree::json_parser_error &error) {
-      return boost::none;
+
+bool DispatchStart(SignalingMessageIncomingSink *sink,
+    const std::string &source, const SignalingParameter &parameter) {
+  SessionOptions options;
+  // older clients send no parameter
+  if (!parameter.IsEmpty()) {
+    const JsonValue tree = parameter.Structure();
+    if (!tree.IsObject()) {
+      RGL_WARN("OnStart json parse failure");
+      return false;
+    }
+    options.session = std::string(tree.Find("session").String());
+    options.broadcast = std::string(tree.Find("broadcast").String());
+    options.tier = std::string(tree.Find("tier").String());
+  }
+  sink->OnStart(source, options);
+  return true;
+}
+
+bool DispatchClose(SignalingMessageIncomingSink *sink,
+    const std::string &source, const SignalingParameter &parameter) {
+  sink->OnClose(source);
+  return true;
+}
+
+bool DispatchAcceptAnswer(SignalingMessageIncomingSink *sink,
+    const std::string &source, const SignalingParameter &parameter) {
+  sink->OnAcceptAnswer(source, std::string(parameter.Text()));
+  return true;
+}
+
+bool DispatchICECandidates(SignalingMessageIncomingSink *sink,
+    const std::string &source, const SignalingParameter &parameter) {
+  const JsonValue tree = parameter.Structure();
+  if (!tree.IsArray()) {
+    RGL_WARN("OnICECandidates json parse failure");
+    return false;
+  }
+  std::vector<ICECandidate> candidates;
+  candidates.reserve(tree.Size());
+  for (JsonValue child = tree.First(); child.IsValid();
+      child = child.Next()) {
+    if (!child.IsObject()) {
+      RGL_WARN("OnICECandidates child node parse failure");
+      return false;
+    }
+    int64_t index;
+    if (!child.Find("sdpMLineIndex").ToInt(&index)) {
+      RGL_WARN("OnICECandidates sdpMLineIndex parse failure");
+      return false;
     }
-    const auto method = tree.get_optional<std::string>("method")
-        .value_or(std::string());
-    const auto source = tree.get_optional<std::string>("source")
-        .value_or(std::string());
-    const auto parameter = tree.get_optional<std::string>("parameter")
-        .value_or(std::string());
-    return Message {
-      .method = std::move(method),
-      .parameter = std::move(parameter),
-      .source = std::move(source)
-    };
+    candidates.push_back(ICECandidate {
+      .sdp = std::string(child.Find("candidate").String()),
+      .sdp_mid = std::string(child.Find("sdpMid").String()),
+      .sdp_mline_index = static_cast<int>(index)
+    });
   }
+  sink->OnICECandidates(source, candidates);
+  return true;
+}
+
+bool DispatchAcquire(SignalingMessageIncomingSink *sink,
+    const std::string &source, const SignalingParameter &parameter) {
+  sink->OnAcquire(source);
+  return true;
+}
 
-  boost::optional<std::string> Encode() {
-    boost::property_tree::ptree tree;
-    tree.put("method", method);
-    tree.put("parameter", parameter);
-    tree.put("source", source);
-    tree.put("destination", destination);
-    std::stringstream stream;
-    try {
-      boost::property_tree::json_parser::write_json(stream, tree);
-    } catch (const boost::property_tree::json_parser_error &error) {
-      return boost::none;
+bool DispatchPermitInput(SignalingMessageIncomingSink *sink,
+    const std::string &source, const SignalingParameter &parameter) {
+  const JsonValue tree = parameter.Structure();
+  if (!tree.IsObject()) {
+    RGL_WARN("OnPermitInput json parse failure");
+    return false;
+  }
+  const JsonValue peer = tree.Find("peer");
+  if (!peer.IsString()) {
+    RGL_WARN("OnPermitInput peer parse failure");
+    return false;
+  }
+  int permissions = kPeerInputNone;
+  const JsonValue input = tree.Find("input");
+  for (JsonValue v = input.First(); v.IsValid(); v = v.Next()) {
+    const absl::string_view name = v.String();
+    if (name == "motion") {
+      permissions |= kPeerInputMotion;
+    } else if (name == "zoom") {
+      permissions |= kPeerInputZoom;
     }
-    return stream.str();
   }
+  sink->OnPermitInput(source, std::string(peer.String()), permissions);
+  return true;
+}
+
+typedef RMIMethod<SignalingMessageIncomingSink,
+    const std::string &, const SignalingParameter &> SignalingMethod;
+
+// sorted by name
+constexpr SignalingMethod kSignalingMethods[] = {
+  { "acquire", &DispatchAcquire },
+  { "answer", &DispatchAcceptAnswer },
+  { "candidate", &DispatchICECandidates },
+  { "close", &DispatchClose },
+  { "permit", &DispatchPermitInput },
+  { "start", &DispatchStart },
 };
+static_assert(RMIIsSorted(kSignalingMethods),
+    "signaling methods out of order");
+
+constexpr RMITable<SignalingMessageIncomingSink,
+    const std::string &, const SignalingParameter &>
+    kSignalingMethodTable(kSignalingMethods);
+
 }  // unnamed namespace
 
+JsonValue SignalingParameter::Structure() const {
+  if (value_.IsObject() || value_.IsArray()) return value_;
+  if (!embedded_->ParseEmbedded(value_)) return JsonValue();
+  return embedded_->Root();
+}
+
 SignalingMessageDispatcher::SignalingMessageDispatcher(
     SignalingMessageIncomingSink *incoming,
     SignalingMessageOutgoingSink *outgoing)
     : incoming_(incoming), outgoing_(outgoing) {
-  // OnStart
-  storage_.Register("start",
-      [](SignalingMessageIncomingSink *sink,
-          const std::string &source, const std::string &parameter) {
-    sink->OnStart(source);
-    return true;
-  });
-  // OnClose
-  storage_.Register("close",
-      [](SignalingMessageIncomingSink *sink,
-          const std::string &source, const std::string &parameter) {
-    sink->OnClose(source);
-    return true;
-  });
-  // OnAcceptAnswer
-  storage_.Register("answer",
-      [](SignalingMessageIncomingSink *sink,
-          const std::string &source, const std::string &parameter) {
-    sink->OnAcceptAnswer(source, parameter);
-    return true;
-  });
-  // OnICECandidates
-  storage_.Register("candidate",
-      [](SignalingMessageIncomingSink *sink,
-          const std::string &source, const std::string &parameter) {
-    boost::property_tree::ptree tree;
-    try {
-      std::stringstream stream(parameter);
-      boost::property_tree::json_parser::read_json(stream, tree);
-    } catch (const boost::property_tree::json_parser_error &error) {
-      RGL_WARN("OnICECandidates json parse failure");
-      return false;
-    }
-    std::vector<ICECandidate> candidates;
-    for (const auto &v : tree) {
-      const auto child_opt = v.second.get_child_optional("");
-      if (!child_opt) {
-        RGL_WARN("OnICECandidates child node parse failure");
-        return false;
-      }
-      const auto child = child_opt.get();
-      const auto sdp = child.get_optional<std::string>("candidate")
-          .value_or(std::string());
-      const auto mid = child.get_optional<std::string>("sdpMid")
-          .value_or(std::string());
-      const auto index_opt = child.get_optional<int>("sdpMLineIndex");
-      if (!index_opt) {
-        RGL_WARN("OnICECandidates sdpMLineIndex parse failure");
-        return false;
-      }
-      const auto index = index_opt.get();
-      auto candidate = ICECandidate {
-        .sdp = std::move(sdp),
-        .sdp_mid = std::move(mid),
-        .sdp_mline_index = index
-      };
-      candidates.push_back(std::move(candidate));
-    }
-    sink->OnICECandidates(source, candidates);
-    return true;
-  });
-  // OnAcquire
-  storage_.Register("acquire",
-      [](SignalingMessageIncomingSink *sink,
-          const std::string &source, const std::string &parameter) {
-    sink->OnAcquire(source);
-    return true;
-  });
+  pthread_mutex_init(&writer_mutex_, nullptr);
 }
 
-void SignalingMessageDispatcher::DispatchMessage(
-    const std::string &message_str) {
-  auto message_opt = Message::Decode(message_str);
-  if (!message_opt) {
-    RGL_WARN("Message::Decode failed");
+SignalingMessageDispatcher::~SignalingMessageDispatcher() {
+  pthread_mutex_destroy(&writer_mutex_);
+}
+
+void SignalingMessageDispatcher::DispatchMessage(char *message,
+    size_t size) {
+  if (!document_.Parse(message, size) || !document_.Root().IsObject()) {
+    RGL_WARN("JsonDocument::Parse failed");
     return;
   }
-  const auto &message = message_opt.value();
-  bool ok = storage_.TryInvoke(incoming_,
-      message.method, message.source, message.parameter);
+  const JsonValue root = document_.Root();
+  const std::string source(root.Find("source").String());
+  const SignalingParameter parameter(root.Find("parameter"),
+      &parameter_document_);
+  bool ok = kSignalingMethodTable.TryInvoke(incoming_,
+      root.Find("method").String(), source, parameter);
   if (!ok) {
-    RGL_WARN("RMIStorage::TryInvoke failed");
+    RGL_WARN("RMITable::TryInvoke failed");
   }
 }
 
+void SignalingMessageDispatcher::Send(absl::string_view method,
+    const std::string &destination, absl::string_view parameter) {
+  writer_.Reset();
+  writer_.BeginObject();
+  writer_.Key("method");
+  writer_.String(method);
+  writer_.Key("parameter");
+  writer_.String(parameter);
+  writer_.Key("source");
+  writer_.String("");
+  writer_.Key("destination");
+  writer_.String(destination);
+  writer_.EndObject();
+  outgoing_->SendMessage(writer_.Data());
+}
+
 void SignalingMessageDispatcher::SendOffer(const std::string &destination,
       const std::string &sdp) {
-  auto message = Message {
-    .method = "offer",
-    .parameter = sdp,
-    .source = "",
-    .destination = destination,
-  };
-  auto encoded_opt = message.Encode();
-  if (!encoded_opt) {
-    RGL_WARN("Message::Encode failed");
-    return;
-  }
-  outgoing_->SendMessage(encoded_opt.value());
+  pthread_mutex_lock(&writer_mutex_);
+  Send("offer", destination, sdp);
+  pthread_mutex_unlock(&writer_mutex_);
 }
 
 void SignalingMessageDispatcher::SendICECandidates(
     const std::string &destination,
     const std::vector<ICECandidate> &candidates) {
-  // HAX: boost property tree cannot be used
-  // when encoding json array as root node.
-  std::vector<std::string> items;
+  pthread_mutex_lock(&writer_mutex_);
+  // clients parse the parameter as JSON text
+  parameter_writer_.Reset();
+  parameter_writer_.BeginArray();
   for (const auto &v : candidates) {
-    boost::property_tree::ptree item;
-    item.put("candidate", v.sdp);
-    item.put("sdpMid", v.sdp_mid);
-    item.put("sdpMLineIndex", v.sdp_mline_index);
-    std::stringstream stream;
-    try {
-      boost::property_tree::json_parser::write_json(stream, item, false);
-    } catch (const boost::property_tree::json_parser_error &error) {
-      return;
-    }
-    std::string item_encoded = stream.str();
-    items.push_back(item_encoded);
+    parameter_writer_.BeginObject();
+    parameter_writer_.Key("candidate");
+    parameter_writer_.String(v.sdp);
+    parameter_writer_.Key("sdpMid");
+    parameter_writer_.String(v.sdp_mid);
+    parameter_writer_.Key("sdpMLineIndex");
+    parameter_writer_.Int(v.sdp_mline_index);
+    parameter_writer_.EndObject();
   }
-  std::string array_encoded = "[" + boost::algorithm::join(items, ",") + "]";
-  auto message = Message {
-    .method = "candidate",
-    .parameter = array_encoded,
-    .source = "",
-    .destination = destination,
-  };
-  auto encoded_opt = message.Encode();
-  if (!encoded_opt) {
-    RGL_WARN("Message::Encode failed");
-    return;
+  parameter_writer_.EndArray();
+  Send("candidate", destination, parameter_writer_.Data());
+  pthread_mutex_unlock(&writer_mutex_);
+}
+
+void SignalingMessageDispatcher::SendAdmission(
+    const std::string &destination, const SessionAdmission &admission) {
+  pthread_mutex_lock(&writer_mutex_);
+  // {"state": "queued", "position": 3, "reason": "frame_time"}
+  parameter_writer_.Reset();
+  parameter_writer_.BeginObject();
+  parameter_writer_.Key("state");
+  switch (admission.result) {
+  case kSessionAdmitted:
+    parameter_writer_.String("admitted");
+    break;
+  case kSessionQueued:
+    parameter_writer_.String("queued");
+    parameter_writer_.Key("position");
+    parameter_writer_.Int(static_cast<int64_t>(admission.position));
+    parameter_writer_.Key("reason");
+    parameter_writer_.String(admission.reason);
+    break;
+  case kSessionRejected:
+    parameter_writer_.String("rejected");
+    parameter_writer_.Key("reason");
+    parameter_writer_.String(admission.reason);
+    break;
   }
-  outgoing_->SendMessage(encoded_opt.value());
+  parameter_writer_.EndObject();
+  Send("admission", destination, parameter_writer_.Data());
+  pthread_mutex_unlock(&writer_mutex_);
 }
 
 }  // namespace rigel
@@ -5,19 +5,29 @@
 #include <vector>
 #include <string>
 
-#include "message_storage.h"
 #include "ice_candidate.h"
+#include "channel.h"
+#include "session_admission.h"
+#include "json_codec.h"
+
+extern "C" {
+#include <pthread.h>
+}
 
 namespace rigel {
 
 struct SignalingMessageIncomingSink {
-  virtual void OnStart(const std::string &source) = 0;
+  virtual void OnStart(const std::string &source,
+      const SessionOptions &options) = 0;
   virtual void OnClose(const std::string &source) = 0;
   virtual void OnAcceptAnswer(const std::string &source,
       const std::string &sdp) = 0;
   virtual void OnICECandidates(const std::string &source,
       const std::vector<ICECandidate> &candidates) = 0;
   virtual void OnAcquire(const std::string &source) = 0;
+  // permissions is a combination of PeerInputPermission flags
+  virtual void OnPermitInput(const std::string &source,
+      const std::string &peer, int permissions) = 0;
 };
 
 struct SignalingMessageOutgoingSink {
@@ -29,25 +39,65 @@ struct SignalingMessageInterface {
       const std::string &sdp) = 0;
   virtual void SendICECandidates(const std::string &destination,
       const std::vector<ICECandidate> &candidates) = 0;
+  // a "start" that was queued, rejected, or admitted after waiting
+  virtual void SendAdmission(const std::string &destination,
+      const SessionAdmission &admission) = 0;
+};
+
+// "parameter" of an incoming message, the SDP of an answer or the
+// structure the other methods take. Older clients send structures as
+// JSON text within a string, which Structure parses in place.
+class SignalingParameter {
+ public:
+  SignalingParameter(const JsonValue &value, JsonDocument *embedded)
+      : value_(value), embedded_(embedded) {}
+
+  // absent or an empty string
+  bool IsEmpty() const {
+    return !value_.IsValid() || (value_.IsString() && Text().empty());
+  }
+  absl::string_view Text() const { return value_.String(); }
+  // invalid when malformed
+  JsonValue Structure() const;
+
+ private:
+  JsonValue value_;
+  JsonDocument *embedded_;
 };
 
+// Messages are read in place and written by a single pass into buffers
+// reused from one message to the next
 class SignalingMessageDispatcher : public SignalingMessageInterface {
  public:
   explicit SignalingMessageDispatcher(SignalingMessageIncomingSink *incoming,
       SignalingMessageOutgoingSink *outgoing);
+  explicit SignalingMessageDispatcher(
+      const SignalingMessageDispatcher &) = delete;
+  ~SignalingMessageDispatcher();
 
-  void DispatchMessage(const std::string &message);
+  // message is modified in place. Called from a single thread
+  void DispatchMessage(char *message, size_t size);
 
   // SignalingMessageInterface
   void SendOffer(const std::string &destination,
       const std::string &sdp) override;
   void SendICECandidates(const std::string &destination,
       const std::vector<ICECandidate> &candidates) override;
+  void SendAdmission(const std::string &destination,
+      const SessionAdmission &admission) override;
  private:
-  RMIStorage<SignalingMessageIncomingSink,
-      const std::string &, const std::string &> storage_;
+  // must hold writer_mutex_
+  void Send(absl::string_view method, const std::string &destination,
+      absl::string_view parameter);
+
   SignalingMessageIncomingSink *incoming_;
   SignalingMessageOutgoingSink *outgoing_;
+  JsonDocument document_;
+  JsonDocument parameter_document_;
+  // messages are sent from the setup and the RTC threads
+  pthread_mutex_t writer_mutex_;
+  JsonWriter writer_;
+  JsonWriter parameter_writer_;
 };
 
 }  // namespace rigel
@@ -2,29 +2,90 @@
 #ifndef RIGEL_BASE_MESSAGE_STORAGE_H_
 #define RIGEL_BASE_MESSAGE_STORAGE_H_
 
-#include <string>
-#include <unordered_map>
-#include <functional>
+#include <utility>
+#include <cstddef>
+
+#include "absl/strings/string_view.h"
 
 namespace rigel {
 
+// A method of an RMITable, the name with the function it calls.
+// Args are meant to be references, invoking copies nothing then.
 template<typename SinkType, typename... Args>
-class RMIStorage {
+struct RMIMethod {
+  typedef bool (*Function)(SinkType *, Args...);
+
+  template<size_t Length>
+  constexpr RMIMethod(const char (&name)[Length], Function function)
+      : name(name), length(Length - 1), function(function) {}
+
+  const char *name;
+  size_t length;
+  Function function;
+};
+
+constexpr bool RMINameLess(const char *a, const char *b) {
+  return *a == *b ?
+      (*a != '\0' && RMINameLess(a + 1, b + 1)) :
+      static_cast<unsigned char>(*a) < static_cast<unsigned char>(*b);
+}
+
+// whether the names strictly ascend, which also makes them unique
+template<typename Method, size_t N>
+constexpr bool RMIIsSorted(const Method (&methods)[N], size_t i = 1) {
+  return i >= N ||
+      (RMINameLess(methods[i - 1].name, methods[i].name) &&
+       RMIIsSorted(methods, i + 1));
+}
+
+// Dispatch table over a constexpr array of methods sorted by name,
+// checked where it is defined:
+//   constexpr RMIMethod<Sink, const A &> kMethods[] = {
+//     { "close", &Close },
+//     { "start", &Start },
+//   };
+//   static_assert(RMIIsSorted(kMethods), "methods out of order");
+//   constexpr RMITable<Sink, const A &> kTable(kMethods);
+// Lookups are a binary search, without allocating or hashing the name.
+template<typename SinkType, typename... Args>
+class RMITable {
  public:
-  typedef std::function<bool(SinkType *, Args...)> SinkFunc;
+  typedef RMIMethod<SinkType, Args...> Method;
+
+  template<size_t N>
+  constexpr explicit RMITable(const Method (&methods)[N])
+      : methods_(methods), size_(N) {}
 
-  void Register(const std::string &name, SinkFunc sink) {
-    sink_map_[name] = sink;
+  // null when no method is named name
+  const Method *Find(absl::string_view name) const {
+    size_t low = 0;
+    size_t high = size_;
+    while (low < high) {
+      const size_t middle = low + (high - low) / 2;
+      const Method &method = methods_[middle];
+      const int order =
+          absl::string_view(method.name, method.length).compare(name);
+      if (order == 0) return &method;
+      if (order < 0) {
+        low = middle + 1;
+      } else {
+        high = middle;
+      }
+    }
+    return nullptr;
   }
 
-  bool TryInvoke(SinkType *sink, const std::string &name, Args... args) {
-    auto it = sink_map_.find(name);
-    if (it == sink_map_.end()) return false;
-    return it->second(sink, args...);
+  template<typename... Params>
+  bool TryInvoke(SinkType *sink, absl::string_view name,
+      Params &&... args) const {
+    const Method *method = Find(name);
+    if (method == nullptr) return false;
+    return method->function(sink, std::forward<Params>(args)...);
   }
 
  private:
-  std::unordered_map<std::string, SinkFunc> sink_map_;
+  const Method *methods_;
+  size_t size_;
 };
 
 }  // namespace rigel
@@ -0,0 +1,506 @@
+
+#include "obj_loader.h"
+
+#include <map>
+#include <algorithm>
+#include <fstream>
+#include <functional>
+#include <utility>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+extern "C" {
+#include <pthread.h>
+#include <unistd.h>
+}
+
+#include "mapped_file.h"
+
+#define TINYOBJLOADER_IMPLEMENTATION
+#include "third_party/tiny_obj_loader.h"
+
+namespace rigel {
+
+namespace {
+
+// chunks smaller than this are not worth a thread
+constexpr size_t kMinChunkSize = 1 << 20;
+constexpr uint32_t kNoTexcoord = 0xffffffffu;
+
+// powers of ten exactly representable as double
+const double kPow10[] = {
+  1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+  1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20,
+  1e21, 1e22
+};
+
+inline bool IsSpace(char c) {
+  return c == ' ' || c == '\t' || c == '\r';
+}
+
+inline bool IsDigit(char c) {
+  return c >= '0' && c <= '9';
+}
+
+inline const char *SkipSpace(const char *p, const char *end) {
+  while (p < end && IsSpace(*p)) p++;
+  return p;
+}
+
+inline bool StartsWith(const char *p, const char *end,
+    const char *token, size_t length) {
+  return static_cast<size_t>(end - p) > length &&
+      memcmp(p, token, length) == 0 && IsSpace(p[length]);
+}
+
+// Decimal float parser. Mantissas of up to 19 digits with small
+// exponents are converted exactly with a single multiplication or
+// division, anything else falls back to strtod.
+const char *ParseFloat(const char *p, const char *end, float *out) {
+  p = SkipSpace(p, end);
+  const char *start = p;
+  bool negative = false;
+  if (p < end && (*p == '-' || *p == '+')) {
+    negative = *p == '-';
+    p++;
+  }
+  uint64_t mantissa = 0;
+  int digits = 0;
+  int exponent = 0;
+  bool any = false;
+  for (; p < end && IsDigit(*p); p++) {
+    any = true;
+    if (digits < 19) {
+      mantissa = mantissa * 10 + (*p - '0');
+      if (mantissa != 0) digits++;
+    } else {
+      exponent++;
+    }
+  }
+  if (p < end && *p == '.') {
+    p++;
+    for (; p < end && IsDigit(*p); p++) {
+      any = true;
+      if (digits < 19) {
+        mantissa = mantissa * 10 + (*p - '0');
+        if (mantissa != 0) digits++;
+        exponent--;
+      }
+    }
+  }
+  if (!any) return nullptr;
+  if (p < end && (*p == 'e' || *p == 'E')) {
+    const char *q = p + 1;
+    bool exponent_negative = false;
+    if (q < end && (*q == '-' || *q == '+')) {
+      exponent_negative = *q == '-';
+      q++;
+    }
+    if (q < end && IsDigit(*q)) {
+      int value = 0;
+      for (; q < end && IsDigit(*q); q++) {
+        if (value < 10000) value = value * 10 + (*q - '0');
+      }
+      exponent += exponent_negative ? -value : value;
+      p = q;
+    }
+  }
+  double value;
+  if (exponent >= -22 && exponent <= 22) {
+    value = static_cast<double>(mantissa);
+    value = exponent < 0 ? value / kPow10[-exponent] :
+        value * kPow10[exponent];
+  } else {
+    std::string text(start, p);
+    value = std::strtod(text.c_str(), nullptr);
+    negative = false;
+  }
+  *out = static_cast<float>(negative ? -value : value);
+  return p;
+}
+
+const char *ParseInt(const char *p, const char *end, int *out) {
+  bool negative = false;
+  if (p < end && (*p == '-' || *p == '+')) {
+    negative = *p == '-';
+    p++;
+  }
+  if (p >= end || !IsDigit(*p)) return nullptr;
+  int value = 0;
+  for (; p < end && IsDigit(*p); p++) {
+    value = value * 10 + (*p - '0');
+  }
+  *out = negative ? -value : value;
+  return p;
+}
+
+std::string ParseName(const char *p, const char *end) {
+  p = SkipSpace(p, end);
+  while (end > p && IsSpace(end[-1])) end--;
+  return std::string(p, end);
+}
+
+// stable per position shading for assets without textures
+void FillVertex(Vertex *vertex, const float *position, uint32_t index,
+    bool z_up) {
+  const float &x = position[0];
+  const float &y = position[1];
+  const float &z = position[2];
+  vertex->position[0] = x;
+  vertex->position[1] = z_up ? z : y;
+  vertex->position[2] = z_up ? y : z;
+  float i = static_cast<float>(index * 3);
+  vertex->color[0] = (std::cos(i * 0.324f) + 1.0f) * 0.5f;
+  vertex->color[1] = (std::cos(i * 0.513f) + 1.0f) * 0.5f;
+  vertex->color[2] = (std::cos(i + 0.762f) + 1.0f) * 0.5f;
+  vertex->uv[0] = 0.0f;
+  vertex->uv[1] = 0.0f;
+}
+
+struct ObjChunk {
+  const char *begin;
+  const char *end;
+  // counted by the first pass
+  uint32_t position_count;
+  uint32_t texcoord_count;
+  uint32_t corner_count;
+  std::vector<std::string> mtllibs;
+  // exclusive prefix sums over the preceding chunks
+  uint32_t position_offset;
+  uint32_t texcoord_offset;
+  uint32_t corner_offset;
+  // usemtl switches as (corner, material)
+  std::vector<std::pair<uint32_t, uint32_t>> switches;
+  bool failed;
+};
+
+// Shared state of the second pass. Either vertices and indices are
+// written in place, or positions, texcoords and corners are gathered
+// for the per corner expansion.
+struct ObjTarget {
+  bool per_corner;
+  bool z_up;
+  uint32_t position_count;
+  uint32_t texcoord_count;
+  const std::map<std::string, int> *material_map;
+  uint32_t default_material;
+  Vertex *vertices;
+  uint32_t *indices;
+  float *positions;
+  float *texcoords;
+  uint32_t *corners;
+};
+
+void CountChunk(ObjChunk *chunk) {
+  const char *p = chunk->begin;
+  const char *end = chunk->end;
+  while (p < end) {
+    const char *eol = static_cast<const char *>(memchr(p, '\n', end - p));
+    if (eol == nullptr) eol = end;
+    const char *q = SkipSpace(p, eol);
+    if (StartsWith(q, eol, "v", 1)) {
+      chunk->position_count++;
+    } else if (StartsWith(q, eol, "vt", 2)) {
+      chunk->texcoord_count++;
+    } else if (StartsWith(q, eol, "f", 1)) {
+      uint32_t n = 0;
+      q += 1;
+      while (true) {
+        q = SkipSpace(q, eol);
+        if (q >= eol) break;
+        n++;
+        while (q < eol && !IsSpace(*q)) q++;
+      }
+      if (n >= 3) chunk->corner_count += 3 * (n - 2);
+    } else if (StartsWith(q, eol, "mtllib", 6)) {
+      chunk->mtllibs.push_back(ParseName(q + 6, eol));
+    }
+    p = eol + 1;
+  }
+}
+
+void ParseChunk(ObjChunk *chunk, const ObjTarget &target) {
+  const char *p = chunk->begin;
+  const char *end = chunk->end;
+  uint32_t position = chunk->position_offset;
+  uint32_t texcoord = chunk->texcoord_offset;
+  uint32_t corner = chunk->corner_offset;
+  std::vector<std::pair<uint32_t, uint32_t>> face;
+  while (p < end) {
+    const char *eol = static_cast<const char *>(memchr(p, '\n', end - p));
+    if (eol == nullptr) eol = end;
+    const char *q = SkipSpace(p, eol);
+    if (StartsWith(q, eol, "v", 1)) {
+      float xyz[3];
+      q += 1;
+      for (int i = 0; i < 3 && q != nullptr; i++) {
+        q = ParseFloat(q, eol, &xyz[i]);
+      }
+      if (q == nullptr) {
+        chunk->failed = true;
+        return;
+      }
+      if (target.per_corner) {
+        memcpy(&target.positions[position * 3], xyz, sizeof(xyz));
+      } else {
+        FillVertex(&target.vertices[position], xyz, position, target.z_up);
+      }
+      position++;
+    } else if (StartsWith(q, eol, "vt", 2)) {
+      // the v coordinate is optional
+      float uv[2] = { 0.0f, 0.0f };
+      q = ParseFloat(q + 2, eol, &uv[0]);
+      if (q != nullptr) ParseFloat(q, eol, &uv[1]);
+      if (q == nullptr) {
+        chunk->failed = true;
+        return;
+      }
+      if (target.per_corner) {
+        target.texcoords[texcoord * 2 + 0] = uv[0];
+        target.texcoords[texcoord * 2 + 1] = 1.0f - uv[1];
+      }
+      texcoord++;
+    } else if (StartsWith(q, eol, "f", 1)) {
+      face.clear();
+      q += 1;
+      while (true) {
+        q = SkipSpace(q, eol);
+        if (q >= eol) break;
+        int v = 0;
+        int vt = 0;
+        q = ParseInt(q, eol, &v);
+        if (q != nullptr && q < eol && *q == '/') {
+          q++;
+          if (q < eol && *q != '/') q = ParseInt(q, eol, &vt);
+          // normals are not used
+          if (q != nullptr && q < eol && *q == '/') {
+            q++;
+            while (q < eol && !IsSpace(*q)) q++;
+          }
+        }
+        if (q == nullptr || v == 0) {
+          chunk->failed = true;
+          return;
+        }
+        // negative indices are relative to the elements read so far
+        int64_t vi = v > 0 ? v - 1 : static_cast<int64_t>(position) + v;
+        int64_t ti = vt > 0 ? vt - 1 :
+            vt < 0 ? static_cast<int64_t>(texcoord) + vt : -1;
+        if (vi < 0 || vi >= target.position_count ||
+            ti >= static_cast<int64_t>(target.texcoord_count) ||
+            (vt != 0 && ti < 0)) {
+          chunk->failed = true;
+          return;
+        }
+        face.push_back(std::make_pair(static_cast<uint32_t>(vi),
+            ti < 0 ? kNoTexcoord : static_cast<uint32_t>(ti)));
+      }
+      for (size_t i = 1; i + 1 < face.size(); i++) {
+        const std::pair<uint32_t, uint32_t> *triangle[] = {
+          &face[0], &face[i], &face[i + 1]
+        };
+        for (const auto *c : triangle) {
+          if (target.per_corner) {
+            target.corners[corner * 2 + 0] = c->first;
+            target.corners[corner * 2 + 1] = c->second;
+          } else {
+            target.indices[corner] = c->first;
+          }
+          corner++;
+        }
+      }
+    } else if (StartsWith(q, eol, "usemtl", 6)) {
+      auto it = target.material_map->find(ParseName(q + 6, eol));
+      uint32_t material = it != target.material_map->end() ?
+          static_cast<uint32_t>(it->second) : target.default_material;
+      chunk->switches.push_back(std::make_pair(corner, material));
+    }
+    p = eol + 1;
+  }
+}
+
+void ExpandCorners(const ObjChunk &chunk, const ObjTarget &target) {
+  uint32_t begin = chunk.corner_offset;
+  uint32_t end = begin + chunk.corner_count;
+  for (uint32_t c = begin; c < end; c++) {
+    uint32_t position = target.corners[c * 2 + 0];
+    uint32_t texcoord = target.corners[c * 2 + 1];
+    Vertex &vertex = target.vertices[c];
+    FillVertex(&vertex, &target.positions[position * 3], position,
+        target.z_up);
+    if (texcoord != kNoTexcoord) {
+      vertex.uv[0] = target.texcoords[texcoord * 2 + 0];
+      vertex.uv[1] = target.texcoords[texcoord * 2 + 1];
+    }
+    target.indices[c] = c;
+  }
+}
+
+struct ParallelTask {
+  const std::function<void(size_t)> *function;
+  size_t index;
+};
+
+void *RGLParallelTaskEntry(void *arg) {
+  ParallelTask *task = static_cast<ParallelTask *>(arg);
+  (*task->function)(task->index);
+  return nullptr;
+}
+
+// runs function(0) on the calling thread and the rest on new threads
+void ParallelFor(size_t count, const std::function<void(size_t)> &function) {
+  std::vector<pthread_t> threads(count);
+  std::vector<ParallelTask> tasks(count);
+  for (size_t i = 1; i < count; i++) {
+    tasks[i] = ParallelTask { &function, i };
+    pthread_create(&threads[i], nullptr, RGLParallelTaskEntry, &tasks[i]);
+  }
+  if (count > 0) function(0);
+  for (size_t i = 1; i < count; i++) {
+    pthread_join(threads[i], nullptr);
+  }
+}
+
+// splits the mapping into chunks ending right after a newline
+std::vector<ObjChunk> SplitChunks(const char *data, size_t size,
+    size_t thread_count) {
+  size_t count = std::max<size_t>(1,
+      std::min(thread_count, size / kMinChunkSize));
+  std::vector<ObjChunk> chunks;
+  const char *end = data + size;
+  const char *p = data;
+  for (size_t i = 0; i < count && p < end; i++) {
+    const char *chunk_end = i + 1 == count ? end :
+        std::max(p, data + size / count * (i + 1));
+    if (chunk_end < end) {
+      const char *eol = static_cast<const char *>(
+          memchr(chunk_end, '\n', end - chunk_end));
+      chunk_end = eol == nullptr ? end : eol + 1;
+    }
+    ObjChunk chunk = {};
+    chunk.begin = p;
+    chunk.end = chunk_end;
+    chunks.push_back(std::move(chunk));
+    p = chunk_end;
+  }
+  return chunks;
+}
+
+void LoadMaterials(const std::vector<ObjChunk> &chunks,
+    const std::string &base_dir, ObjModel *model,
+    std::map<std::string, int> *material_map) {
+  for (const auto &chunk : chunks) {
+    for (const auto &name : chunk.mtllibs) {
+      std::ifstream stream(base_dir + name);
+      if (!stream) continue;
+      std::string warning;
+      std::string error;
+      tinyobj::LoadMtl(material_map, &model->materials, &stream,
+          &warning, &error);
+    }
+  }
+}
+
+}  // unnamed namespace
+
+bool LoadObjModel(const std::string &path, const std::string &base_dir,
+    const ObjLoadOptions &options, ObjModel *model, std::string *err) {
+  MappedFile file;
+  if (!file.Open(path)) {
+    if (err) *err = "could not open " + path;
+    return false;
+  }
+  size_t thread_count = options.thread_count;
+  if (thread_count == 0) {
+    long processors = sysconf(_SC_NPROCESSORS_ONLN);
+    thread_count = processors > 0 ? static_cast<size_t>(processors) : 1;
+  }
+  std::vector<ObjChunk> chunks =
+      SplitChunks(file.Data(), file.Size(), thread_count);
+  // first pass sizes every output so that threads write in place
+  ParallelFor(chunks.size(), [&](size_t i) { CountChunk(&chunks[i]); });
+  uint64_t position_count = 0;
+  uint64_t texcoord_count = 0;
+  uint64_t corner_count = 0;
+  for (auto &chunk : chunks) {
+    chunk.position_offset = static_cast<uint32_t>(position_count);
+    chunk.texcoord_offset = static_cast<uint32_t>(texcoord_count);
+    chunk.corner_offset = static_cast<uint32_t>(corner_count);
+    position_count += chunk.position_count;
+    texcoord_count += chunk.texcoord_count;
+    corner_count += chunk.corner_count;
+  }
+  if (corner_count > 0xffffffffu) {
+    if (err) *err = "too many faces in " + path;
+    return false;
+  }
+  model->materials.clear();
+  std::map<std::string, int> material_map;
+  LoadMaterials(chunks, base_dir, model, &material_map);
+
+  ObjTarget target;
+  target.per_corner = texcoord_count > 0;
+  target.z_up = options.z_up;
+  target.position_count = static_cast<uint32_t>(position_count);
+  target.texcoord_count = static_cast<uint32_t>(texcoord_count);
+  target.material_map = &material_map;
+  target.default_material = static_cast<uint32_t>(model->materials.size());
+  std::vector<float> positions;
+  std::vector<float> texcoords;
+  std::vector<uint32_t> corners;
+  if (target.per_corner) {
+    positions.resize(position_count * 3);
+    texcoords.resize(texcoord_count * 2);
+    corners.resize(corner_count * 2);
+    model->vertices.resize(corner_count);
+  } else {
+    model->vertices.resize(position_count);
+  }
+  model->indices.resize(corner_count);
+  target.vertices = model->vertices.data();
+  target.indices = model->indices.data();
+  target.positions = positions.data();
+  target.texcoords = texcoords.data();
+  target.corners = corners.data();
+
+  ParallelFor(chunks.size(), [&](size_t i) {
+    ParseChunk(&chunks[i], target);
+  });
+  for (const auto &chunk : chunks) {
+    if (chunk.failed) {
+      if (err) *err = "malformed line in " + path;
+      return false;
+    }
+  }
+  if (target.per_corner) {
+    ParallelFor(chunks.size(), [&](size_t i) {
+      ExpandCorners(chunks[i], target);
+    });
+  }
+
+  // one mesh per usemtl run, adjacent runs of a material are merged
+  model->meshes.clear();
+  uint32_t material = target.default_material;
+  uint32_t first = 0;
+  auto flush = [&](uint32_t last) {
+    if (last == first) return;
+    if (!model->meshes.empty() &&
+        model->meshes.back().material == material) {
+      model->meshes.back().index_count += last - first;
+    } else {
+      model->meshes.push_back(Mesh { first, last - first, material });
+    }
+    first = last;
+  };
+  for (const auto &chunk : chunks) {
+    for (const auto &change : chunk.switches) {
+      flush(change.first);
+      material = change.second;
+    }
+  }
+  flush(static_cast<uint32_t>(corner_count));
+  return true;
+}
+
+}  // namespace rigel
@@ -0,0 +1,43 @@
+
+#ifndef RIGEL_GRAPHICS_OBJ_LOADER_H_
+#define RIGEL_GRAPHICS_OBJ_LOADER_H_
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "render_mesh.h"
+#include "third_party/tiny_obj_loader.h"
+
+namespace rigel {
+
+struct ObjLoadOptions {
+  // 0 uses every online processor
+  size_t thread_count;
+  // swaps y and z so that z-up assets face the camera
+  bool z_up;
+
+  ObjLoadOptions() : thread_count(0), z_up(true) {}
+};
+
+// Geometry already laid out for the vertex and index buffers.
+// Each mesh is a contiguous index range of a single usemtl run, and
+// the material index past the end of materials is the default material.
+struct ObjModel {
+  std::vector<Vertex> vertices;
+  std::vector<uint32_t> indices;
+  std::vector<Mesh> meshes;
+  std::vector<tinyobj::material_t> materials;
+};
+
+// Parses a Wavefront OBJ file from a memory mapping, splitting it on line
+// boundaries across threads. Only positions, texture coordinates, faces
+// and materials are read. Faces are triangulated as fans.
+// Vertices are shared by position when the file has no texture
+// coordinates, and emitted per face corner otherwise.
+bool LoadObjModel(const std::string &path, const std::string &base_dir,
+    const ObjLoadOptions &options, ObjModel *model, std::string *err);
+
+}  // namespace rigel
+
+#endif  // RIGEL_GRAPHICS_OBJ_LOADER_H_
@@ -1,13 +1,52 @@
-
-
 #include "render.h"
 #include "render_instance.h"
+#include "renderer_pool.h"
+#include "render_engine.h"
+#include "logging.inc"
 
 namespace rigel {
 
+namespace {
+
+// renderers kept ready for sessions about to start
+constexpr size_t kWarmRenderers = 2;
+
+}  // unnamed namespace
+
+RenderContext::RenderContext() : RenderContext(kWarmRenderers) {}
+
+RenderContext::RenderContext(size_t warm_renderers) {
+  const std::vector<GraphicsDeviceInfo> devices =
+      GraphicsRenderer::QueryDevices();
+  for (size_t i = 0; i < devices.size(); i++) {
+    RGL_INFO("GPU " + std::to_string(i) + ": " + devices[i].name + ", " +
+        std::to_string(devices[i].memory_bytes >> 20) + "MiB");
+    pools_.emplace_back(new GraphicsRendererPool(warm_renderers,
+        static_cast<uint32_t>(i)));
+    memory_bytes_.push_back(devices[i].memory_bytes);
+  }
+  if (pools_.empty()) {
+    // the renderers report the failure themselves
+    pools_.emplace_back(new GraphicsRendererPool(warm_renderers));
+    memory_bytes_.push_back(0);
+  }
+}
+
+RenderContext::~RenderContext() = default;
+
 std::unique_ptr<RenderInstanceInterface> RenderContext::CreateInstance(
-    RenderInstanceSink *sink) {
-  return std::unique_ptr<RenderInstanceInterface>(new RenderInstance(sink));
+    RenderInstanceSink *sink, size_t device) {
+  return std::unique_ptr<RenderInstanceInterface>(
+      new RenderInstance(sink, pools_[device % pools_.size()].get()));
+}
+
+RenderDeviceStatus RenderContext::GetDeviceStatus(size_t device) const {
+  RenderDeviceStatus status;
+  status.memory_bytes = memory_bytes_[device];
+  const GraphicsRendererPoolStats stats = pools_[device]->GetStats();
+  status.frame_time = stats.frame_time;
+  status.frames = stats.frames;
+  return status;
 }
 
 }  // namespace rigel
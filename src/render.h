@@ -3,33 +3,113 @@
 #define RIGEL_GRAPHICS_RENDER_H_
 
 #include <memory>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#include "frame_trace.h"
 
 namespace rigel {
 
+class GraphicsRendererPool;
+
+// RGBA frame read back from the renderer. The image is split into
+// square tiles, and only tiles flagged in dirty_tiles have changed
+// since the previous frame delivered to the same sink.
+struct RenderFrame {
+  const char *data;
+  int width;
+  int height;
+  int stride;
+  int tile_size;
+  int tile_columns;
+  int tile_rows;
+  // one bit per tile in row-major order
+  const uint32_t *dirty_tiles;
+  // stamped up to the readback, sinks carry it on
+  FrameTrace trace;
+
+  bool IsTileDirty(int column, int row) const {
+    int tile = row * tile_columns + column;
+    return (dirty_tiles[tile / 32] >> (tile % 32)) & 1;
+  }
+
+  bool IsTileRowDirty(int row) const {
+    for (int column = 0; column < tile_columns; column++) {
+      if (IsTileDirty(column, row)) return true;
+    }
+    return false;
+  }
+};
+
+// relative input with the server time it happened at
+struct RenderInputEvent {
+  int x, y, z;
+  // client sequence number, 0 for none
+  uint32_t sequence;
+  int64_t time_us;
+};
+
 struct RenderInstanceSink {
-  virtual void OnRenderFrame(const char *v, int w, int h, int r) = 0;
+  virtual void OnRenderFrame(const RenderFrame &frame) = 0;
 };
 
 struct RenderInstanceInterface {
   virtual ~RenderInstanceInterface() = default;
   virtual void StartRendering() = 0;
   virtual void StopRendering() = 0;
-  virtual void InputXYAxis(int x, int y) = 0;
-  virtual void InputZAxis(int z) = 0;
+  // sequence is the client sequence number of the event, 0 for none
+  virtual void InputXYAxis(int x, int y, uint32_t sequence) = 0;
+  virtual void InputZAxis(int z, uint32_t sequence) = 0;
+  // a batch of events received in a single message
+  virtual void InputEvents(const RenderInputEvent *events, size_t count) = 0;
 };
 
 struct RenderInstanceFactoryInterface {
   virtual ~RenderInstanceFactoryInterface() = default;
+  // device is the GPU to render on, see RenderDeviceMonitorInterface
   virtual std::unique_ptr<RenderInstanceInterface> CreateInstance(
-      RenderInstanceSink *sink) = 0;
+      RenderInstanceSink *sink, size_t device) = 0;
+};
+
+struct RenderDeviceStatus {
+  // device local memory, 0 when unknown
+  uint64_t memory_bytes;
+  // recent frame times of the instances rendering on the device
+  LatencySummary frame_time;
+  // frames recorded on the device so far
+  uint64_t frames;
 };
 
-class RenderContext : public RenderInstanceFactoryInterface {
+struct RenderDeviceMonitorInterface {
+  virtual ~RenderDeviceMonitorInterface() = default;
+  // at least one
+  virtual size_t DeviceCount() const = 0;
+  // safe to call from any thread
+  virtual RenderDeviceStatus GetDeviceStatus(size_t device) const = 0;
+};
+
+// Instances take their renderer from a pool kept warm in the background,
+// one pool per GPU
+class RenderContext : public RenderInstanceFactoryInterface,
+    public RenderDeviceMonitorInterface {
  public:
-  RenderContext() = default;
+  RenderContext();
+  explicit RenderContext(size_t warm_renderers);
   explicit RenderContext(const RenderContext &) = delete;
+  ~RenderContext() override;
   std::unique_ptr<RenderInstanceInterface> CreateInstance(
-      RenderInstanceSink *sink) override;
+      RenderInstanceSink *sink, size_t device) override;
+
+  size_t DeviceCount() const override { return pools_.size(); }
+  RenderDeviceStatus GetDeviceStatus(size_t device) const override;
+  GraphicsRendererPool *RendererPool(size_t device) {
+    return pools_[device].get();
+  }
+
+ private:
+  std::vector<std::unique_ptr<GraphicsRendererPool>> pools_;
+  std::vector<uint64_t> memory_bytes_;
 };
 
 }  // namespace rigel
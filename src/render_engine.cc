@@ -8,6 +8,8 @@
 #include <array>
 #include <iostream>
 #include <algorithm>
+#include <memory>
+#include <utility>
 
 #define GLM_FORCE_RADIANS
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
@@ -18,16 +20,29 @@
 #include <vulkan/vulkan.h>
 
 #include "render_engine.h"
+#include "render_scene.h"
+#include "render_mesh.h"
+#include "render_queue.h"
+#include "render_pipeline.h"
+#include "render_texture.h"
+#include "render_graph.h"
+#include "render_tile_diff.h"
+#include "input_watermark.h"
+#include "obj_loader.h"
 #include "render_helper.inc"
 #include "logging.inc"
 
-#define TINYOBJLOADER_IMPLEMENTATION
-#include "third_party/tiny_obj_loader.h"
-
 #define VK_CHECK_RESULT(f) (f)
 
 namespace rigel {
 
+constexpr size_t kSceneCapacity = 4096;
+constexpr uint32_t kUnresolvedPipeline = 0xffffffffu;
+// device memory available to streamed textures of a single session
+constexpr VkDeviceSize kTextureBudget = 64 * 1024 * 1024;
+// granularity of change detection and partial readback
+constexpr uint32_t kCaptureTileSize = 64;
+
 class GraphicsRendererImpl {
  public:
   VkInstance instance;
@@ -39,11 +54,16 @@ class GraphicsRendererImpl {
   VkCommandPool commandPool;
   VkCommandBuffer commandBuffer;
   VkDescriptorSetLayout descriptorSetLayout;
+  VkDescriptorPool descriptorPool;
   VkPipelineLayout pipelineLayout;
-  VkPipeline pipeline;
+  PipelineStateCache pipelines_;
   std::vector<VkShaderModule> shaderModules;
   VkBuffer vertexBuffer, indexBuffer;
   VkDeviceMemory vertexMemory, indexMemory;
+  // world matrices in draw order, rewritten every frame
+  VkBuffer instanceBuffer;
+  VkDeviceMemory instanceMemory;
+  Instance *instances_;
 
   const char* imagedata;
   VkImage dstImage;
@@ -60,23 +80,42 @@ class GraphicsRendererImpl {
   FrameBufferAttachment colorAttachment, depthAttachment;
   VkRenderPass renderPass;
 
-  uint32_t draw_index_count_;
+  // scene rendering, tile comparison, readback to the host visible
+  // image and host access
+  RenderGraph graph_;
+  RenderGraph::Pass scenePass_, diffPass_, readbackPass_, hostPass_;
+
+  // only tiles that changed are copied into the persistent host image
+  TileDiff tileDiff_;
+  bool tileDiffEnabled_;
+  bool forceFullCapture_;
+  uint32_t captureRowPitch_;
+  std::vector<uint32_t> dirtyTiles_;
+  std::vector<VkImageCopy> copyRegions_;
+
+  struct Material {
+    PipelineState state;
+    // resolved on first draw
+    uint32_t pipeline;
+    // streamed texture, -1 for vertex colors only
+    int texture;
+    VkDescriptorSet descriptorSet;
+  };
+  std::vector<Material> materials_;
+  std::vector<Mesh> meshes_;
+  std::unique_ptr<TextureStreamer> textures_;
+
+  SceneStore scene_;
+  RenderQueue queue_;
+  RenderStats stats_;
+  // trace of the last rendered frame, handed over by Capture
+  FrameTrace trace_;
+  // camera of the last rendered frame
+  glm::mat4 viewProj_;
 
   uint32_t GetMemoryTypeIndex(uint32_t typeBits,
       VkMemoryPropertyFlags properties) {
-    VkPhysicalDeviceMemoryProperties deviceMemoryProperties;
-    vkGetPhysicalDeviceMemoryProperties(physicalDevice,
-        &deviceMemoryProperties);
-    for (uint32_t i = 0; i < deviceMemoryProperties.memoryTypeCount; i++) {
-      if ((typeBits & 1) == 1) {
-        if ((deviceMemoryProperties.memoryTypes[i].
-            propertyFlags & properties) == properties) {
-          return i;
-        }
-      }
-      typeBits >>= 1;
-    }
-    return 0;
+    return ::GetMemoryTypeIndex(physicalDevice, typeBits, properties);
   }
 
   VkResult CreateBuffer(VkBufferUsageFlags usageFlags,
@@ -110,18 +149,11 @@ class GraphicsRendererImpl {
     Submit command buffer to a queue and wait for fence until queue operations have been finished
   */
   void SubmitWork(VkCommandBuffer cmdBuffer, VkQueue queue) {
-    VkSubmitInfo submitInfo = CreateSubmitInfo();
-    submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &cmdBuffer;
-    VkFenceCreateInfo fenceInfo = CreateFenceCreateInfo();
-    VkFence fence;
-    VK_CHECK_RESULT(vkCreateFence(device, &fenceInfo, nullptr, &fence));
-    VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, fence));
-    VK_CHECK_RESULT(vkWaitForFences(device, 1, &fence, VK_TRUE, UINT64_MAX));
-    vkDestroyFence(device, fence, nullptr);
+    ::SubmitWork(device, cmdBuffer, queue);
   }
 
-  GraphicsRendererImpl() {
+  explicit GraphicsRendererImpl(uint32_t device_index)
+      : scene_(kSceneCapacity), stats_(), trace_(), viewProj_(1.0f) {
     VkApplicationInfo appInfo = {};
     appInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
     appInfo.pApplicationName = "Rigel";
@@ -145,7 +177,7 @@ class GraphicsRendererImpl {
     std::vector<VkPhysicalDevice> physicalDevices(deviceCount);
     VK_CHECK_RESULT(vkEnumeratePhysicalDevices(instance,
         &deviceCount, physicalDevices.data()));
-    physicalDevice = physicalDevices[0];
+    physicalDevice = physicalDevices[device_index % deviceCount];
 
     VkPhysicalDeviceProperties deviceProperties;
     vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
@@ -174,11 +206,18 @@ class GraphicsRendererImpl {
         }
       }
     }
+    // Block-compressed textures are optional
+    VkPhysicalDeviceFeatures supportedFeatures;
+    vkGetPhysicalDeviceFeatures(physicalDevice, &supportedFeatures);
+    VkPhysicalDeviceFeatures enabledFeatures = {};
+    enabledFeatures.textureCompressionBC =
+        supportedFeatures.textureCompressionBC;
     // Create logical device
     VkDeviceCreateInfo deviceCreateInfo = {};
     deviceCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
     deviceCreateInfo.queueCreateInfoCount = 1;
     deviceCreateInfo.pQueueCreateInfos = &queueCreateInfo;
+    deviceCreateInfo.pEnabledFeatures = &enabledFeatures;
     VK_CHECK_RESULT(vkCreateDevice(physicalDevice,
         &deviceCreateInfo, nullptr, &device));
 
@@ -196,56 +235,41 @@ class GraphicsRendererImpl {
     /*
       Prepare vertex and index buffers
     */
-    struct Vertex {
-      float position[3];
-      float color[3];
-    };
     {
       std::vector<Vertex> vertices;
       std::vector<uint32_t> indices;
       {
         std::string inputfile = "res/cube.obj";
-
-        tinyobj::attrib_t attrib;
-        std::vector<tinyobj::shape_t> shapes;
-        std::vector<tinyobj::material_t> materials;
-
-        std::string warn;
+        ObjModel model;
         std::string err;
-
-        bool ret = tinyobj::LoadObj(&attrib, &shapes,
-            &materials, &warn, &err, inputfile.c_str());
-        if (!ret) {
+        if (!LoadObjModel(inputfile, "res/", ObjLoadOptions(), &model, &err)) {
           RGL_WARN("count not load " + inputfile);
           exit(1);
         }
-        for (int i = 0; i < attrib.vertices.size(); i += 3) {
-          const auto &x = attrib.vertices[i + 0];
-          const auto &y = attrib.vertices[i + 1];
-          const auto &z = attrib.vertices[i + 2];
-          Vertex vtx = {
-            { x, z, y },
-            {
-              (glm::cos(i * 0.324f) + 1.0f) * 0.5f,
-              (glm::cos(i * 0.513f) + 1.0f) * 0.5f,
-              (glm::cos(i + 0.762f) + 1.0f) * 0.5f
-            }
-          };
-          vertices.push_back(vtx);
-        }
-        for (size_t s = 0; s < shapes.size(); s++) {
-          size_t index_offset = 0;
-          for (size_t f = 0; f < shapes[s].mesh.num_face_vertices.size(); f++) {
-            int fv = shapes[s].mesh.num_face_vertices[f];
-            for (size_t v = 0; v < fv; v++) {
-              tinyobj::index_t idx = shapes[s].mesh.indices[index_offset + v];
-              indices.push_back(idx.vertex_index);
-            }
-            index_offset += fv;
+        vertices = std::move(model.vertices);
+        indices = std::move(model.indices);
+        meshes_ = std::move(model.meshes);
+        // the last material is the default one for faces without usemtl
+        textures_ = std::unique_ptr<TextureStreamer>(new TextureStreamer(
+            physicalDevice, device, queue, commandPool, kTextureBudget));
+        for (const auto &material : model.materials) {
+          Material m;
+          m.state = material.dissolve < 1.0f ?
+              PipelineState::Translucent() : PipelineState::Opaque();
+          m.pipeline = kUnresolvedPipeline;
+          m.texture = -1;
+          m.descriptorSet = VK_NULL_HANDLE;
+          const std::string &name = material.diffuse_texname;
+          if (name.size() > 5 &&
+              name.compare(name.size() - 5, 5, ".ktx2") == 0) {
+            m.texture = textures_->Load("res/" + name);
           }
+          materials_.push_back(m);
         }
+        materials_.push_back(Material {
+          PipelineState::Opaque(), kUnresolvedPipeline, -1, VK_NULL_HANDLE
+        });
       }
-      draw_index_count_ = indices.size();
 
       const VkDeviceSize vertexBufferSize = vertices.size() * sizeof(Vertex);
       const VkDeviceSize indexBufferSize = indices.size() * sizeof(uint32_t);
@@ -319,6 +343,20 @@ class GraphicsRendererImpl {
         vkDestroyBuffer(device, stagingBuffer, nullptr);
         vkFreeMemory(device, stagingMemory, nullptr);
       }
+
+      // Instances, one per node and mesh pair at most. Render waits
+      // for its submission, so a single mapped buffer is reused
+      const VkDeviceSize instanceBufferSize =
+          kSceneCapacity * meshes_.size() * sizeof(Instance);
+      CreateBuffer(
+        VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
+            | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        &instanceBuffer,
+        &instanceMemory,
+        instanceBufferSize);
+      VK_CHECK_RESULT(vkMapMemory(device, instanceMemory, 0,
+          instanceBufferSize, 0, reinterpret_cast<void **>(&instances_)));
     }
 
     /*
@@ -329,6 +367,7 @@ class GraphicsRendererImpl {
     VkFormat colorFormat = VK_FORMAT_R8G8B8A8_UNORM;
     VkFormat depthFormat;
     GetSupportedDepthFormat(physicalDevice, &depthFormat);
+    PrepareCapture();
     {
       // Color attachment
       VkImageCreateInfo image = CreateImageCreateInfo();
@@ -342,7 +381,8 @@ class GraphicsRendererImpl {
       image.samples = VK_SAMPLE_COUNT_1_BIT;
       image.tiling = VK_IMAGE_TILING_OPTIMAL;
       image.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT
-          | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+          | VK_IMAGE_USAGE_TRANSFER_SRC_BIT
+          | VK_IMAGE_USAGE_STORAGE_BIT;
 
       VkMemoryAllocateInfo memAlloc = CreateMemoryAllocateInfo();
       VkMemoryRequirements memReqs;
@@ -371,20 +411,60 @@ class GraphicsRendererImpl {
       VK_CHECK_RESULT(vkCreateImageView(device,
           &colorImageView, nullptr, &colorAttachment.view));
 
-      // Depth stencil attachment
+      // Depth stencil attachment, its contents never leave the render pass
+      // so it is owned by the frame graph as a transient image
       image.format = depthFormat;
-      image.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+      image.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT
+          | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
 
-      VK_CHECK_RESULT(vkCreateImage(device,
-          &image, nullptr, &depthAttachment.image));
-      vkGetImageMemoryRequirements(device, depthAttachment.image, &memReqs);
-      memAlloc.allocationSize = memReqs.size;
-      memAlloc.memoryTypeIndex = GetMemoryTypeIndex(memReqs.memoryTypeBits,
-          VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-      VK_CHECK_RESULT(vkAllocateMemory(device,
-          &memAlloc, nullptr, &depthAttachment.memory));
-      VK_CHECK_RESULT(vkBindImageMemory(device,
-          depthAttachment.image, depthAttachment.memory, 0));
+      // Tile comparison, every frame is read back in full
+      // when its shader has not been built
+      VkPipelineCacheCreateInfo pipelineCacheCreateInfo = {};
+      pipelineCacheCreateInfo.sType =
+          VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+      VK_CHECK_RESULT(vkCreatePipelineCache(device,
+          &pipelineCacheCreateInfo, nullptr, &pipelineCache));
+      VkShaderModule tileDiffShader =
+          LoadShader("shaders/tile_diff.comp.spv", device);
+      tileDiffEnabled_ = tileDiffShader != VK_NULL_HANDLE &&
+          tileDiff_.Initialize(physicalDevice, device, pipelineCache,
+              tileDiffShader, colorAttachment.view, width, height,
+              kCaptureTileSize);
+      if (tileDiffShader != VK_NULL_HANDLE) {
+        shaderModules.push_back(tileDiffShader);
+      }
+      if (!tileDiffEnabled_) {
+        RGL_WARN("tile comparison unavailable, frames are read back in full");
+      }
+
+      graph_.Initialize(physicalDevice, device);
+      RenderGraph::Resource color = graph_.ImportImage(
+          colorAttachment.image, VK_IMAGE_ASPECT_COLOR_BIT);
+      RenderGraph::Resource depth = graph_.CreateTransientImage(image,
+          VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT);
+      RenderGraph::Resource capture = graph_.ImportImage(
+          dstImage, VK_IMAGE_ASPECT_COLOR_BIT);
+      scenePass_ = graph_.AddPass("scene");
+      graph_.Write(scenePass_, color, kRenderGraphColorAttachment, true);
+      graph_.Write(scenePass_, depth, kRenderGraphDepthAttachment, true);
+      if (tileDiffEnabled_) {
+        RenderGraph::Resource history = graph_.ImportImage(
+            tileDiff_.GetHistoryImage(), VK_IMAGE_ASPECT_COLOR_BIT);
+        diffPass_ = graph_.AddPass("diff");
+        graph_.Read(diffPass_, color, kRenderGraphStorageRead);
+        graph_.Write(diffPass_, history, kRenderGraphStorageWrite, false);
+      }
+      // clean tiles of the host image are kept from previous frames
+      readbackPass_ = graph_.AddPass("readback");
+      graph_.Read(readbackPass_, color, kRenderGraphTransferSrc);
+      graph_.Write(readbackPass_, capture, kRenderGraphTransferDst, false);
+      hostPass_ = graph_.AddPass("host");
+      graph_.Read(hostPass_, capture, kRenderGraphHostRead);
+      if (!graph_.Compile()) {
+        exit(1);
+      }
+      depthAttachment.image = graph_.GetImage(depth);
+      depthAttachment.memory = VK_NULL_HANDLE;
 
       VkImageViewCreateInfo depthStencilView = CreateImageViewCreateInfo();
       depthStencilView.viewType = VK_IMAGE_VIEW_TYPE_2D;
@@ -416,8 +496,8 @@ class GraphicsRendererImpl {
         color.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
         color.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
         color.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-        color.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-        color.finalLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        color.initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+        color.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
         // Depth attachment
         auto &depth = attchmentDescriptions[1];
         depth.format = depthFormat;
@@ -426,7 +506,7 @@ class GraphicsRendererImpl {
         depth.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
         depth.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
         depth.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-        depth.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        depth.initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
         depth.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
       }
 
@@ -441,30 +521,8 @@ class GraphicsRendererImpl {
       subpassDescription.pColorAttachments = &colorReference;
       subpassDescription.pDepthStencilAttachment = &depthReference;
 
-      // Use subpass dependencies for layout transitions
-      std::array<VkSubpassDependency, 2> dependencies;
-
-      dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
-      dependencies[0].dstSubpass = 0;
-      dependencies[0].srcStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
-      dependencies[0].dstStageMask =
-          VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-      dependencies[0].srcAccessMask = VK_ACCESS_MEMORY_READ_BIT;
-      dependencies[0].dstAccessMask =
-          VK_ACCESS_COLOR_ATTACHMENT_READ_BIT |
-          VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-      dependencies[0].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
-
-      dependencies[1].srcSubpass = 0;
-      dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
-      dependencies[1].srcStageMask =
-          VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-      dependencies[1].dstStageMask =
-          VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
-      dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT |
-          VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-      dependencies[1].dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
-      dependencies[1].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+      // Layout transitions and dependencies on the surrounding passes
+      // are recorded by the frame graph around the render pass
 
       // Create the actual renderpass
       VkRenderPassCreateInfo renderPassInfo = {};
@@ -474,9 +532,7 @@ class GraphicsRendererImpl {
       renderPassInfo.pAttachments = attchmentDescriptions.data();
       renderPassInfo.subpassCount = 1;
       renderPassInfo.pSubpasses = &subpassDescription;
-      renderPassInfo.dependencyCount =
-          static_cast<uint32_t>(dependencies.size());
-      renderPassInfo.pDependencies = dependencies.data();
+      renderPassInfo.dependencyCount = 0;
       VK_CHECK_RESULT(vkCreateRenderPass(device,
           &renderPassInfo, nullptr, &renderPass));
 
@@ -500,16 +556,26 @@ class GraphicsRendererImpl {
       Prepare graphics pipeline
     */
     {
-      std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings = {};
+      // Binding 0: material texture
+      VkDescriptorSetLayoutBinding textureBinding = {};
+      textureBinding.binding = 0;
+      textureBinding.descriptorType =
+          VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+      textureBinding.descriptorCount = 1;
+      textureBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+      std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings = {
+        textureBinding
+      };
       VkDescriptorSetLayoutCreateInfo descriptorLayout =
           CreateDescriptorSetLayoutCreateInfo(setLayoutBindings);
       VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device,
           &descriptorLayout, nullptr, &descriptorSetLayout));
 
       VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo =
-          CreatePipelineLayoutCreateInfo(nullptr, 0);
+          CreatePipelineLayoutCreateInfo(&descriptorSetLayout, 1);
 
-      // MVP via push constant block
+      // view projection via push constant block, world matrices
+      // are per instance
       VkPushConstantRange pushConstantRange =
           CreatePushConstantRange(VK_SHADER_STAGE_VERTEX_BIT,
               sizeof(glm::mat4), 0);
@@ -521,113 +587,92 @@ class GraphicsRendererImpl {
       VK_CHECK_RESULT(vkCreatePipelineLayout(device,
           &pipelineLayoutCreateInfo, nullptr, &pipelineLayout));
 
-      VkPipelineCacheCreateInfo pipelineCacheCreateInfo = {};
-      pipelineCacheCreateInfo.sType =
-          VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
-      VK_CHECK_RESULT(vkCreatePipelineCache(device,
-          &pipelineCacheCreateInfo, nullptr, &pipelineCache));
-
-      // Create pipeline
-      VkPipelineInputAssemblyStateCreateInfo inputAssemblyState =
-          CreatePipelineInputAssemblyStateCreateInfo(
-              VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, 0, VK_FALSE);
-
-      VkPipelineRasterizationStateCreateInfo rasterizationState =
-          CreatePipelineRasterizationStateCreateInfo(
-              VK_POLYGON_MODE_FILL, VK_CULL_MODE_BACK_BIT,
-              VK_FRONT_FACE_COUNTER_CLOCKWISE);
-
-      VkPipelineColorBlendAttachmentState blendAttachmentState =
-          CreatePipelineColorBlendAttachmentState(0xf, VK_FALSE);
-
-      VkPipelineColorBlendStateCreateInfo colorBlendState =
-          CreatePipelineColorBlendStateCreateInfo(1, &blendAttachmentState);
-
-      VkPipelineDepthStencilStateCreateInfo depthStencilState =
-          CreatePipelineDepthStencilStateCreateInfo(VK_TRUE, VK_TRUE,
-              VK_COMPARE_OP_LESS_OR_EQUAL);
-
-      VkPipelineViewportStateCreateInfo viewportState =
-          CreatePipelineViewportStateCreateInfo(1, 1);
-
-      VkPipelineMultisampleStateCreateInfo multisampleState =
-          CreatePipelineMultisampleStateCreateInfo(VK_SAMPLE_COUNT_1_BIT);
-
-      std::vector<VkDynamicState> dynamicStateEnables = {
-        VK_DYNAMIC_STATE_VIEWPORT,
-        VK_DYNAMIC_STATE_SCISSOR
-      };
-      VkPipelineDynamicStateCreateInfo dynamicState =
-        CreatePipelineDynamicStateCreateInfo(dynamicStateEnables);
-
-      VkGraphicsPipelineCreateInfo pipelineCreateInfo =
-        CreatePipelineCreateInfo(pipelineLayout, renderPass);
-
-      std::array<VkPipelineShaderStageCreateInfo, 2> shaderStages{};
-
-      pipelineCreateInfo.pInputAssemblyState = &inputAssemblyState;
-      pipelineCreateInfo.pRasterizationState = &rasterizationState;
-      pipelineCreateInfo.pColorBlendState = &colorBlendState;
-      pipelineCreateInfo.pMultisampleState = &multisampleState;
-      pipelineCreateInfo.pViewportState = &viewportState;
-      pipelineCreateInfo.pDepthStencilState = &depthStencilState;
-      pipelineCreateInfo.pDynamicState = &dynamicState;
-      pipelineCreateInfo.stageCount =
-          static_cast<uint32_t>(shaderStages.size());
-      pipelineCreateInfo.pStages = shaderStages.data();
-
-      // Vertex bindings an attributes
-      // Binding description
-      std::vector<VkVertexInputBindingDescription> vertexInputBindings = {
-        CreateVertexInputBindingDescription(0,
-            sizeof(Vertex), VK_VERTEX_INPUT_RATE_VERTEX),
-      };
-
-      // Attribute descriptions
-      std::vector<VkVertexInputAttributeDescription> vertexInputAttributes = {
-        // position
-        CreateVertexInputAttributeDescription(0, 0,
-            VK_FORMAT_R32G32B32_SFLOAT, 0),
-        // color
-        CreateVertexInputAttributeDescription(0, 1,
-            VK_FORMAT_R32G32B32_SFLOAT, sizeof(float) * 3),
-      };
+      // Pipeline variants are created lazily on first draw
+      pipelines_.Initialize(device, pipelineCache, pipelineLayout, renderPass);
+      VkShaderModule vertexShader =
+          LoadShader("shaders/triangle.vert.spv", device);
+      VkShaderModule fragmentShader =
+          LoadShader("shaders/triangle.frag.spv", device);
+      pipelines_.SetShaderStages(kPipelineShaderColor,
+          vertexShader, fragmentShader);
+      shaderModules.push_back(vertexShader);
+      shaderModules.push_back(fragmentShader);
+
+      // Textured variant, materials fall back to vertex colors
+      // when its shaders have not been built
+      VkShaderModule texturedVertexShader =
+          LoadShader("shaders/textured.vert.spv", device);
+      VkShaderModule texturedFragmentShader =
+          LoadShader("shaders/textured.frag.spv", device);
+      bool textured = texturedVertexShader != VK_NULL_HANDLE &&
+          texturedFragmentShader != VK_NULL_HANDLE;
+      if (textured) {
+        pipelines_.SetShaderStages(kPipelineShaderTextured,
+            texturedVertexShader, texturedFragmentShader);
+        shaderModules.push_back(texturedVertexShader);
+        shaderModules.push_back(texturedFragmentShader);
+      } else {
+        RGL_WARN("textured shaders not found, textures are disabled");
+      }
 
-      VkPipelineVertexInputStateCreateInfo vertexInputState =
-          CreatePipelineVertexInputStateCreateInfo();
-      vertexInputState.vertexBindingDescriptionCount =
-          static_cast<uint32_t>(vertexInputBindings.size());
-      vertexInputState.pVertexBindingDescriptions = vertexInputBindings.data();
-      vertexInputState.vertexAttributeDescriptionCount =
-          static_cast<uint32_t>(vertexInputAttributes.size());
-      vertexInputState.pVertexAttributeDescriptions =
-          vertexInputAttributes.data();
-
-      pipelineCreateInfo.pVertexInputState = &vertexInputState;
-
-      shaderStages[0].sType =
-          VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-      shaderStages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
-      shaderStages[0].pName = "main";
-      shaderStages[1].sType =
-          VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-      shaderStages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-      shaderStages[1].pName = "main";
-      shaderStages[0].module = LoadShader("shaders/triangle.vert.spv", device);
-      shaderStages[1].module = LoadShader("shaders/triangle.frag.spv", device);
-
-      shaderModules = { shaderStages[0].module, shaderStages[1].module };
-      VK_CHECK_RESULT(vkCreateGraphicsPipelines(device,
-          pipelineCache, 1, &pipelineCreateInfo, nullptr, &pipeline));
+      VkDescriptorPoolSize poolSize = {};
+      poolSize.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+      poolSize.descriptorCount = static_cast<uint32_t>(materials_.size());
+      VkDescriptorPoolCreateInfo poolInfo = {};
+      poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+      poolInfo.maxSets = static_cast<uint32_t>(materials_.size());
+      poolInfo.poolSizeCount = 1;
+      poolInfo.pPoolSizes = &poolSize;
+      VK_CHECK_RESULT(vkCreateDescriptorPool(device,
+          &poolInfo, nullptr, &descriptorPool));
+      for (auto &material : materials_) {
+        if (material.texture < 0) continue;
+        if (!textured) {
+          material.texture = -1;
+          continue;
+        }
+        VkDescriptorSetAllocateInfo allocInfo = {};
+        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.descriptorPool = descriptorPool;
+        allocInfo.descriptorSetCount = 1;
+        allocInfo.pSetLayouts = &descriptorSetLayout;
+        VK_CHECK_RESULT(vkAllocateDescriptorSets(device,
+            &allocInfo, &material.descriptorSet));
+        material.state.shader = kPipelineShaderTextured;
+        UpdateTextureDescriptor(material);
+      }
     }
 
     /* 
       Command buffer creation
     */
-    PrepareCapture();
     PrepareCaptureTwo();
   }
 
+  void UpdateTextureDescriptor(const Material &material) {
+    VkDescriptorImageInfo imageInfo = {};
+    imageInfo.sampler = textures_->GetSampler();
+    imageInfo.imageView = textures_->GetView(material.texture);
+    imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    VkWriteDescriptorSet write = {};
+    write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write.dstSet = material.descriptorSet;
+    write.dstBinding = 0;
+    write.descriptorCount = 1;
+    write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    write.pImageInfo = &imageInfo;
+    vkUpdateDescriptorSets(device, 1, &write, 0, nullptr);
+  }
+
+  void StreamTextures() {
+    // previous frames have completed, views can be swapped safely
+    int texture = textures_->Pump();
+    if (texture < 0) return;
+    for (const auto &material : materials_) {
+      if (material.texture == texture) UpdateTextureDescriptor(material);
+    }
+  }
+
   void PrepareCapture() {
     /*
       Copy framebuffer image to host visible image
@@ -664,8 +709,8 @@ class GraphicsRendererImpl {
   }
 
   void PrepareCaptureTwo() {
-    // Do the actual blit from the offscreen image to
-    // our host visible destination image
+    // Command buffer for the readback, recorded every capture
+    // with the regions of dirty tiles
     VkCommandBufferAllocateInfo cmdBufAllocateInfo =
         CreateCommandBufferAllocateInfo(commandPool,
             VK_COMMAND_BUFFER_LEVEL_PRIMARY, 1);
@@ -673,52 +718,33 @@ class GraphicsRendererImpl {
         &cmdBufAllocateInfo, &copyCmd));
     VkCommandBufferBeginInfo cmdBufInfo = CreateCommandBufferBeginInfo();
     VK_CHECK_RESULT(vkBeginCommandBuffer(copyCmd, &cmdBufInfo));
-    // Transition destination image to transfer destination layout
+    // Images persisting across frames start out in general layout,
+    // which is the required layout for mapping the image memory
     InsertImageMemoryBarrier(
       copyCmd,
       dstImage,
       0,
-      VK_ACCESS_TRANSFER_WRITE_BIT,
+      VK_ACCESS_HOST_READ_BIT,
       VK_IMAGE_LAYOUT_UNDEFINED,
-      VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-      VK_PIPELINE_STAGE_TRANSFER_BIT,
-      VK_PIPELINE_STAGE_TRANSFER_BIT,
-      VkImageSubresourceRange{ VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 });
-    // colorAttachment.image is already in
-    // VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-    // and does not need to be transitioned
-    VkImageCopy imageCopyRegion{};
-    imageCopyRegion.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    imageCopyRegion.srcSubresource.layerCount = 1;
-    imageCopyRegion.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    imageCopyRegion.dstSubresource.layerCount = 1;
-    imageCopyRegion.extent.width = width;
-    imageCopyRegion.extent.height = height;
-    imageCopyRegion.extent.depth = 1;
-
-    vkCmdCopyImage(
-      copyCmd,
-      colorAttachment.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-      dstImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-      1,
-      &imageCopyRegion);
-
-    // Transition destination image to general layout,
-    // which is the required layout for mapping the image memory later on
-    InsertImageMemoryBarrier(
-      copyCmd,
-      dstImage,
-      VK_ACCESS_TRANSFER_WRITE_BIT,
-      VK_ACCESS_MEMORY_READ_BIT,
-      VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
       VK_IMAGE_LAYOUT_GENERAL,
-      VK_PIPELINE_STAGE_TRANSFER_BIT,
-      VK_PIPELINE_STAGE_TRANSFER_BIT,
+      VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+      VK_PIPELINE_STAGE_HOST_BIT,
       VkImageSubresourceRange{ VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 });
-
+    if (tileDiffEnabled_) {
+      InsertImageMemoryBarrier(
+        copyCmd,
+        tileDiff_.GetHistoryImage(),
+        0,
+        VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+        VK_IMAGE_LAYOUT_UNDEFINED,
+        VK_IMAGE_LAYOUT_GENERAL,
+        VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VkImageSubresourceRange{ VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 });
+    }
     VK_CHECK_RESULT(vkEndCommandBuffer(copyCmd));
-
     SubmitWork(copyCmd, queue);
+
     // Get layout of the image (including row pitch)
     VkImageSubresource subResource{};
     subResource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
@@ -726,15 +752,43 @@ class GraphicsRendererImpl {
 
     vkGetImageSubresourceLayout(device,
         dstImage, &subResource, &subResourceLayout);
+    captureRowPitch_ = static_cast<uint32_t>(subResourceLayout.rowPitch);
 
     // Map image memory so we can start copying from it
     vkMapMemory(device, dstImageMemory, 0,
         VK_WHOLE_SIZE, 0,
             const_cast<void **>(reinterpret_cast<const void**>(&imagedata)));
     imagedata += subResourceLayout.offset;
+
+    // history contents are undefined until the first comparison
+    forceFullCapture_ = true;
+    const uint32_t columns = (width + kCaptureTileSize - 1) / kCaptureTileSize;
+    const uint32_t rows = (height + kCaptureTileSize - 1) / kCaptureTileSize;
+    dirtyTiles_.assign((columns * rows + 31) / 32, 0);
+  }
+
+  glm::mat4 ViewProjection(const RenderCamera &camera) const {
+    glm::mat4 proj(glm::perspective(
+        glm::radians(60.0f),
+        static_cast<float>(width) / static_cast<float>(height),
+        0.1f, 256.0f));
+    float theta = camera.theta - 1.72f;
+    float phi = camera.phi;
+    float dist = 15.0f;
+    dist += camera.gamma;
+    float x = dist * glm::sin(theta) * glm::cos(phi + 1.0);
+    float y = dist * glm::cos(theta);
+    float z = dist * glm::sin(theta) * glm::sin(phi + 1.0);
+    glm::vec3 eye(x, y, z);
+    auto view = glm::lookAt(eye, glm::vec3(0, 0, 0), glm::vec3(0, 1, 0));
+    return proj * view;
   }
 
-  void Render(float phi, float theta, float gamma) {
+  void Render(const RGLGraphicsCameraHandle &cameraHandle,
+      const FrameTrace &trace) {
+    trace_ = trace;
+    StreamTextures();
+
     VkCommandBuffer commandBuffer;
     VkCommandBufferAllocateInfo cmdBufAllocateInfo =
         CreateCommandBufferAllocateInfo(commandPool,
@@ -745,6 +799,7 @@ class GraphicsRendererImpl {
     VkCommandBufferBeginInfo cmdBufInfo = CreateCommandBufferBeginInfo();
 
     VK_CHECK_RESULT(vkBeginCommandBuffer(commandBuffer, &cmdBufInfo));
+    graph_.RecordBarriers(scenePass_, commandBuffer);
 
     VkClearValue clearValues[2];
     clearValues[0].color = { { 0.0f, 0.0f, 0.2f, 1.0f } };
@@ -775,47 +830,224 @@ class GraphicsRendererImpl {
     scissor.extent.height = height;
     vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
 
-    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
-
     // Render scene
     VkDeviceSize offsets[1] = { 0 };
     vkCmdBindVertexBuffers(commandBuffer, 0, 1, &vertexBuffer, offsets);
+    vkCmdBindVertexBuffers(commandBuffer, 1, 1, &instanceBuffer, offsets);
     vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0, VK_INDEX_TYPE_UINT32);
 
-    std::vector<glm::vec3> pos = {
-      glm::vec3(0, 0, 0)
-    };
-
-    for (const auto &v : pos) {
-      glm::mat4 proj(glm::perspective(
-          glm::radians(60.0f),
-          static_cast<float>(width) / static_cast<float>(height),
-          0.1f, 256.0f));
-      theta -= 1.72f;
-      float dist = 15.0f;
-      dist += gamma;
-      float x = dist * glm::sin(theta) * glm::cos(phi + 1.0);
-      float y = dist * glm::cos(theta);
-      float z = dist * glm::sin(theta) * glm::sin(phi + 1.0);
-      glm::vec3 eye(x, y, z);
-      auto view = glm::lookAt(eye, glm::vec3(0, 0, 0), glm::vec3(0, 1, 0));
-      auto model = glm::translate(glm::mat4(), v);
-      glm::mat4 mvp = proj * view;
-      vkCmdPushConstants(commandBuffer, pipelineLayout,
-        VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(glm::mat4), &mvp);
-      vkCmdDrawIndexed(commandBuffer, draw_index_count_, 1, 0, 0, 0);
+    // Only world matrices of moved nodes are recomputed
+    scene_.Update();
+    const glm::mat4 *worlds = scene_.WorldMatrices();
+    const size_t nodeCount = scene_.Size();
+    const uint32_t meshCount = static_cast<uint32_t>(meshes_.size());
+
+    // Build sort keys for every node and mesh pair. Depths come from
+    // the camera of the previous frame, the current one is not sampled yet
+    queue_.Clear();
+    for (size_t i = 0; i < nodeCount; i++) {
+      glm::vec4 clip = viewProj_ * worlds[i][3];
+      float depth = clip.w / 256.0f;
+      for (uint32_t m = 0; m < meshCount; m++) {
+        const uint32_t id = meshes_[m].material;
+        Material &material = materials_[id];
+        if (material.pipeline == kUnresolvedPipeline) {
+          material.pipeline = pipelines_.Acquire(material.state);
+        }
+        uint32_t item = static_cast<uint32_t>(i * meshCount + m);
+        uint64_t key = material.state.blend_enable ?
+            RenderSortKey::Translucent(material.pipeline, id, m, depth) :
+            RenderSortKey::Opaque(material.pipeline, id, m, depth);
+        queue_.Push(key, item);
+      }
+    }
+    queue_.Sort();
+
+    // World matrices in draw order, so each run of a mesh in the queue
+    // reads its instances from a contiguous range
+    const size_t drawCount = queue_.Size();
+    for (size_t q = 0; q < drawCount; q++) {
+      const uint32_t node = queue_.ItemAt(q) / meshCount;
+      memcpy(instances_[q].world, &worlds[node][0][0], sizeof(Instance));
+    }
+
+    // Late latch: input is sampled as late as possible, only the draw
+    // recording separates it from the submission
+    const RenderCamera camera = cameraHandle(&trace_);
+    viewProj_ = ViewProjection(camera);
+    vkCmdPushConstants(commandBuffer, pipelineLayout,
+      VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(glm::mat4), &viewProj_);
+
+    // Record one instanced draw per run of the same mesh, which shares
+    // pipeline and material, binding state only when it changes
+    RenderStats stats = {};
+    uint32_t boundPipeline = kUnresolvedPipeline;
+    uint32_t boundMaterial = kUnresolvedPipeline;
+    size_t q = 0;
+    while (q < drawCount) {
+      const uint32_t m = queue_.ItemAt(q) % meshCount;
+      size_t end = q + 1;
+      while (end < drawCount && queue_.ItemAt(end) % meshCount == m) {
+        end++;
+      }
+      const Mesh &mesh = meshes_[m];
+      const Material &material = materials_[mesh.material];
+      if (material.pipeline != boundPipeline) {
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+            pipelines_.Get(material.pipeline));
+        boundPipeline = material.pipeline;
+        stats.pipeline_binds++;
+      }
+      if (mesh.material != boundMaterial) {
+        boundMaterial = mesh.material;
+        if (material.descriptorSet != VK_NULL_HANDLE) {
+          vkCmdBindDescriptorSets(commandBuffer,
+              VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1,
+              &material.descriptorSet, 0, nullptr);
+        }
+        stats.material_binds++;
+      }
+      vkCmdDrawIndexed(commandBuffer, mesh.index_count,
+          static_cast<uint32_t>(end - q), mesh.first_index, 0,
+          static_cast<uint32_t>(q));
+      stats.draws++;
+      q = end;
+    }
+    stats.pipeline_variants = static_cast<uint32_t>(pipelines_.Size());
+    stats.dirty_tiles = stats_.dirty_tiles;
+    stats_ = stats;
+
+    if (trace_.input_sequence != 0) {
+      RecordInputWatermark(commandBuffer, trace_.input_sequence);
     }
 
     vkCmdEndRenderPass(commandBuffer);
 
+    if (tileDiffEnabled_) {
+      graph_.RecordBarriers(diffPass_, commandBuffer);
+      tileDiff_.Record(commandBuffer);
+    }
+
     VK_CHECK_RESULT(vkEndCommandBuffer(commandBuffer));
 
+    // SubmitWork returns once the fence signaled
+    trace_.Mark(kFrameStageRenderSubmit);
     SubmitWork(commandBuffer, queue);
+    trace_.Mark(kFrameStageGpuComplete);
+  }
+
+  // Clears the watermark cells over the rendered scene,
+  // see input_watermark.h for the layout
+  void RecordInputWatermark(VkCommandBuffer commandBuffer,
+      uint32_t sequence) {
+    if (width < kInputWatermarkCells * kInputWatermarkCellSize ||
+        height < kInputWatermarkCellSize) {
+      return;
+    }
+    const uint32_t pattern = EncodeInputWatermark(sequence);
+    VkClearRect rects[2][kInputWatermarkCells];
+    uint32_t counts[2] = { 0, 0 };
+    for (int cell = 0; cell < kInputWatermarkCells; cell++) {
+      const uint32_t bit = (pattern >> (kInputWatermarkCells - 1 - cell)) & 1;
+      VkClearRect &rect = rects[bit][counts[bit]++];
+      rect.rect.offset = { cell * kInputWatermarkCellSize, 0 };
+      rect.rect.extent = { kInputWatermarkCellSize, kInputWatermarkCellSize };
+      rect.baseArrayLayer = 0;
+      rect.layerCount = 1;
+    }
+    for (uint32_t bit = 0; bit < 2; bit++) {
+      if (counts[bit] == 0) continue;
+      const float value = bit ? 1.0f : 0.0f;
+      VkClearAttachment attachment = {};
+      attachment.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+      attachment.colorAttachment = 0;
+      attachment.clearValue.color = { { value, value, value, 1.0f } };
+      vkCmdClearAttachments(commandBuffer, 1, &attachment,
+          counts[bit], rects[bit]);
+    }
   }
 
   void Capture(const RGLGraphicsCaptureHandle &handle) {
-    SubmitWork(copyCmd, queue);
-    handle(imagedata, width, height, 0);
+    const uint32_t columns = (width + kCaptureTileSize - 1) / kCaptureTileSize;
+    const uint32_t rows = (height + kCaptureTileSize - 1) / kCaptureTileSize;
+    // The bitmask of the last rendered frame is host visible
+    // since Render waits for its submission
+    if (tileDiffEnabled_ && !forceFullCapture_) {
+      const uint32_t *mask = tileDiff_.GetDirtyTiles();
+      std::copy(mask, mask + dirtyTiles_.size(), dirtyTiles_.begin());
+    } else {
+      std::fill(dirtyTiles_.begin(), dirtyTiles_.end(), 0xffffffffu);
+    }
+    forceFullCapture_ = false;
+
+    // One copy per horizontal run of dirty tiles
+    copyRegions_.clear();
+    uint32_t dirtyCount = 0;
+    for (uint32_t row = 0; row < rows; row++) {
+      uint32_t column = 0;
+      while (column < columns) {
+        uint32_t tile = row * columns + column;
+        if (((dirtyTiles_[tile / 32] >> (tile % 32)) & 1) == 0) {
+          column++;
+          continue;
+        }
+        uint32_t first = column;
+        while (column < columns) {
+          tile = row * columns + column;
+          if (((dirtyTiles_[tile / 32] >> (tile % 32)) & 1) == 0) break;
+          column++;
+        }
+        dirtyCount += column - first;
+        int32_t x = static_cast<int32_t>(first * kCaptureTileSize);
+        int32_t y = static_cast<int32_t>(row * kCaptureTileSize);
+        VkImageCopy region{};
+        region.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.srcSubresource.layerCount = 1;
+        region.srcOffset = { x, y, 0 };
+        region.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.dstSubresource.layerCount = 1;
+        region.dstOffset = { x, y, 0 };
+        region.extent.width = std::min<uint32_t>(
+            (column - first) * kCaptureTileSize, width - x);
+        region.extent.height = std::min<uint32_t>(
+            kCaptureTileSize, height - y);
+        region.extent.depth = 1;
+        copyRegions_.push_back(region);
+      }
+    }
+    stats_.dirty_tiles = dirtyCount;
+
+    if (!copyRegions_.empty()) {
+      VK_CHECK_RESULT(vkResetCommandBuffer(copyCmd, 0));
+      VkCommandBufferBeginInfo cmdBufInfo = CreateCommandBufferBeginInfo();
+      VK_CHECK_RESULT(vkBeginCommandBuffer(copyCmd, &cmdBufInfo));
+      graph_.RecordBarriers(readbackPass_, copyCmd);
+      vkCmdCopyImage(
+        copyCmd,
+        colorAttachment.image,
+        RenderGraph::GetLayout(kRenderGraphTransferSrc),
+        dstImage,
+        RenderGraph::GetLayout(kRenderGraphTransferDst),
+        static_cast<uint32_t>(copyRegions_.size()),
+        copyRegions_.data());
+      // Back to general layout for host access
+      graph_.RecordBarriers(hostPass_, copyCmd);
+      VK_CHECK_RESULT(vkEndCommandBuffer(copyCmd));
+      SubmitWork(copyCmd, queue);
+    }
+
+    RenderFrame frame = {};
+    frame.data = imagedata;
+    frame.width = width;
+    frame.height = height;
+    frame.stride = static_cast<int>(captureRowPitch_);
+    frame.tile_size = static_cast<int>(kCaptureTileSize);
+    frame.tile_columns = static_cast<int>(columns);
+    frame.tile_rows = static_cast<int>(rows);
+    frame.dirty_tiles = dirtyTiles_.data();
+    frame.trace = trace_;
+    frame.trace.Mark(kFrameStageReadback);
+    handle(frame);
   }
 
   ~GraphicsRendererImpl() {
@@ -828,17 +1060,22 @@ class GraphicsRendererImpl {
     vkFreeMemory(device, vertexMemory, nullptr);
     vkDestroyBuffer(device, indexBuffer, nullptr);
     vkFreeMemory(device, indexMemory, nullptr);
+    vkUnmapMemory(device, instanceMemory);
+    vkDestroyBuffer(device, instanceBuffer, nullptr);
+    vkFreeMemory(device, instanceMemory, nullptr);
     vkDestroyImageView(device, colorAttachment.view, nullptr);
     vkDestroyImage(device, colorAttachment.image, nullptr);
     vkFreeMemory(device, colorAttachment.memory, nullptr);
     vkDestroyImageView(device, depthAttachment.view, nullptr);
-    vkDestroyImage(device, depthAttachment.image, nullptr);
-    vkFreeMemory(device, depthAttachment.memory, nullptr);
+    graph_.Destroy();
+    tileDiff_.Destroy();
     vkDestroyRenderPass(device, renderPass, nullptr);
     vkDestroyFramebuffer(device, framebuffer, nullptr);
     vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
+    vkDestroyDescriptorPool(device, descriptorPool, nullptr);
     vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
-    vkDestroyPipeline(device, pipeline, nullptr);
+    textures_ = nullptr;
+    pipelines_.Destroy();
     vkDestroyPipelineCache(device, pipelineCache, nullptr);
     vkDestroyCommandPool(device, commandPool, nullptr);
     for (auto shadermodule : shaderModules) {
@@ -849,18 +1086,69 @@ class GraphicsRendererImpl {
   }
 };
 
-GraphicsRenderer::GraphicsRenderer() : impl_(new GraphicsRendererImpl()) {}
+GraphicsRenderer::GraphicsRenderer() : GraphicsRenderer(0) {}
+
+GraphicsRenderer::GraphicsRenderer(uint32_t device_index)
+    : impl_(new GraphicsRendererImpl(device_index)) {}
+
+std::vector<GraphicsDeviceInfo> GraphicsRenderer::QueryDevices() {
+  std::vector<GraphicsDeviceInfo> devices;
+  VkApplicationInfo appInfo = {};
+  appInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+  appInfo.pApplicationName = "Rigel";
+  appInfo.pEngineName = "RIGEL";
+  appInfo.apiVersion = VK_API_VERSION_1_0;
+  VkInstanceCreateInfo instanceCreateInfo = {};
+  instanceCreateInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+  instanceCreateInfo.pApplicationInfo = &appInfo;
+  VkInstance instance;
+  if (vkCreateInstance(&instanceCreateInfo, nullptr, &instance)
+      != VK_SUCCESS) {
+    return devices;
+  }
+  uint32_t deviceCount = 0;
+  vkEnumeratePhysicalDevices(instance, &deviceCount, nullptr);
+  std::vector<VkPhysicalDevice> physicalDevices(deviceCount);
+  vkEnumeratePhysicalDevices(instance, &deviceCount, physicalDevices.data());
+  for (VkPhysicalDevice physicalDevice : physicalDevices) {
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+    VkPhysicalDeviceMemoryProperties memoryProperties;
+    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+    GraphicsDeviceInfo info;
+    info.name = properties.deviceName;
+    info.memory_bytes = 0;
+    for (uint32_t i = 0; i < memoryProperties.memoryHeapCount; i++) {
+      const VkMemoryHeap &heap = memoryProperties.memoryHeaps[i];
+      if (heap.flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) {
+        info.memory_bytes += heap.size;
+      }
+    }
+    devices.push_back(std::move(info));
+  }
+  vkDestroyInstance(instance, nullptr);
+  return devices;
+}
 
 GraphicsRenderer::~GraphicsRenderer() {
   delete impl_;
 }
 
-void GraphicsRenderer::Render(float x, float y, float z) {
-  impl_->Render(x, y, z);
+void GraphicsRenderer::Render(const RGLGraphicsCameraHandle &camera,
+    const FrameTrace &trace) {
+  impl_->Render(camera, trace);
 }
 
 void GraphicsRenderer::Capture(const RGLGraphicsCaptureHandle &f) {
   impl_->Capture(f);
 }
 
+SceneStore *GraphicsRenderer::Scene() {
+  return &impl_->scene_;
+}
+
+RenderStats GraphicsRenderer::GetStats() const {
+  return impl_->stats_;
+}
+
 }  // namespace rigel
@@ -3,22 +3,63 @@
 #define RIGEL_GRAPHICS_RENDER_ENGINE_H_
 
 #include <functional>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "render.h"
 
 namespace rigel {
 
 class GraphicsRendererImpl;
+class SceneStore;
+
+typedef std::function<void(const RenderFrame &)> RGLGraphicsCaptureHandle;
 
-typedef std::function<void(const char *, int, int, int)>
-    RGLGraphicsCaptureHandle;
+// orbit camera angles and distance offset
+struct RenderCamera {
+  float phi;
+  float theta;
+  float gamma;
+};
+
+// Samples the camera right before the frame is submitted, and may note
+// the input it consumed in the trace
+typedef std::function<RenderCamera(FrameTrace *trace)>
+    RGLGraphicsCameraHandle;
+
+// state changes recorded by the last Render call
+struct RenderStats {
+  uint32_t draws;
+  uint32_t pipeline_binds;
+  uint32_t material_binds;
+  uint32_t pipeline_variants;
+  // tiles copied back by the last Capture call
+  uint32_t dirty_tiles;
+};
+
+struct GraphicsDeviceInfo {
+  std::string name;
+  // sum of the device local heaps
+  uint64_t memory_bytes;
+};
 
 class GraphicsRenderer {
  private:
   GraphicsRendererImpl *impl_;
  public:
   GraphicsRenderer();
+  // device_index is into QueryDevices, wrapped around the device count
+  explicit GraphicsRenderer(uint32_t device_index);
   ~GraphicsRenderer();
-  void Render(float x, float y, float z);
+  void Render(const RGLGraphicsCameraHandle &camera,
+      const FrameTrace &trace = FrameTrace());
   void Capture(const RGLGraphicsCaptureHandle &f);
+  SceneStore *Scene();
+  RenderStats GetStats() const;
+
+  // the physical devices in enumeration order
+  static std::vector<GraphicsDeviceInfo> QueryDevices();
 };
 
 }  // namespace rigel
@@ -0,0 +1,339 @@
+
+#include "render_graph.h"
+
+#include <algorithm>
+
+#include "logging.inc"
+
+namespace rigel {
+
+namespace {
+
+struct UsageInfo {
+  VkImageLayout layout;
+  VkPipelineStageFlags stages;
+  VkAccessFlags access;
+};
+
+const UsageInfo &GetUsageInfo(RenderGraphUsage usage) {
+  static const UsageInfo kUsages[] = {
+    // kRenderGraphColorAttachment
+    {
+      VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+      VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+      VK_ACCESS_COLOR_ATTACHMENT_READ_BIT |
+          VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT
+    },
+    // kRenderGraphDepthAttachment
+    {
+      VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+      VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT |
+          VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+      VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
+          VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT
+    },
+    // kRenderGraphTransferSrc
+    {
+      VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+      VK_PIPELINE_STAGE_TRANSFER_BIT,
+      VK_ACCESS_TRANSFER_READ_BIT
+    },
+    // kRenderGraphTransferDst
+    {
+      VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+      VK_PIPELINE_STAGE_TRANSFER_BIT,
+      VK_ACCESS_TRANSFER_WRITE_BIT
+    },
+    // kRenderGraphShaderRead
+    {
+      VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+      VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT |
+          VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+      VK_ACCESS_SHADER_READ_BIT
+    },
+    // kRenderGraphStorageRead
+    {
+      VK_IMAGE_LAYOUT_GENERAL,
+      VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+      VK_ACCESS_SHADER_READ_BIT
+    },
+    // kRenderGraphStorageWrite
+    {
+      VK_IMAGE_LAYOUT_GENERAL,
+      VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+      VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT
+    },
+    // kRenderGraphHostRead
+    {
+      VK_IMAGE_LAYOUT_GENERAL,
+      VK_PIPELINE_STAGE_HOST_BIT,
+      VK_ACCESS_HOST_READ_BIT
+    },
+  };
+  return kUsages[usage];
+}
+
+// returns false when no memory type matches
+bool FindMemoryType(VkPhysicalDevice physical_device, uint32_t type_bits,
+    VkMemoryPropertyFlags properties, uint32_t *index) {
+  VkPhysicalDeviceMemoryProperties memory_properties;
+  vkGetPhysicalDeviceMemoryProperties(physical_device, &memory_properties);
+  for (uint32_t i = 0; i < memory_properties.memoryTypeCount; i++) {
+    if ((type_bits & (1u << i)) != 0 &&
+        (memory_properties.memoryTypes[i].propertyFlags & properties) ==
+            properties) {
+      *index = i;
+      return true;
+    }
+  }
+  return false;
+}
+
+}  // unnamed namespace
+
+RenderGraph::RenderGraph()
+    : physical_device_(VK_NULL_HANDLE), device_(VK_NULL_HANDLE),
+      transient_bytes_(0), lazily_allocated_(false) {}
+
+RenderGraph::~RenderGraph() {
+  Destroy();
+}
+
+void RenderGraph::Initialize(VkPhysicalDevice physical_device,
+    VkDevice device) {
+  physical_device_ = physical_device;
+  device_ = device;
+}
+
+RenderGraph::Resource RenderGraph::ImportImage(VkImage image,
+    VkImageAspectFlags aspect) {
+  Image entry = {};
+  entry.image = image;
+  entry.aspect = aspect;
+  entry.transient = false;
+  entry.slot = -1;
+  entry.alias = -1;
+  images_.push_back(entry);
+  return static_cast<Resource>(images_.size() - 1);
+}
+
+RenderGraph::Resource RenderGraph::CreateTransientImage(
+    const VkImageCreateInfo &info, VkImageAspectFlags aspect) {
+  Image entry = {};
+  entry.image = VK_NULL_HANDLE;
+  entry.aspect = aspect;
+  entry.transient = true;
+  entry.info = info;
+  entry.slot = -1;
+  entry.alias = -1;
+  images_.push_back(entry);
+  return static_cast<Resource>(images_.size() - 1);
+}
+
+RenderGraph::Pass RenderGraph::AddPass(const char *name) {
+  PassBarriers pass = {};
+  pass.name = name;
+  passes_.push_back(pass);
+  return static_cast<Pass>(passes_.size() - 1);
+}
+
+void RenderGraph::Read(Pass pass, Resource resource,
+    RenderGraphUsage usage) {
+  accesses_.push_back(Access { pass, resource, usage, false, false });
+}
+
+void RenderGraph::Write(Pass pass, Resource resource,
+    RenderGraphUsage usage, bool discard) {
+  accesses_.push_back(Access { pass, resource, usage, true, discard });
+}
+
+VkImage RenderGraph::GetImage(Resource resource) const {
+  return images_[resource].image;
+}
+
+VkImageLayout RenderGraph::GetLayout(RenderGraphUsage usage) {
+  return GetUsageInfo(usage).layout;
+}
+
+bool RenderGraph::AllocateTransients() {
+  struct Slot {
+    VkMemoryRequirements requirements;
+    bool lazy;
+    Pass last_pass;
+    int32_t first;
+    int32_t last;
+  };
+  std::vector<Slot> slots;
+  for (size_t i = 0; i < images_.size(); i++) {
+    Image &image = images_[i];
+    if (!image.transient) continue;
+    Pass first_pass = 0xffffffffu;
+    Pass last_pass = 0;
+    for (const auto &access : accesses_) {
+      if (access.resource != i) continue;
+      first_pass = std::min(first_pass, access.pass);
+      last_pass = std::max(last_pass, access.pass);
+    }
+    if (first_pass == 0xffffffffu) continue;
+    if (vkCreateImage(device_, &image.info, nullptr, &image.image) !=
+        VK_SUCCESS) {
+      return false;
+    }
+    VkMemoryRequirements requirements;
+    vkGetImageMemoryRequirements(device_, image.image, &requirements);
+    bool lazy =
+        (image.info.usage & VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT) != 0;
+    // reuse memory whose previous owner is no longer used this frame
+    int32_t slot = -1;
+    for (size_t s = 0; s < slots.size(); s++) {
+      if (slots[s].last_pass < first_pass &&
+          (slots[s].requirements.memoryTypeBits &
+              requirements.memoryTypeBits) != 0) {
+        slot = static_cast<int32_t>(s);
+        break;
+      }
+    }
+    if (slot < 0) {
+      Slot entry = { requirements, lazy, last_pass,
+          static_cast<int32_t>(i), static_cast<int32_t>(i) };
+      slots.push_back(entry);
+      slot = static_cast<int32_t>(slots.size() - 1);
+    } else {
+      Slot &entry = slots[slot];
+      entry.requirements.size =
+          std::max(entry.requirements.size, requirements.size);
+      entry.requirements.alignment =
+          std::max(entry.requirements.alignment, requirements.alignment);
+      entry.requirements.memoryTypeBits &= requirements.memoryTypeBits;
+      entry.lazy = entry.lazy && lazy;
+      entry.last_pass = last_pass;
+      image.alias = entry.last;
+      entry.last = static_cast<int32_t>(i);
+    }
+    image.slot = slot;
+  }
+  for (auto &slot : slots) {
+    // the first owner follows the last one of the previous frame
+    images_[slot.first].alias = slot.last;
+    uint32_t type_index = 0;
+    bool lazy = slot.lazy && FindMemoryType(physical_device_,
+        slot.requirements.memoryTypeBits,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT |
+        VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT, &type_index);
+    if (!lazy && !FindMemoryType(physical_device_,
+        slot.requirements.memoryTypeBits,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &type_index)) {
+      return false;
+    }
+    VkMemoryAllocateInfo allocate_info = {};
+    allocate_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocate_info.allocationSize = slot.requirements.size;
+    allocate_info.memoryTypeIndex = type_index;
+    VkDeviceMemory memory;
+    if (vkAllocateMemory(device_, &allocate_info, nullptr, &memory) !=
+        VK_SUCCESS) {
+      return false;
+    }
+    memories_.push_back(memory);
+    if (lazy) {
+      lazily_allocated_ = true;
+    } else {
+      transient_bytes_ += slot.requirements.size;
+    }
+  }
+  for (auto &image : images_) {
+    if (image.slot < 0) continue;
+    vkBindImageMemory(device_, image.image, memories_[image.slot], 0);
+  }
+  return true;
+}
+
+const RenderGraph::Access *RenderGraph::FindPrevious(size_t index) const {
+  const Access &current = accesses_[index];
+  for (size_t i = index; i-- > 0;) {
+    if (accesses_[i].resource == current.resource) return &accesses_[i];
+  }
+  // first access of the frame follows the last access of the previous
+  // frame, or of the image sharing the memory for transient images
+  const Image &image = images_[current.resource];
+  Resource resource = image.alias >= 0 ?
+      static_cast<Resource>(image.alias) : current.resource;
+  for (size_t i = accesses_.size(); i-- > 0;) {
+    if (accesses_[i].resource == resource) return &accesses_[i];
+  }
+  return nullptr;
+}
+
+bool RenderGraph::Compile() {
+  std::stable_sort(accesses_.begin(), accesses_.end(),
+      [](const Access &a, const Access &b) { return a.pass < b.pass; });
+  if (!AllocateTransients()) {
+    RGL_WARN("could not allocate transient attachments");
+    return false;
+  }
+  for (size_t i = 0; i < accesses_.size(); i++) {
+    const Access &current = accesses_[i];
+    const Access *previous = FindPrevious(i);
+    if (previous == nullptr) continue;
+    const UsageInfo &prev = GetUsageInfo(previous->usage);
+    const UsageInfo &next = GetUsageInfo(current.usage);
+    VkImageLayout old_layout =
+        current.discard ? VK_IMAGE_LAYOUT_UNDEFINED : prev.layout;
+    bool transition = old_layout != next.layout;
+    // reads after reads in the same layout need no barrier
+    if (!previous->write && !current.write && !transition) continue;
+    const Image &image = images_[current.resource];
+    VkImageMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    // write after read only needs an execution dependency
+    barrier.srcAccessMask = previous->write ? prev.access : 0;
+    barrier.dstAccessMask =
+        previous->write || transition ? next.access : 0;
+    barrier.oldLayout = old_layout;
+    barrier.newLayout = next.layout;
+    barrier.image = image.image;
+    barrier.subresourceRange.aspectMask = image.aspect;
+    barrier.subresourceRange.baseMipLevel = 0;
+    barrier.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
+    barrier.subresourceRange.baseArrayLayer = 0;
+    barrier.subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
+    PassBarriers &pass = passes_[current.pass];
+    pass.src_stages |= prev.stages;
+    pass.dst_stages |= next.stages;
+    pass.barriers.push_back(barrier);
+  }
+  return true;
+}
+
+void RenderGraph::RecordBarriers(Pass pass,
+    VkCommandBuffer command_buffer) const {
+  const PassBarriers &barriers = passes_[pass];
+  if (barriers.barriers.empty()) return;
+  vkCmdPipelineBarrier(command_buffer,
+      barriers.src_stages, barriers.dst_stages, 0,
+      0, nullptr, 0, nullptr,
+      static_cast<uint32_t>(barriers.barriers.size()),
+      barriers.barriers.data());
+}
+
+void RenderGraph::Destroy() {
+  if (device_ == VK_NULL_HANDLE) return;
+  for (auto &image : images_) {
+    if (image.transient && image.image != VK_NULL_HANDLE) {
+      vkDestroyImage(device_, image.image, nullptr);
+    }
+  }
+  for (auto memory : memories_) {
+    vkFreeMemory(device_, memory, nullptr);
+  }
+  images_.clear();
+  accesses_.clear();
+  passes_.clear();
+  memories_.clear();
+  transient_bytes_ = 0;
+  device_ = VK_NULL_HANDLE;
+}
+
+}  // namespace rigel
@@ -0,0 +1,104 @@
+
+#ifndef RIGEL_GRAPHICS_RENDER_GRAPH_H_
+#define RIGEL_GRAPHICS_RENDER_GRAPH_H_
+
+#include <vector>
+#include <cstdint>
+
+#include <vulkan/vulkan.h>
+
+namespace rigel {
+
+// How a pass touches an image. Each usage implies the layout,
+// pipeline stage and access mask of the access.
+enum RenderGraphUsage : uint8_t {
+  kRenderGraphColorAttachment = 0,
+  kRenderGraphDepthAttachment,
+  kRenderGraphTransferSrc,
+  kRenderGraphTransferDst,
+  kRenderGraphShaderRead,
+  kRenderGraphStorageRead,
+  kRenderGraphStorageWrite,
+  kRenderGraphHostRead,
+};
+
+// Static description of the passes of a frame and the images they read
+// and write. Compile derives the minimal set of image barriers between
+// passes, treating the frame as a loop so that the first access of a
+// frame synchronizes with the last access of the previous one.
+// Transient images are owned by the graph, and those whose lifetimes
+// do not overlap within a frame share memory, which is lazily
+// allocated where the device supports it.
+class RenderGraph {
+ public:
+  typedef uint32_t Resource;
+  typedef uint32_t Pass;
+
+  RenderGraph();
+  explicit RenderGraph(const RenderGraph &) = delete;
+  ~RenderGraph();
+
+  void Initialize(VkPhysicalDevice physical_device, VkDevice device);
+
+  Resource ImportImage(VkImage image, VkImageAspectFlags aspect);
+  // the image is created by Compile, its first access must discard
+  Resource CreateTransientImage(const VkImageCreateInfo &info,
+      VkImageAspectFlags aspect);
+
+  Pass AddPass(const char *name);
+  void Read(Pass pass, Resource resource, RenderGraphUsage usage);
+  // discard allows the previous contents to be thrown away
+  void Write(Pass pass, Resource resource, RenderGraphUsage usage,
+      bool discard);
+
+  bool Compile();
+  // records the barriers required before the pass
+  void RecordBarriers(Pass pass, VkCommandBuffer command_buffer) const;
+  void Destroy();
+
+  VkImage GetImage(Resource resource) const;
+  static VkImageLayout GetLayout(RenderGraphUsage usage);
+  VkDeviceSize GetTransientBytes() const { return transient_bytes_; }
+  bool IsLazilyAllocated() const { return lazily_allocated_; }
+
+ private:
+  struct Access {
+    Pass pass;
+    Resource resource;
+    RenderGraphUsage usage;
+    bool write;
+    bool discard;
+  };
+  struct Image {
+    VkImage image;
+    VkImageAspectFlags aspect;
+    bool transient;
+    VkImageCreateInfo info;
+    // memory shared with other transient images
+    int32_t slot;
+    // previous owner of the memory within a frame, or -1
+    int32_t alias;
+  };
+  struct PassBarriers {
+    const char *name;
+    VkPipelineStageFlags src_stages;
+    VkPipelineStageFlags dst_stages;
+    std::vector<VkImageMemoryBarrier> barriers;
+  };
+
+  bool AllocateTransients();
+  const Access *FindPrevious(size_t index) const;
+
+  VkPhysicalDevice physical_device_;
+  VkDevice device_;
+  std::vector<Image> images_;
+  std::vector<Access> accesses_;
+  std::vector<PassBarriers> passes_;
+  std::vector<VkDeviceMemory> memories_;
+  VkDeviceSize transient_bytes_;
+  bool lazily_allocated_;
+};
+
+}  // namespace rigel
+
+#endif  // RIGEL_GRAPHICS_RENDER_GRAPH_H_
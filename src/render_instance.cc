@@ -1,88 +1,245 @@
 
 #include "render_instance.h"
-#include <boost/lockfree/queue.hpp>
+#include "render_scene.h"
+#include "spsc_ring.h"
+#include "logging.inc"
+
+#include <atomic>
+#include <string>
 
 namespace rigel {
 
+namespace {
+
+// input after this long without any renders right away
+constexpr int64_t kInputIdleMicros = 100000;
+// sequenced events buffered between two ticks
+constexpr size_t kInputRingCapacity = 256;
+// ticks between two checks for input overflows
+constexpr uint64_t kInputReportInterval = 300;
+
+}  // unnamed namespace
+
 struct RenderInstanceMessage {
   int x, y, z;
+  uint32_t sequence;
+  int64_t time_us;
 };
 
+// Input is posted by the single thread receiving data channel messages
+// and consumed by the timer thread.
+// Relative motion without a sequence number is only summed into atomic
+// accumulators, so bursts from high rate devices cost a few atomic adds
+// and are drained at once. Sequenced events go through the ring to keep
+// their arrival time; when it is full their motion is summed as well
+// and the sequence is counted as an overflow.
 class RenderInstancePrivate {
  public:
-  RenderInstancePrivate() : message_queue_(128), x_(0), y_(0), z_(0),
-      is_initial_state_(true) {}
+  RenderInstancePrivate() : pending_x_(0), pending_y_(0), pending_z_(0),
+      pending_(false), queued_(0), coalesced_(0), overflows_(0),
+      x_(0), y_(0), z_(0), is_initial_state_(true), frame_id_(0),
+      input_sequence_(0), input_time_us_(0), reported_overflows_(0),
+      last_post_us_(0) {}
 
   void Update() {
     RenderInstanceMessage message;
-    while (message_queue_.pop(message)) {
+    while (ring_.Pop(&message)) {
       x_ += message.x;
       y_ += message.y;
       z_ += message.z;
       is_initial_state_ = false;
+      // unordered delivery may hand in older sequences late
+      if (input_sequence_ == 0 ||
+          static_cast<int32_t>(message.sequence - input_sequence_) > 0) {
+        input_sequence_ = message.sequence;
+        input_time_us_ = message.time_us;
+      }
+    }
+    if (pending_.exchange(false, std::memory_order_acquire)) {
+      x_ += pending_x_.exchange(0, std::memory_order_relaxed);
+      y_ += pending_y_.exchange(0, std::memory_order_relaxed);
+      z_ += pending_z_.exchange(0, std::memory_order_relaxed);
+      is_initial_state_ = false;
     }
   }
 
-  void Post(const RenderInstanceMessage &message) {
-    message_queue_.push(message);
+  // returns true when the message ends an idle period
+  bool Post(const RenderInstanceMessage &message) {
+    if (message.sequence != 0 && ring_.Push(message)) {
+      queued_.fetch_add(1, std::memory_order_relaxed);
+    } else {
+      if (message.sequence != 0) {
+        overflows_.fetch_add(1, std::memory_order_relaxed);
+      } else {
+        coalesced_.fetch_add(1, std::memory_order_relaxed);
+      }
+      pending_x_.fetch_add(message.x, std::memory_order_relaxed);
+      pending_y_.fetch_add(message.y, std::memory_order_relaxed);
+      pending_z_.fetch_add(message.z, std::memory_order_relaxed);
+      pending_.store(true, std::memory_order_release);
+    }
+    bool idle = message.time_us - last_post_us_ > kInputIdleMicros;
+    last_post_us_ = message.time_us;
+    return idle;
+  }
+
+  RenderInputStats GetInputStats() const {
+    RenderInputStats stats;
+    stats.queued = queued_.load(std::memory_order_relaxed);
+    stats.coalesced = coalesced_.load(std::memory_order_relaxed);
+    stats.overflows = overflows_.load(std::memory_order_relaxed);
+    return stats;
+  }
+
+  // overflows since the last call, on the timer thread
+  uint64_t TakeNewOverflows() {
+    const uint64_t overflows = overflows_.load(std::memory_order_relaxed);
+    const uint64_t taken = overflows - reported_overflows_;
+    reported_overflows_ = overflows;
+    return taken;
   }
 
   int GetX() const { return x_; }
   int GetY() const { return y_; }
   int GetZ() const { return z_; }
   bool IsInitialState() const { return is_initial_state_; }
+  uint64_t NextFrameId() { return ++frame_id_; }
+  // latest consumed input carrying a sequence number
+  uint32_t GetInputSequence() const { return input_sequence_; }
+  int64_t GetInputTime() const { return input_time_us_; }
 
  private:
-  boost::lockfree::queue<RenderInstanceMessage> message_queue_;
+  SpscRing<RenderInstanceMessage, kInputRingCapacity> ring_;
+  std::atomic<int> pending_x_;
+  std::atomic<int> pending_y_;
+  std::atomic<int> pending_z_;
+  std::atomic<bool> pending_;
+  std::atomic<uint64_t> queued_;
+  std::atomic<uint64_t> coalesced_;
+  std::atomic<uint64_t> overflows_;
   // internal state
   int x_;
   int y_;
   int z_;
   bool is_initial_state_;
+  uint64_t frame_id_;
+  uint32_t input_sequence_;
+  int64_t input_time_us_;
+  uint64_t reported_overflows_;
+  // only accessed by the posting thread
+  int64_t last_post_us_;
 };
 
-RenderInstance::RenderInstance(RenderInstanceSink *sink)
-    : sink_(sink), private_(new RenderInstancePrivate()) {}
+RenderInstance::RenderInstance(RenderInstanceSink *sink,
+    GraphicsRendererPool *pool)
+    : sink_(sink), pool_(pool), private_(new RenderInstancePrivate()) {
+  pthread_mutex_init(&timer_mutex_, nullptr);
+}
 
 RenderInstance::~RenderInstance() {
+  StopRendering();
+  pthread_mutex_destroy(&timer_mutex_);
   delete private_;
   private_ = nullptr;
 }
 
 void RenderInstance::StartRendering() {
-  renderer_ = std::unique_ptr<GraphicsRenderer>(new GraphicsRenderer());
+  renderer_ = pool_->Claim();
+  // single model placed at the origin
+  renderer_->Scene()->CreateNode();
   auto *timer = new IntervalTimer(1.0 / 30, [=](double time_sec) {
     this->OnTick(time_sec);
   });
+  pthread_mutex_lock(&timer_mutex_);
   timer_ = std::unique_ptr<IntervalTimer>(timer);
-  renderer_->Render(0, 0, 0);
+  pthread_mutex_unlock(&timer_mutex_);
 }
 
 void RenderInstance::StopRendering() {
-  timer_ = nullptr;
+  std::unique_ptr<IntervalTimer> timer;
+  pthread_mutex_lock(&timer_mutex_);
+  timer.swap(timer_);
+  pthread_mutex_unlock(&timer_mutex_);
+  // joins the timer thread, without holding up triggers meanwhile
+  timer = nullptr;
 }
 
 void RenderInstance::OnTick(double time_sec) {
-  renderer_->Capture([=](const char *v, int w, int h, int r) {
-    this->sink_->OnRenderFrame(v, w, h, r);
+  FrameTrace trace = {};
+  trace.id = private_->NextFrameId();
+  trace.capture_time_us = FrameTraceNowMicros();
+  // Input is sampled by the renderer right before submission,
+  // and the frame is read back within the same tick
+  renderer_->Render([=](FrameTrace *sampled) {
+    return this->SampleCamera(time_sec, sampled);
+  }, trace);
+  renderer_->Capture([=](const RenderFrame &frame) {
+    this->sink_->OnRenderFrame(frame);
   });
+  // load of the device, weighed by admission control
+  pool_->RecordFrameTime(FrameTraceNowMicros() - trace.capture_time_us);
+  if (trace.id % kInputReportInterval == 0) {
+    const uint64_t overflows = private_->TakeNewOverflows();
+    if (overflows > 0) {
+      const RenderInputStats stats = private_->GetInputStats();
+      RGL_WARN("input ring overflowed " + std::to_string(overflows) +
+          " times, queued " + std::to_string(stats.queued) +
+          " coalesced " + std::to_string(stats.coalesced) +
+          " overflows " + std::to_string(stats.overflows));
+    }
+  }
+}
+
+RenderCamera RenderInstance::SampleCamera(double time_sec, FrameTrace *trace) {
   private_->Update();
+  // drawn as a watermark by the renderer
+  trace->input_sequence = private_->GetInputSequence();
+  trace->input_time_us = private_->GetInputTime();
   if (private_->IsInitialState()) {
-    renderer_->Render(time_sec, time_sec * 0.3, 0);
-  } else {
-    renderer_->Render(
-      static_cast<float>(private_->GetX()) * 0.01,
-      static_cast<float>(private_->GetY()) * 0.01,
-      static_cast<float>(private_->GetZ()) * 0.01);
+    return RenderCamera {
+      static_cast<float>(time_sec), static_cast<float>(time_sec * 0.3), 0 };
   }
+  return RenderCamera {
+    static_cast<float>(private_->GetX()) * 0.01f,
+    static_cast<float>(private_->GetY()) * 0.01f,
+    static_cast<float>(private_->GetZ()) * 0.01f };
+}
+
+RenderInputStats RenderInstance::GetInputStats() const {
+  return private_->GetInputStats();
 }
 
-void RenderInstance::InputXYAxis(int x, int y) {
-  private_->Post(RenderInstanceMessage { x, y, 0 });
+void RenderInstance::InputXYAxis(int x, int y, uint32_t sequence) {
+  Trigger(private_->Post(RenderInstanceMessage {
+    x, y, 0, sequence, FrameTraceNowMicros() }));
 }
 
-void RenderInstance::InputZAxis(int z) {
-  private_->Post(RenderInstanceMessage { 0, 0, z });
+void RenderInstance::InputZAxis(int z, uint32_t sequence) {
+  Trigger(private_->Post(RenderInstanceMessage {
+    0, 0, z, sequence, FrameTraceNowMicros() }));
+}
+
+void RenderInstance::InputEvents(const RenderInputEvent *events,
+    size_t count) {
+  bool idle = false;
+  for (size_t i = 0; i < count; i++) {
+    const RenderInputEvent &event = events[i];
+    idle |= private_->Post(RenderInstanceMessage {
+      event.x, event.y, event.z, event.sequence, event.time_us });
+  }
+  Trigger(idle);
+}
+
+void RenderInstance::Trigger(bool idle) {
+  // The first input after an idle period is rendered by an early tick
+  // instead of waiting for the cadence, continuous input keeps the
+  // regular frame rate
+  if (!idle) return;
+  pthread_mutex_lock(&timer_mutex_);
+  if (timer_ != nullptr) {
+    timer_->Trigger();
+  }
+  pthread_mutex_unlock(&timer_mutex_);
 }
 
 }  // namespace rigel
@@ -7,26 +7,49 @@
 #include "render.h"
 #include "render_timer.h"
 #include "render_engine.h"
+#include "renderer_pool.h"
+
+extern "C" {
+#include <pthread.h>
+}
 
 namespace rigel {
 
 class RenderInstancePrivate;
 
+struct RenderInputStats {
+  // sequenced events passed through the ring
+  uint64_t queued;
+  // motion events summed into the accumulators
+  uint64_t coalesced;
+  // sequenced events that found the ring full, their motion is kept
+  uint64_t overflows;
+};
+
 class RenderInstance : public RenderInstanceInterface {
  public:
-  explicit RenderInstance(RenderInstanceSink *sink);
+  // the renderer is claimed from pool when rendering starts
+  RenderInstance(RenderInstanceSink *sink, GraphicsRendererPool *pool);
   ~RenderInstance();
 
   void StartRendering() override;
   void StopRendering() override;
-  void InputXYAxis(int x, int y) override;
-  void InputZAxis(int z) override;
+  void InputXYAxis(int x, int y, uint32_t sequence) override;
+  void InputZAxis(int z, uint32_t sequence) override;
+  void InputEvents(const RenderInputEvent *events, size_t count) override;
+
+  RenderInputStats GetInputStats() const;
  private:
   RenderInstanceSink *sink_;
+  GraphicsRendererPool *pool_;
+  // set and reset by start and stop, triggered by the input thread
+  pthread_mutex_t timer_mutex_;
   std::unique_ptr<IntervalTimer> timer_;
   std::unique_ptr<GraphicsRenderer> renderer_;
   RenderInstancePrivate *private_;
   void OnTick(double time_sec);
+  RenderCamera SampleCamera(double time_sec, FrameTrace *trace);
+  void Trigger(bool idle);
 };
 
 
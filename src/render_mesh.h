@@ -0,0 +1,30 @@
+
+#ifndef RIGEL_GRAPHICS_RENDER_MESH_H_
+#define RIGEL_GRAPHICS_RENDER_MESH_H_
+
+#include <cstdint>
+
+namespace rigel {
+
+struct Vertex {
+  float position[3];
+  float color[3];
+  float uv[2];
+};
+
+// per-instance data, read by the vertex shaders at instance rate
+struct Instance {
+  // column-major world matrix of the scene node
+  float world[16];
+};
+
+// contiguous index range sharing a single material
+struct Mesh {
+  uint32_t first_index;
+  uint32_t index_count;
+  uint32_t material;
+};
+
+}  // namespace rigel
+
+#endif  // RIGEL_GRAPHICS_RENDER_MESH_H_
@@ -0,0 +1,210 @@
+
+#include "render_pipeline.h"
+#include "render_mesh.h"
+#include "render_helper.inc"
+
+#include <array>
+#include <cstring>
+#include <cstddef>
+
+#define VK_CHECK_RESULT(f) (f)
+
+namespace rigel {
+
+PipelineState PipelineState::Opaque() {
+  PipelineState state;
+  memset(&state, 0, sizeof(state));
+  state.shader = kPipelineShaderColor;
+  state.cull_mode = VK_CULL_MODE_BACK_BIT;
+  state.blend_enable = VK_FALSE;
+  state.depth_write = VK_TRUE;
+  return state;
+}
+
+PipelineState PipelineState::Translucent() {
+  PipelineState state = Opaque();
+  state.blend_enable = VK_TRUE;
+  state.depth_write = VK_FALSE;
+  return state;
+}
+
+bool PipelineState::operator==(const PipelineState &other) const {
+  return memcmp(this, &other, sizeof(PipelineState)) == 0;
+}
+
+uint64_t HashPipelineState(const PipelineState &state) {
+  // FNV-1a over the raw state bytes
+  const uint8_t *bytes = reinterpret_cast<const uint8_t *>(&state);
+  uint64_t hash = 14695981039346656037ull;
+  for (size_t i = 0; i < sizeof(PipelineState); i++) {
+    hash ^= bytes[i];
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+PipelineStateCache::PipelineStateCache()
+    : device_(VK_NULL_HANDLE), cache_(VK_NULL_HANDLE),
+      layout_(VK_NULL_HANDLE), render_pass_(VK_NULL_HANDLE) {
+  for (int i = 0; i < kPipelineShaderCount; i++) {
+    vertex_modules_[i] = VK_NULL_HANDLE;
+    fragment_modules_[i] = VK_NULL_HANDLE;
+  }
+}
+
+PipelineStateCache::~PipelineStateCache() {
+  Destroy();
+}
+
+void PipelineStateCache::Initialize(VkDevice device, VkPipelineCache cache,
+    VkPipelineLayout layout, VkRenderPass render_pass) {
+  device_ = device;
+  cache_ = cache;
+  layout_ = layout;
+  render_pass_ = render_pass;
+}
+
+void PipelineStateCache::SetShaderStages(PipelineShader shader,
+    VkShaderModule vertex, VkShaderModule fragment) {
+  vertex_modules_[shader] = vertex;
+  fragment_modules_[shader] = fragment;
+}
+
+void PipelineStateCache::Destroy() {
+  for (auto pipeline : pipelines_) {
+    vkDestroyPipeline(device_, pipeline, nullptr);
+  }
+  pipelines_.clear();
+  states_.clear();
+  index_.clear();
+}
+
+uint32_t PipelineStateCache::Acquire(const PipelineState &state) {
+  const uint64_t hash = HashPipelineState(state);
+  auto range = index_.equal_range(hash);
+  for (auto it = range.first; it != range.second; ++it) {
+    if (states_[it->second] == state) return it->second;
+  }
+  uint32_t id = static_cast<uint32_t>(pipelines_.size());
+  pipelines_.push_back(Create(state));
+  states_.push_back(state);
+  index_.insert(std::make_pair(hash, id));
+  return id;
+}
+
+VkPipeline PipelineStateCache::Create(const PipelineState &state) {
+  VkPipelineInputAssemblyStateCreateInfo inputAssemblyState =
+      CreatePipelineInputAssemblyStateCreateInfo(
+          VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, 0, VK_FALSE);
+
+  VkPipelineRasterizationStateCreateInfo rasterizationState =
+      CreatePipelineRasterizationStateCreateInfo(
+          VK_POLYGON_MODE_FILL, state.cull_mode,
+          VK_FRONT_FACE_COUNTER_CLOCKWISE);
+
+  VkPipelineColorBlendAttachmentState blendAttachmentState =
+      CreatePipelineColorBlendAttachmentState(0xf, state.blend_enable);
+  if (state.blend_enable) {
+    blendAttachmentState.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+    blendAttachmentState.dstColorBlendFactor =
+        VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+    blendAttachmentState.colorBlendOp = VK_BLEND_OP_ADD;
+    blendAttachmentState.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+    blendAttachmentState.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+    blendAttachmentState.alphaBlendOp = VK_BLEND_OP_ADD;
+  }
+
+  VkPipelineColorBlendStateCreateInfo colorBlendState =
+      CreatePipelineColorBlendStateCreateInfo(1, &blendAttachmentState);
+
+  VkPipelineDepthStencilStateCreateInfo depthStencilState =
+      CreatePipelineDepthStencilStateCreateInfo(VK_TRUE, state.depth_write,
+          VK_COMPARE_OP_LESS_OR_EQUAL);
+
+  VkPipelineViewportStateCreateInfo viewportState =
+      CreatePipelineViewportStateCreateInfo(1, 1);
+
+  VkPipelineMultisampleStateCreateInfo multisampleState =
+      CreatePipelineMultisampleStateCreateInfo(VK_SAMPLE_COUNT_1_BIT);
+
+  std::vector<VkDynamicState> dynamicStateEnables = {
+    VK_DYNAMIC_STATE_VIEWPORT,
+    VK_DYNAMIC_STATE_SCISSOR
+  };
+  VkPipelineDynamicStateCreateInfo dynamicState =
+    CreatePipelineDynamicStateCreateInfo(dynamicStateEnables);
+
+  VkGraphicsPipelineCreateInfo pipelineCreateInfo =
+    CreatePipelineCreateInfo(layout_, render_pass_);
+
+  std::array<VkPipelineShaderStageCreateInfo, 2> shaderStages{};
+
+  pipelineCreateInfo.pInputAssemblyState = &inputAssemblyState;
+  pipelineCreateInfo.pRasterizationState = &rasterizationState;
+  pipelineCreateInfo.pColorBlendState = &colorBlendState;
+  pipelineCreateInfo.pMultisampleState = &multisampleState;
+  pipelineCreateInfo.pViewportState = &viewportState;
+  pipelineCreateInfo.pDepthStencilState = &depthStencilState;
+  pipelineCreateInfo.pDynamicState = &dynamicState;
+  pipelineCreateInfo.stageCount =
+      static_cast<uint32_t>(shaderStages.size());
+  pipelineCreateInfo.pStages = shaderStages.data();
+
+  // Vertex bindings an attributes
+  // Binding description
+  std::vector<VkVertexInputBindingDescription> vertexInputBindings = {
+    CreateVertexInputBindingDescription(0,
+        sizeof(Vertex), VK_VERTEX_INPUT_RATE_VERTEX),
+    CreateVertexInputBindingDescription(1,
+        sizeof(Instance), VK_VERTEX_INPUT_RATE_INSTANCE),
+  };
+
+  // Attribute descriptions
+  std::vector<VkVertexInputAttributeDescription> vertexInputAttributes = {
+    // position
+    CreateVertexInputAttributeDescription(0, 0,
+        VK_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, position)),
+    // color
+    CreateVertexInputAttributeDescription(0, 1,
+        VK_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, color)),
+    // texture coordinate
+    CreateVertexInputAttributeDescription(0, 2,
+        VK_FORMAT_R32G32_SFLOAT, offsetof(Vertex, uv)),
+  };
+  // world matrix, one column per location
+  for (uint32_t column = 0; column < 4; column++) {
+    vertexInputAttributes.push_back(CreateVertexInputAttributeDescription(
+        1, 3 + column, VK_FORMAT_R32G32B32A32_SFLOAT,
+        offsetof(Instance, world) + column * 4 * sizeof(float)));
+  }
+
+  VkPipelineVertexInputStateCreateInfo vertexInputState =
+      CreatePipelineVertexInputStateCreateInfo();
+  vertexInputState.vertexBindingDescriptionCount =
+      static_cast<uint32_t>(vertexInputBindings.size());
+  vertexInputState.pVertexBindingDescriptions = vertexInputBindings.data();
+  vertexInputState.vertexAttributeDescriptionCount =
+      static_cast<uint32_t>(vertexInputAttributes.size());
+  vertexInputState.pVertexAttributeDescriptions =
+      vertexInputAttributes.data();
+
+  pipelineCreateInfo.pVertexInputState = &vertexInputState;
+
+  shaderStages[0].sType =
+      VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+  shaderStages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+  shaderStages[0].pName = "main";
+  shaderStages[0].module = vertex_modules_[state.shader];
+  shaderStages[1].sType =
+      VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+  shaderStages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+  shaderStages[1].pName = "main";
+  shaderStages[1].module = fragment_modules_[state.shader];
+
+  VkPipeline pipeline;
+  VK_CHECK_RESULT(vkCreateGraphicsPipelines(device_,
+      cache_, 1, &pipelineCreateInfo, nullptr, &pipeline));
+  return pipeline;
+}
+
+}  // namespace rigel
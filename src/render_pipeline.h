@@ -0,0 +1,72 @@
+
+#ifndef RIGEL_GRAPHICS_RENDER_PIPELINE_H_
+#define RIGEL_GRAPHICS_RENDER_PIPELINE_H_
+
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+
+#include <vulkan/vulkan.h>
+
+namespace rigel {
+
+enum PipelineShader : uint8_t {
+  kPipelineShaderColor = 0,
+  kPipelineShaderTextured,
+  kPipelineShaderCount
+};
+
+// Fixed function state distinguishing pipeline variants.
+// Kept as plain bytes so that it can be hashed and compared directly.
+struct PipelineState {
+  uint8_t shader;
+  uint8_t cull_mode;
+  uint8_t blend_enable;
+  uint8_t depth_write;
+
+  static PipelineState Opaque();
+  static PipelineState Translucent();
+
+  bool operator==(const PipelineState &other) const;
+};
+
+uint64_t HashPipelineState(const PipelineState &state);
+
+// Creates pipeline variants lazily from the shared VkPipelineCache and
+// hands out small sequential identifiers suitable for sort keys.
+class PipelineStateCache {
+ public:
+  PipelineStateCache();
+  explicit PipelineStateCache(const PipelineStateCache &) = delete;
+  ~PipelineStateCache();
+
+  void Initialize(VkDevice device, VkPipelineCache cache,
+      VkPipelineLayout layout, VkRenderPass render_pass);
+  void SetShaderStages(PipelineShader shader,
+      VkShaderModule vertex, VkShaderModule fragment);
+  void Destroy();
+
+  // returns the identifier of the pipeline for the given state,
+  // creating it on first use
+  uint32_t Acquire(const PipelineState &state);
+  VkPipeline Get(uint32_t id) const { return pipelines_[id]; }
+  const PipelineState &GetState(uint32_t id) const { return states_[id]; }
+  size_t Size() const { return pipelines_.size(); }
+
+ private:
+  VkPipeline Create(const PipelineState &state);
+
+  VkDevice device_;
+  VkPipelineCache cache_;
+  VkPipelineLayout layout_;
+  VkRenderPass render_pass_;
+  VkShaderModule vertex_modules_[kPipelineShaderCount];
+  VkShaderModule fragment_modules_[kPipelineShaderCount];
+  std::unordered_multimap<uint64_t, uint32_t> index_;
+  std::vector<PipelineState> states_;
+  std::vector<VkPipeline> pipelines_;
+};
+
+}  // namespace rigel
+
+#endif  // RIGEL_GRAPHICS_RENDER_PIPELINE_H_
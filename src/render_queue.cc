@@ -0,0 +1,99 @@
+
+#include "render_queue.h"
+
+#include <cstring>
+#include <utility>
+
+namespace rigel {
+
+constexpr uint32_t RenderSortKey::kPipelineBits;
+constexpr uint32_t RenderSortKey::kMaterialBits;
+constexpr uint32_t RenderSortKey::kMeshBits;
+constexpr uint32_t RenderSortKey::kDepthBits;
+
+namespace {
+inline uint64_t Field(uint32_t value, uint32_t bits) {
+  return static_cast<uint64_t>(value) & ((1ull << bits) - 1);
+}
+
+inline uint64_t QuantizeDepth(float depth) {
+  constexpr uint32_t max = (1u << RenderSortKey::kDepthBits) - 1;
+  if (!(depth > 0.0f)) return 0;
+  if (depth >= 1.0f) return max;
+  return static_cast<uint64_t>(depth * static_cast<float>(max));
+}
+}  // unnamed namespace
+
+uint64_t RenderSortKey::Opaque(uint32_t pipeline, uint32_t material,
+    uint32_t mesh, float depth) {
+  return (Field(pipeline, kPipelineBits) << 56) |
+      (Field(material, kMaterialBits) << 40) |
+      (Field(mesh, kMeshBits) << 24) |
+      QuantizeDepth(depth);
+}
+
+uint64_t RenderSortKey::Translucent(uint32_t pipeline, uint32_t material,
+    uint32_t mesh, float depth) {
+  constexpr uint64_t max = (1u << kDepthBits) - 1;
+  return (1ull << 63) |
+      ((max - QuantizeDepth(depth)) << 39) |
+      (Field(pipeline, kPipelineBits) << 32) |
+      (Field(material, kMaterialBits) << 16) |
+      Field(mesh, kMeshBits);
+}
+
+void RenderQueue::Clear() {
+  keys_.clear();
+  items_.clear();
+}
+
+void RenderQueue::Push(uint64_t key, uint32_t item) {
+  keys_.push_back(key);
+  items_.push_back(item);
+}
+
+void RenderQueue::Sort() {
+  const size_t size = keys_.size();
+  if (size < 2) return;
+  scratch_keys_.resize(size);
+  scratch_items_.resize(size);
+  uint64_t *src_keys = keys_.data();
+  uint32_t *src_items = items_.data();
+  uint64_t *dst_keys = scratch_keys_.data();
+  uint32_t *dst_items = scratch_items_.data();
+  // histograms for all 8 byte positions in a single read pass
+  size_t counts[8][256];
+  memset(counts, 0, sizeof(counts));
+  for (size_t i = 0; i < size; i++) {
+    uint64_t key = src_keys[i];
+    for (int pass = 0; pass < 8; pass++) {
+      counts[pass][(key >> (pass * 8)) & 0xff]++;
+    }
+  }
+  for (int pass = 0; pass < 8; pass++) {
+    const int shift = pass * 8;
+    size_t *count = counts[pass];
+    // every key shares this byte, the pass would be an identity copy
+    if (count[(src_keys[0] >> shift) & 0xff] == size) continue;
+    size_t offset = 0;
+    for (int b = 0; b < 256; b++) {
+      size_t c = count[b];
+      count[b] = offset;
+      offset += c;
+    }
+    for (size_t i = 0; i < size; i++) {
+      uint64_t key = src_keys[i];
+      size_t position = count[(key >> shift) & 0xff]++;
+      dst_keys[position] = key;
+      dst_items[position] = src_items[i];
+    }
+    std::swap(src_keys, dst_keys);
+    std::swap(src_items, dst_items);
+  }
+  if (src_keys != keys_.data()) {
+    memcpy(keys_.data(), src_keys, size * sizeof(uint64_t));
+    memcpy(items_.data(), src_items, size * sizeof(uint32_t));
+  }
+}
+
+}  // namespace rigel
@@ -0,0 +1,57 @@
+
+#ifndef RIGEL_GRAPHICS_RENDER_QUEUE_H_
+#define RIGEL_GRAPHICS_RENDER_QUEUE_H_
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace rigel {
+
+// 64-bit draw sort key.
+//  opaque:      [63] 0 | [62..56] pipeline | [55..40] material
+//               | [39..24] mesh | [23..0] depth (front to back)
+//  translucent: [63] 1 | [62..39] inverted depth (back to front)
+//               | [38..32] pipeline | [31..16] material | [15..0] mesh
+// Sorting ascending keeps binds of the same pipeline and material
+// adjacent for opaque draws and draws translucent ones afterwards.
+struct RenderSortKey {
+  static constexpr uint32_t kPipelineBits = 7;
+  static constexpr uint32_t kMaterialBits = 16;
+  static constexpr uint32_t kMeshBits = 16;
+  static constexpr uint32_t kDepthBits = 24;
+
+  // depth is normalized to [0, 1]
+  static uint64_t Opaque(uint32_t pipeline, uint32_t material,
+      uint32_t mesh, float depth);
+  static uint64_t Translucent(uint32_t pipeline, uint32_t material,
+      uint32_t mesh, float depth);
+};
+
+// Per-frame list of draws ordered by RenderSortKey with an LSD radix sort.
+// Buffers are kept across frames so steady state recording does not
+// allocate.
+class RenderQueue {
+ public:
+  RenderQueue() = default;
+  explicit RenderQueue(const RenderQueue &) = delete;
+
+  void Clear();
+  void Push(uint64_t key, uint32_t item);
+  void Sort();
+
+  size_t Size() const { return keys_.size(); }
+  uint64_t KeyAt(size_t i) const { return keys_[i]; }
+  uint32_t ItemAt(size_t i) const { return items_[i]; }
+
+ private:
+  std::vector<uint64_t> keys_;
+  std::vector<uint32_t> items_;
+  // scratch buffers for radix passes
+  std::vector<uint64_t> scratch_keys_;
+  std::vector<uint32_t> scratch_items_;
+};
+
+}  // namespace rigel
+
+#endif  // RIGEL_GRAPHICS_RENDER_QUEUE_H_
@@ -0,0 +1,132 @@
+
+#include "render_scene.h"
+
+#include <cstring>
+
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+
+namespace rigel {
+
+namespace {
+// local = T * R * S
+inline void ComposeLocal(const glm::vec3 &t, const glm::quat &r,
+    const glm::vec3 &s, glm::mat4 *out) {
+  glm::mat3 m = glm::mat3_cast(r);
+  glm::mat4 &o = *out;
+  o[0] = glm::vec4(m[0] * s.x, 0.0f);
+  o[1] = glm::vec4(m[1] * s.y, 0.0f);
+  o[2] = glm::vec4(m[2] * s.z, 0.0f);
+  o[3] = glm::vec4(t, 1.0f);
+}
+
+// out = a * b (column-major), out may alias b but not a
+inline void MultiplyMatrix(const glm::mat4 &a, const glm::mat4 &b,
+    glm::mat4 *out) {
+#if defined(__SSE__)
+  const float *pa = &a[0][0];
+  const float *pb = &b[0][0];
+  float *po = &(*out)[0][0];
+  const __m128 a0 = _mm_loadu_ps(pa + 0);
+  const __m128 a1 = _mm_loadu_ps(pa + 4);
+  const __m128 a2 = _mm_loadu_ps(pa + 8);
+  const __m128 a3 = _mm_loadu_ps(pa + 12);
+  for (int i = 0; i < 4; i++) {
+    const __m128 c = _mm_loadu_ps(pb + i * 4);
+    __m128 r = _mm_mul_ps(a0, _mm_shuffle_ps(c, c, _MM_SHUFFLE(0, 0, 0, 0)));
+    r = _mm_add_ps(r,
+        _mm_mul_ps(a1, _mm_shuffle_ps(c, c, _MM_SHUFFLE(1, 1, 1, 1))));
+    r = _mm_add_ps(r,
+        _mm_mul_ps(a2, _mm_shuffle_ps(c, c, _MM_SHUFFLE(2, 2, 2, 2))));
+    r = _mm_add_ps(r,
+        _mm_mul_ps(a3, _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 3, 3, 3))));
+    _mm_storeu_ps(po + i * 4, r);
+  }
+#else
+  *out = a * b;
+#endif
+}
+}  // unnamed namespace
+
+SceneStore::SceneStore(size_t capacity)
+    : capacity_(capacity), dirty_begin_(0) {
+  translations_.reserve(capacity);
+  rotations_.reserve(capacity);
+  scales_.reserve(capacity);
+  parents_.reserve(capacity);
+  worlds_.reserve(capacity);
+  dirty_.reserve(capacity);
+}
+
+SceneNode SceneStore::CreateNode(SceneNode parent) {
+  size_t index = parents_.size();
+  if (index >= capacity_) return kInvalidSceneNode;
+  if (parent != kInvalidSceneNode && parent >= index) return kInvalidSceneNode;
+  translations_.push_back(glm::vec3(0.0f));
+  rotations_.push_back(glm::quat(1.0f, 0.0f, 0.0f, 0.0f));
+  scales_.push_back(glm::vec3(1.0f));
+  parents_.push_back(parent);
+  worlds_.push_back(glm::mat4(1.0f));
+  dirty_.push_back(1);
+  SceneNode node = static_cast<SceneNode>(index);
+  MarkDirty(node);
+  return node;
+}
+
+void SceneStore::Clear() {
+  translations_.clear();
+  rotations_.clear();
+  scales_.clear();
+  parents_.clear();
+  worlds_.clear();
+  dirty_.clear();
+  dirty_begin_ = 0;
+}
+
+void SceneStore::SetTranslation(SceneNode node,
+    const glm::vec3 &translation) {
+  translations_[node] = translation;
+  MarkDirty(node);
+}
+
+void SceneStore::SetRotation(SceneNode node, const glm::quat &rotation) {
+  rotations_[node] = rotation;
+  MarkDirty(node);
+}
+
+void SceneStore::SetScale(SceneNode node, const glm::vec3 &scale) {
+  scales_[node] = scale;
+  MarkDirty(node);
+}
+
+void SceneStore::MarkDirty(SceneNode node) {
+  dirty_[node] = 1;
+  if (node < dirty_begin_) dirty_begin_ = node;
+}
+
+size_t SceneStore::Update() {
+  const size_t size = parents_.size();
+  if (dirty_begin_ >= size) return 0;
+  size_t updated = 0;
+  glm::mat4 local;
+  for (size_t i = dirty_begin_; i < size; i++) {
+    const SceneNode parent = parents_[i];
+    // a node is stale when itself or its parent changed this pass.
+    // parents always precede children so their flags are already final
+    if (parent != kInvalidSceneNode && dirty_[parent]) dirty_[i] = 1;
+    if (!dirty_[i]) continue;
+    ComposeLocal(translations_[i], rotations_[i], scales_[i], &local);
+    if (parent == kInvalidSceneNode) {
+      worlds_[i] = local;
+    } else {
+      MultiplyMatrix(worlds_[parent], local, &worlds_[i]);
+    }
+    updated++;
+  }
+  memset(dirty_.data() + dirty_begin_, 0, size - dirty_begin_);
+  dirty_begin_ = size;
+  return updated;
+}
+
+}  // namespace rigel
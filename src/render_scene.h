@@ -0,0 +1,84 @@
+
+#ifndef RIGEL_GRAPHICS_RENDER_SCENE_H_
+#define RIGEL_GRAPHICS_RENDER_SCENE_H_
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#ifndef GLM_FORCE_RADIANS
+#define GLM_FORCE_RADIANS
+#endif
+#ifndef GLM_FORCE_DEPTH_ZERO_TO_ONE
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#endif
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+namespace rigel {
+
+typedef uint32_t SceneNode;
+
+const SceneNode kInvalidSceneNode = 0xffffffffu;
+
+// Scene store keeping node transforms as structure-of-arrays.
+// Nodes are only appended, and a parent is always created before its
+// children, so the hierarchy is a flat array ordered parent-first and
+// world matrices can be resolved in a single forward pass.
+// All storage is reserved up front; creating nodes never allocates.
+class SceneStore {
+ public:
+  explicit SceneStore(size_t capacity);
+  explicit SceneStore(const SceneStore &) = delete;
+
+  // returns kInvalidSceneNode when the store is full
+  // or the parent is not a valid node
+  SceneNode CreateNode(SceneNode parent = kInvalidSceneNode);
+  void Clear();
+
+  void SetTranslation(SceneNode node, const glm::vec3 &translation);
+  void SetRotation(SceneNode node, const glm::quat &rotation);
+  void SetScale(SceneNode node, const glm::vec3 &scale);
+
+  const glm::vec3 &GetTranslation(SceneNode node) const {
+    return translations_[node];
+  }
+  const glm::quat &GetRotation(SceneNode node) const {
+    return rotations_[node];
+  }
+  const glm::vec3 &GetScale(SceneNode node) const {
+    return scales_[node];
+  }
+  SceneNode GetParent(SceneNode node) const { return parents_[node]; }
+
+  // Recomputes world matrices of dirty nodes and their descendants.
+  // Returns the number of world matrices rewritten.
+  size_t Update();
+
+  size_t Size() const { return parents_.size(); }
+  size_t Capacity() const { return capacity_; }
+  // contiguous world matrices, indexed by node
+  const glm::mat4 *WorldMatrices() const { return worlds_.data(); }
+  const glm::mat4 &GetWorldMatrix(SceneNode node) const {
+    return worlds_[node];
+  }
+
+ private:
+  void MarkDirty(SceneNode node);
+
+  size_t capacity_;
+  // transforms (structure-of-arrays)
+  std::vector<glm::vec3> translations_;
+  std::vector<glm::quat> rotations_;
+  std::vector<glm::vec3> scales_;
+  std::vector<SceneNode> parents_;
+  std::vector<glm::mat4> worlds_;
+  // non-zero when the local transform or an ancestor changed
+  std::vector<uint8_t> dirty_;
+  // lowest dirty index, nodes before it are up to date
+  size_t dirty_begin_;
+};
+
+}  // namespace rigel
+
+#endif  // RIGEL_GRAPHICS_RENDER_SCENE_H_
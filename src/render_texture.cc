@@ -0,0 +1,561 @@
+
+#include "render_texture.h"
+#include "render_helper.inc"
+#include "logging.inc"
+
+#include <algorithm>
+#include <functional>
+#include <cstring>
+
+extern "C" {
+#include <pthread.h>
+void *RGLTextureStagingThreadEntry(void *state);
+}
+
+#define VK_CHECK_RESULT(f) (f)
+
+namespace rigel {
+
+namespace {
+const uint8_t kKtx2Identifier[12] = {
+  0xAB, 0x4B, 0x54, 0x58, 0x20, 0x32, 0x30, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A
+};
+// identifier, 9 header words and the index section
+constexpr size_t kKtx2HeaderSize = 12 + 9 * 4 + 4 * 4 + 2 * 8;
+constexpr size_t kKtx2LevelIndexSize = 3 * 8;
+// levels uploaded immediately on load, coarsest first
+constexpr VkDeviceSize kInitialResidentBytes = 64 * 1024;
+
+template<typename T>
+inline T ReadValue(const char *p) {
+  T value;
+  memcpy(&value, p, sizeof(T));
+  return value;
+}
+
+inline uint32_t LevelExtent(uint32_t base, uint32_t level) {
+  return std::max(1u, base >> level);
+}
+}  // unnamed namespace
+
+Ktx2Container::Ktx2Container()
+    : format_(VK_FORMAT_UNDEFINED), width_(0), height_(0) {}
+
+bool Ktx2Container::IsSupportedFormat(VkFormat format) {
+  switch (format) {
+    case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+    case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+    case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+    case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+    case VK_FORMAT_BC3_UNORM_BLOCK:
+    case VK_FORMAT_BC3_SRGB_BLOCK:
+    case VK_FORMAT_BC7_UNORM_BLOCK:
+    case VK_FORMAT_BC7_SRGB_BLOCK:
+      return true;
+    default:
+      return false;
+  }
+}
+
+bool Ktx2Container::Open(const std::string &path) {
+  if (!file_.Open(path)) {
+    RGL_WARN("could not map " + path);
+    return false;
+  }
+  const char *data = file_.Data();
+  const size_t size = file_.Size();
+  if (size < kKtx2HeaderSize ||
+      memcmp(data, kKtx2Identifier, sizeof(kKtx2Identifier)) != 0) {
+    RGL_WARN("not a KTX2 file: " + path);
+    return false;
+  }
+  const char *header = data + sizeof(kKtx2Identifier);
+  const uint32_t vk_format = ReadValue<uint32_t>(header + 0);
+  const uint32_t pixel_width = ReadValue<uint32_t>(header + 8);
+  const uint32_t pixel_height = ReadValue<uint32_t>(header + 12);
+  const uint32_t pixel_depth = ReadValue<uint32_t>(header + 16);
+  const uint32_t layer_count = ReadValue<uint32_t>(header + 20);
+  const uint32_t face_count = ReadValue<uint32_t>(header + 24);
+  const uint32_t level_count = std::max(1u, ReadValue<uint32_t>(header + 28));
+  const uint32_t supercompression = ReadValue<uint32_t>(header + 32);
+  format_ = static_cast<VkFormat>(vk_format);
+  if (!IsSupportedFormat(format_) || supercompression != 0) {
+    RGL_WARN("unsupported KTX2 format: " + path);
+    return false;
+  }
+  if (pixel_width == 0 || pixel_height == 0 || pixel_depth > 1 ||
+      layer_count > 1 || face_count != 1 || level_count > 32) {
+    RGL_WARN("unsupported KTX2 layout: " + path);
+    return false;
+  }
+  if (size < kKtx2HeaderSize + level_count * kKtx2LevelIndexSize) {
+    RGL_WARN("truncated KTX2 level index: " + path);
+    return false;
+  }
+  width_ = pixel_width;
+  height_ = pixel_height;
+  levels_.resize(level_count);
+  const char *index = data + kKtx2HeaderSize;
+  for (uint32_t i = 0; i < level_count; i++) {
+    Level &level = levels_[i];
+    level.offset = ReadValue<uint64_t>(index + i * kKtx2LevelIndexSize);
+    level.length = ReadValue<uint64_t>(index + i * kKtx2LevelIndexSize + 8);
+    if (level.offset > size || level.length > size - level.offset) {
+      RGL_WARN("truncated KTX2 level data: " + path);
+      levels_.clear();
+      return false;
+    }
+  }
+  return true;
+}
+
+const char *Ktx2Container::LevelData(uint32_t level) const {
+  return file_.Data() + levels_[level].offset;
+}
+
+VkDeviceSize Ktx2Container::LevelSize(uint32_t level) const {
+  return static_cast<VkDeviceSize>(levels_[level].length);
+}
+
+// Runs one task at a time off the render thread, for the allocation
+// and staging of the levels a texture grows by.
+class TextureStagingThread {
+ public:
+  TextureStagingThread() : running_(true) {
+    pthread_mutex_init(&mutex_, nullptr);
+    pthread_cond_init(&cond_, nullptr);
+    pthread_create(&thread_, nullptr, RGLTextureStagingThreadEntry, this);
+  }
+
+  // waits for the task in progress
+  ~TextureStagingThread() {
+    pthread_mutex_lock(&mutex_);
+    running_ = false;
+    pthread_cond_signal(&cond_);
+    pthread_mutex_unlock(&mutex_);
+    pthread_join(thread_, nullptr);
+    pthread_cond_destroy(&cond_);
+    pthread_mutex_destroy(&mutex_);
+  }
+
+  // the previous task must be done
+  void Post(const std::function<void()> &task) {
+    pthread_mutex_lock(&mutex_);
+    task_ = task;
+    pthread_cond_signal(&cond_);
+    pthread_mutex_unlock(&mutex_);
+  }
+
+  // whether the posted task has finished, its writes are visible then
+  bool Done() {
+    pthread_mutex_lock(&mutex_);
+    const bool done = !task_;
+    pthread_mutex_unlock(&mutex_);
+    return done;
+  }
+
+  void Run() {
+    pthread_mutex_lock(&mutex_);
+    while (true) {
+      while (running_ && !task_) {
+        pthread_cond_wait(&cond_, &mutex_);
+      }
+      if (!task_) break;
+      std::function<void()> task = task_;
+      pthread_mutex_unlock(&mutex_);
+      task();
+      pthread_mutex_lock(&mutex_);
+      task_ = nullptr;
+    }
+    pthread_mutex_unlock(&mutex_);
+  }
+
+ private:
+  pthread_t thread_;
+  pthread_mutex_t mutex_;
+  pthread_cond_t cond_;
+  bool running_;
+  std::function<void()> task_;
+};
+
+TextureStreamer::LevelUpload::LevelUpload()
+    : texture(-1), resident_level(0), image(VK_NULL_HANDLE),
+      memory(VK_NULL_HANDLE), image_bytes(0), staging(VK_NULL_HANDLE),
+      staging_memory(VK_NULL_HANDLE), staging_bytes(0),
+      cmd(VK_NULL_HANDLE), fence(VK_NULL_HANDLE), staged(false) {}
+
+TextureStreamer::TextureStreamer(VkPhysicalDevice physical_device,
+    VkDevice device, VkQueue queue, VkCommandPool command_pool,
+    VkDeviceSize budget)
+    : physical_device_(physical_device), device_(device), queue_(queue),
+      command_pool_(command_pool), sampler_(VK_NULL_HANDLE),
+      budget_(budget), resident_bytes_(0), next_pump_(0),
+      upload_state_(kUploadIdle),
+      staging_thread_(new TextureStagingThread()) {
+  VkPhysicalDeviceFeatures features;
+  vkGetPhysicalDeviceFeatures(physical_device_, &features);
+  supported_ = features.textureCompressionBC == VK_TRUE;
+  if (!supported_) {
+    RGL_WARN("BC texture compression is not supported");
+    return;
+  }
+  VkSamplerCreateInfo samplerInfo = {};
+  samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+  samplerInfo.magFilter = VK_FILTER_LINEAR;
+  samplerInfo.minFilter = VK_FILTER_LINEAR;
+  samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+  samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+  samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+  samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+  samplerInfo.maxAnisotropy = 1.0f;
+  samplerInfo.minLod = 0.0f;
+  samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+  samplerInfo.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+  VK_CHECK_RESULT(vkCreateSampler(device_, &samplerInfo, nullptr, &sampler_));
+}
+
+TextureStreamer::~TextureStreamer() {
+  // finishes the staging in progress
+  delete staging_thread_;
+  staging_thread_ = nullptr;
+  if (upload_state_ == kUploadCopying) {
+    vkWaitForFences(device_, 1, &upload_.fence, VK_TRUE, UINT64_MAX);
+  }
+  if (upload_state_ != kUploadIdle) {
+    DiscardUpload(&upload_);
+    upload_state_ = kUploadIdle;
+  }
+  for (auto &texture : textures_) {
+    Release(texture.image, texture.memory, texture.view);
+  }
+  textures_.clear();
+  if (sampler_ != VK_NULL_HANDLE) {
+    vkDestroySampler(device_, sampler_, nullptr);
+  }
+}
+
+int TextureStreamer::Load(const std::string &path) {
+  if (!supported_) return -1;
+  std::unique_ptr<Ktx2Container> container(new Ktx2Container());
+  if (!container->Open(path)) return -1;
+  VkFormatProperties formatProps;
+  vkGetPhysicalDeviceFormatProperties(physical_device_,
+      container->Format(), &formatProps);
+  if (!(formatProps.optimalTilingFeatures &
+      VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT)) {
+    RGL_WARN("texture format cannot be sampled: " + path);
+    return -1;
+  }
+  // coarsest levels first, as many as fit the initial allowance
+  const uint32_t count = container->LevelCount();
+  uint32_t level = count - 1;
+  VkDeviceSize bytes = container->LevelSize(level);
+  while (level > 0 &&
+      bytes + container->LevelSize(level - 1) <= kInitialResidentBytes) {
+    level--;
+    bytes += container->LevelSize(level);
+  }
+  // then fewer of them while they do not fit the budget
+  LevelUpload upload;
+  while (true) {
+    upload.resident_level = level;
+    if (!CreateImage(*container, &upload)) return -1;
+    if (resident_bytes_ + upload.image_bytes + upload.staging_bytes <=
+        budget_) {
+      break;
+    }
+    vkDestroyImage(device_, upload.image, nullptr);
+    upload.image = VK_NULL_HANDLE;
+    if (level + 1 == count) {
+      RGL_WARN("texture budget exceeded: " + path);
+      return -1;
+    }
+    level++;
+  }
+  resident_bytes_ += upload.image_bytes + upload.staging_bytes;
+  if (!StageLevels(*container, &upload)) {
+    DiscardUpload(&upload);
+    return -1;
+  }
+  // the initial levels are waited for, the image is sampled right away
+  SubmitUpload(*container, &upload);
+  vkWaitForFences(device_, 1, &upload.fence, VK_TRUE, UINT64_MAX);
+  Texture texture;
+  texture.container = std::move(container);
+  texture.image = VK_NULL_HANDLE;
+  texture.memory = VK_NULL_HANDLE;
+  texture.view = VK_NULL_HANDLE;
+  texture.resident_level = count;
+  texture.bytes = 0;
+  texture.capped = false;
+  textures_.push_back(std::move(texture));
+  upload.texture = static_cast<int>(textures_.size() - 1);
+  FinishUpload(&upload);
+  return upload.texture;
+}
+
+int TextureStreamer::Pump() {
+  if (upload_state_ == kUploadStaging) {
+    if (!staging_thread_->Done()) return -1;
+    Texture &texture = textures_[upload_.texture];
+    if (!upload_.staged) {
+      RGL_WARN("texture level staging failed");
+      DiscardUpload(&upload_);
+      texture.capped = true;
+      upload_state_ = kUploadIdle;
+      return -1;
+    }
+    SubmitUpload(*texture.container, &upload_);
+    upload_state_ = kUploadCopying;
+    return -1;
+  }
+  if (upload_state_ == kUploadCopying) {
+    // the copy runs alongside the frames, checked again next tick
+    if (vkGetFenceStatus(device_, upload_.fence) != VK_SUCCESS) return -1;
+    FinishUpload(&upload_);
+    upload_state_ = kUploadIdle;
+    return upload_.texture;
+  }
+  StartUpload();
+  return -1;
+}
+
+void TextureStreamer::StartUpload() {
+  const size_t size = textures_.size();
+  for (size_t n = 0; n < size; n++) {
+    const size_t i = (next_pump_ + n) % size;
+    Texture &texture = textures_[i];
+    if (texture.resident_level == 0 || texture.capped) continue;
+    LevelUpload upload;
+    upload.texture = static_cast<int>(i);
+    upload.resident_level = texture.resident_level - 1;
+    if (!CreateImage(*texture.container, &upload)) {
+      texture.capped = true;
+      continue;
+    }
+    // the current image stays resident until the new one replaces it
+    if (resident_bytes_ + upload.image_bytes + upload.staging_bytes >
+        budget_) {
+      vkDestroyImage(device_, upload.image, nullptr);
+      texture.capped = true;
+      continue;
+    }
+    resident_bytes_ += upload.image_bytes + upload.staging_bytes;
+    next_pump_ = i + 1;
+    upload_ = std::move(upload);
+    upload_state_ = kUploadStaging;
+    const Ktx2Container *container = texture.container.get();
+    staging_thread_->Post([this, container] {
+      upload_.staged = StageLevels(*container, &upload_);
+    });
+    return;
+  }
+}
+
+VkImageView TextureStreamer::GetView(int texture) const {
+  return textures_[texture].view;
+}
+
+bool TextureStreamer::CreateImage(const Ktx2Container &container,
+    LevelUpload *upload) {
+  const uint32_t resident_level = upload->resident_level;
+  VkImageCreateInfo imageInfo = CreateImageCreateInfo();
+  imageInfo.imageType = VK_IMAGE_TYPE_2D;
+  imageInfo.format = container.Format();
+  imageInfo.extent.width = LevelExtent(container.Width(), resident_level);
+  imageInfo.extent.height = LevelExtent(container.Height(), resident_level);
+  imageInfo.extent.depth = 1;
+  imageInfo.mipLevels = container.LevelCount() - resident_level;
+  imageInfo.arrayLayers = 1;
+  imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+  imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+  imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  imageInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT |
+      VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+  VkImage image;
+  if (vkCreateImage(device_, &imageInfo, nullptr, &image) != VK_SUCCESS) {
+    return false;
+  }
+  VkMemoryRequirements memReqs;
+  vkGetImageMemoryRequirements(device_, image, &memReqs);
+  upload->image = image;
+  upload->image_bytes = memReqs.size;
+  // every level is staged from the mapped container again, so the
+  // image being sampled is never read by the copy
+  upload->staging_bytes = 0;
+  for (uint32_t level = resident_level; level < container.LevelCount();
+      level++) {
+    upload->staging_bytes += container.LevelSize(level);
+  }
+  return true;
+}
+
+bool TextureStreamer::StageLevels(const Ktx2Container &container,
+    LevelUpload *upload) {
+  VkMemoryRequirements memReqs;
+  vkGetImageMemoryRequirements(device_, upload->image, &memReqs);
+  VkMemoryAllocateInfo memAlloc = CreateMemoryAllocateInfo();
+  memAlloc.allocationSize = memReqs.size;
+  memAlloc.memoryTypeIndex = GetMemoryTypeIndex(physical_device_,
+      memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+  if (vkAllocateMemory(device_, &memAlloc, nullptr, &upload->memory) !=
+      VK_SUCCESS) {
+    upload->memory = VK_NULL_HANDLE;
+    return false;
+  }
+  VK_CHECK_RESULT(vkBindImageMemory(device_, upload->image,
+      upload->memory, 0));
+
+  // Stage the levels straight from the mapped container
+  VkBufferCreateInfo bufferInfo = CreateBufferCreateInfo(
+      VK_BUFFER_USAGE_TRANSFER_SRC_BIT, upload->staging_bytes);
+  bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+  if (vkCreateBuffer(device_, &bufferInfo, nullptr, &upload->staging) !=
+      VK_SUCCESS) {
+    upload->staging = VK_NULL_HANDLE;
+    return false;
+  }
+  vkGetBufferMemoryRequirements(device_, upload->staging, &memReqs);
+  memAlloc.allocationSize = memReqs.size;
+  memAlloc.memoryTypeIndex = GetMemoryTypeIndex(physical_device_,
+      memReqs.memoryTypeBits,
+      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+          VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+  if (vkAllocateMemory(device_, &memAlloc, nullptr,
+      &upload->staging_memory) != VK_SUCCESS) {
+    upload->staging_memory = VK_NULL_HANDLE;
+    return false;
+  }
+  VK_CHECK_RESULT(vkBindBufferMemory(device_, upload->staging,
+      upload->staging_memory, 0));
+  char *mapped;
+  VK_CHECK_RESULT(vkMapMemory(device_, upload->staging_memory, 0,
+      upload->staging_bytes, 0, reinterpret_cast<void **>(&mapped)));
+  upload->regions.clear();
+  VkDeviceSize offset = 0;
+  for (uint32_t level = upload->resident_level;
+      level < container.LevelCount(); level++) {
+    const VkDeviceSize size = container.LevelSize(level);
+    memcpy(mapped + offset, container.LevelData(level), size);
+    VkBufferImageCopy region = {};
+    region.bufferOffset = offset;
+    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.imageSubresource.mipLevel = level - upload->resident_level;
+    region.imageSubresource.layerCount = 1;
+    region.imageExtent.width = LevelExtent(container.Width(), level);
+    region.imageExtent.height = LevelExtent(container.Height(), level);
+    region.imageExtent.depth = 1;
+    upload->regions.push_back(region);
+    offset += size;
+  }
+  vkUnmapMemory(device_, upload->staging_memory);
+  return true;
+}
+
+void TextureStreamer::SubmitUpload(const Ktx2Container &container,
+    LevelUpload *upload) {
+  const uint32_t level_count =
+      container.LevelCount() - upload->resident_level;
+  const VkImageSubresourceRange range =
+      { VK_IMAGE_ASPECT_COLOR_BIT, 0, level_count, 0, 1 };
+  VkCommandBufferAllocateInfo cmdBufAllocateInfo =
+      CreateCommandBufferAllocateInfo(command_pool_,
+          VK_COMMAND_BUFFER_LEVEL_PRIMARY, 1);
+  VK_CHECK_RESULT(vkAllocateCommandBuffers(device_, &cmdBufAllocateInfo,
+      &upload->cmd));
+  VkCommandBuffer cmd = upload->cmd;
+  VkCommandBufferBeginInfo cmdBufInfo = CreateCommandBufferBeginInfo();
+  VK_CHECK_RESULT(vkBeginCommandBuffer(cmd, &cmdBufInfo));
+  InsertImageMemoryBarrier(
+    cmd,
+    upload->image,
+    0,
+    VK_ACCESS_TRANSFER_WRITE_BIT,
+    VK_IMAGE_LAYOUT_UNDEFINED,
+    VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+    VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+    VK_PIPELINE_STAGE_TRANSFER_BIT,
+    range);
+  vkCmdCopyBufferToImage(cmd, upload->staging, upload->image,
+      VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+      static_cast<uint32_t>(upload->regions.size()),
+      upload->regions.data());
+  InsertImageMemoryBarrier(
+    cmd,
+    upload->image,
+    VK_ACCESS_TRANSFER_WRITE_BIT,
+    VK_ACCESS_SHADER_READ_BIT,
+    VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+    VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+    VK_PIPELINE_STAGE_TRANSFER_BIT,
+    VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+    range);
+  VK_CHECK_RESULT(vkEndCommandBuffer(cmd));
+  VkFenceCreateInfo fenceInfo = CreateFenceCreateInfo();
+  VK_CHECK_RESULT(vkCreateFence(device_, &fenceInfo, nullptr,
+      &upload->fence));
+  VkSubmitInfo submitInfo = CreateSubmitInfo();
+  submitInfo.commandBufferCount = 1;
+  submitInfo.pCommandBuffers = &cmd;
+  VK_CHECK_RESULT(vkQueueSubmit(queue_, 1, &submitInfo, upload->fence));
+}
+
+void TextureStreamer::FinishUpload(LevelUpload *upload) {
+  vkDestroyFence(device_, upload->fence, nullptr);
+  vkFreeCommandBuffers(device_, command_pool_, 1, &upload->cmd);
+  vkDestroyBuffer(device_, upload->staging, nullptr);
+  vkFreeMemory(device_, upload->staging_memory, nullptr);
+  resident_bytes_ -= upload->staging_bytes;
+
+  Texture &texture = textures_[upload->texture];
+  const uint32_t level_count =
+      texture.container->LevelCount() - upload->resident_level;
+  VkImageViewCreateInfo viewInfo = CreateImageViewCreateInfo();
+  viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+  viewInfo.format = texture.container->Format();
+  viewInfo.subresourceRange = VkImageSubresourceRange{
+      VK_IMAGE_ASPECT_COLOR_BIT, 0, level_count, 0, 1 };
+  viewInfo.image = upload->image;
+  VkImageView view;
+  VK_CHECK_RESULT(vkCreateImageView(device_, &viewInfo, nullptr, &view));
+  // frames sampling the previous image have completed, see Pump
+  Release(texture.image, texture.memory, texture.view);
+  resident_bytes_ -= texture.bytes;
+  texture.image = upload->image;
+  texture.memory = upload->memory;
+  texture.view = view;
+  texture.resident_level = upload->resident_level;
+  texture.bytes = upload->image_bytes;
+}
+
+void TextureStreamer::DiscardUpload(LevelUpload *upload) {
+  if (upload->fence != VK_NULL_HANDLE) {
+    vkDestroyFence(device_, upload->fence, nullptr);
+  }
+  if (upload->cmd != VK_NULL_HANDLE) {
+    vkFreeCommandBuffers(device_, command_pool_, 1, &upload->cmd);
+  }
+  if (upload->staging != VK_NULL_HANDLE) {
+    vkDestroyBuffer(device_, upload->staging, nullptr);
+  }
+  if (upload->staging_memory != VK_NULL_HANDLE) {
+    vkFreeMemory(device_, upload->staging_memory, nullptr);
+  }
+  Release(upload->image, upload->memory, VK_NULL_HANDLE);
+  resident_bytes_ -= upload->image_bytes + upload->staging_bytes;
+  *upload = LevelUpload();
+}
+
+void TextureStreamer::Release(VkImage image, VkDeviceMemory memory,
+    VkImageView view) {
+  if (view != VK_NULL_HANDLE) vkDestroyImageView(device_, view, nullptr);
+  if (image != VK_NULL_HANDLE) vkDestroyImage(device_, image, nullptr);
+  if (memory != VK_NULL_HANDLE) vkFreeMemory(device_, memory, nullptr);
+}
+
+}  // namespace rigel
+
+void *RGLTextureStagingThreadEntry(void *state) {
+  static_cast<rigel::TextureStagingThread *>(state)->Run();
+  return 0;
+}
@@ -0,0 +1,153 @@
+
+#ifndef RIGEL_GRAPHICS_RENDER_TEXTURE_H_
+#define RIGEL_GRAPHICS_RENDER_TEXTURE_H_
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+
+#include <vulkan/vulkan.h>
+
+#include "mapped_file.h"
+
+namespace rigel {
+
+// KTX2 container over a memory mapped file.
+// Only block-compressed formats without supercompression are accepted,
+// so level data can be copied to the staging buffer as is.
+class Ktx2Container {
+ public:
+  Ktx2Container();
+  explicit Ktx2Container(const Ktx2Container &) = delete;
+
+  bool Open(const std::string &path);
+
+  VkFormat Format() const { return format_; }
+  uint32_t Width() const { return width_; }
+  uint32_t Height() const { return height_; }
+  // level 0 is the base (largest) level
+  uint32_t LevelCount() const { return static_cast<uint32_t>(levels_.size()); }
+  const char *LevelData(uint32_t level) const;
+  VkDeviceSize LevelSize(uint32_t level) const;
+
+  static bool IsSupportedFormat(VkFormat format);
+
+ private:
+  struct Level {
+    uint64_t offset;
+    uint64_t length;
+  };
+  MappedFile file_;
+  VkFormat format_;
+  uint32_t width_;
+  uint32_t height_;
+  std::vector<Level> levels_;
+};
+
+class TextureStagingThread;
+
+// Block-compressed textures streamed in from the coarsest mip level.
+// An image only holds its resident levels, and only those are charged
+// to the budget. Load uploads the coarsest levels that fit. Pump grows
+// one texture at a time by a level: a background thread allocates the
+// larger image and stages its levels, the copy is submitted with a
+// fence, and a later call swaps the new image in once it signaled.
+// The old image, the new one and the staging buffer are all charged
+// until then. Textures whose next level does not fit stay at the
+// levels they have.
+class TextureStreamer {
+ public:
+  TextureStreamer(VkPhysicalDevice physical_device, VkDevice device,
+      VkQueue queue, VkCommandPool command_pool, VkDeviceSize budget);
+  explicit TextureStreamer(const TextureStreamer &) = delete;
+  ~TextureStreamer();
+
+  // returns the texture identifier, or -1 on failure
+  int Load(const std::string &path);
+  // Advances the level upload in flight, or starts the next one.
+  // Returns the texture whose image view was replaced, or -1 when
+  // nothing changed. Frames sampling the previous view must have
+  // completed
+  int Pump();
+
+  VkImageView GetView(int texture) const;
+  VkSampler GetSampler() const { return sampler_; }
+  // resident images, and the images and staging buffers in flight
+  VkDeviceSize GetResidentBytes() const { return resident_bytes_; }
+
+ private:
+  struct Texture {
+    std::unique_ptr<Ktx2Container> container;
+    VkImage image;
+    VkDeviceMemory memory;
+    VkImageView view;
+    // finest resident level, levels [resident_level, count) are on GPU
+    uint32_t resident_level;
+    // memory requirements of the image
+    VkDeviceSize bytes;
+    // the next level did not fit the budget
+    bool capped;
+  };
+
+  // an image holding levels [resident_level, count) of a texture, and
+  // the staging buffer its levels are copied from
+  struct LevelUpload {
+    int texture;
+    uint32_t resident_level;
+    VkImage image;
+    VkDeviceMemory memory;
+    VkDeviceSize image_bytes;
+    VkBuffer staging;
+    VkDeviceMemory staging_memory;
+    VkDeviceSize staging_bytes;
+    std::vector<VkBufferImageCopy> regions;
+    VkCommandBuffer cmd;
+    VkFence fence;
+    // set by the staging thread
+    bool staged;
+
+    LevelUpload();
+  };
+
+  enum UploadState {
+    kUploadIdle = 0,
+    // on the staging thread
+    kUploadStaging,
+    // submitted, waiting for the fence
+    kUploadCopying,
+  };
+
+  // creates the image without memory, so its size can be charged first
+  bool CreateImage(const Ktx2Container &container, LevelUpload *upload);
+  // allocates the image and fills the staging buffer, on any thread
+  bool StageLevels(const Ktx2Container &container, LevelUpload *upload);
+  // records the copy and submits it with the fence of the upload
+  void SubmitUpload(const Ktx2Container &container, LevelUpload *upload);
+  // the copy must have completed, the previous image is released
+  void FinishUpload(LevelUpload *upload);
+  // releases what the upload holds and uncharges it
+  void DiscardUpload(LevelUpload *upload);
+  // starts growing the next texture whose next level fits
+  void StartUpload();
+  void Release(VkImage image, VkDeviceMemory memory, VkImageView view);
+
+  VkPhysicalDevice physical_device_;
+  VkDevice device_;
+  VkQueue queue_;
+  VkCommandPool command_pool_;
+  VkSampler sampler_;
+  bool supported_;
+  VkDeviceSize budget_;
+  VkDeviceSize resident_bytes_;
+  std::vector<Texture> textures_;
+  size_t next_pump_;
+  // a single level is in flight at a time
+  UploadState upload_state_;
+  LevelUpload upload_;
+  TextureStagingThread *staging_thread_;
+};
+
+}  // namespace rigel
+
+#endif  // RIGEL_GRAPHICS_RENDER_TEXTURE_H_
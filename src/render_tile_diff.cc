@@ -0,0 +1,210 @@
+#include "render_tile_diff.h"
+#include "render_helper.inc"
+
+#include <array>
+
+#define VK_CHECK_RESULT(f) (f)
+
+namespace rigel {
+
+TileDiff::TileDiff()
+    : device_(VK_NULL_HANDLE),
+      history_image_(VK_NULL_HANDLE), history_memory_(VK_NULL_HANDLE),
+      history_view_(VK_NULL_HANDLE),
+      mask_buffer_(VK_NULL_HANDLE), mask_memory_(VK_NULL_HANDLE),
+      descriptor_set_layout_(VK_NULL_HANDLE),
+      descriptor_pool_(VK_NULL_HANDLE), descriptor_set_(VK_NULL_HANDLE),
+      pipeline_layout_(VK_NULL_HANDLE), pipeline_(VK_NULL_HANDLE),
+      dirty_tiles_(nullptr), columns_(0), rows_(0) {}
+
+TileDiff::~TileDiff() {
+  Destroy();
+}
+
+bool TileDiff::Initialize(VkPhysicalDevice physical_device, VkDevice device,
+    VkPipelineCache cache, VkShaderModule shader, VkImageView color_view,
+    uint32_t width, uint32_t height, uint32_t tile_size) {
+  device_ = device;
+  columns_ = (width + tile_size - 1) / tile_size;
+  rows_ = (height + tile_size - 1) / tile_size;
+
+  // History of the previous frame, only ever touched by the shader
+  VkImageCreateInfo image = CreateImageCreateInfo();
+  image.imageType = VK_IMAGE_TYPE_2D;
+  image.format = VK_FORMAT_R8G8B8A8_UNORM;
+  image.extent.width = width;
+  image.extent.height = height;
+  image.extent.depth = 1;
+  image.mipLevels = 1;
+  image.arrayLayers = 1;
+  image.samples = VK_SAMPLE_COUNT_1_BIT;
+  image.tiling = VK_IMAGE_TILING_OPTIMAL;
+  image.usage = VK_IMAGE_USAGE_STORAGE_BIT;
+  VK_CHECK_RESULT(vkCreateImage(device_, &image, nullptr, &history_image_));
+  VkMemoryRequirements memReqs;
+  vkGetImageMemoryRequirements(device_, history_image_, &memReqs);
+  VkMemoryAllocateInfo memAlloc = CreateMemoryAllocateInfo();
+  memAlloc.allocationSize = memReqs.size;
+  memAlloc.memoryTypeIndex = GetMemoryTypeIndex(physical_device,
+      memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+  VK_CHECK_RESULT(vkAllocateMemory(device_,
+      &memAlloc, nullptr, &history_memory_));
+  VK_CHECK_RESULT(vkBindImageMemory(device_,
+      history_image_, history_memory_, 0));
+  VkImageViewCreateInfo view = CreateImageViewCreateInfo();
+  view.viewType = VK_IMAGE_VIEW_TYPE_2D;
+  view.format = image.format;
+  view.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+  view.image = history_image_;
+  VK_CHECK_RESULT(vkCreateImageView(device_, &view, nullptr, &history_view_));
+
+  // Dirty tile bitmask read by the host
+  VkBufferCreateInfo buffer = CreateBufferCreateInfo(
+      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+      GetMaskWords() * sizeof(uint32_t));
+  buffer.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+  VK_CHECK_RESULT(vkCreateBuffer(device_, &buffer, nullptr, &mask_buffer_));
+  vkGetBufferMemoryRequirements(device_, mask_buffer_, &memReqs);
+  memAlloc.allocationSize = memReqs.size;
+  memAlloc.memoryTypeIndex = GetMemoryTypeIndex(physical_device,
+      memReqs.memoryTypeBits,
+      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+      VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+  VK_CHECK_RESULT(vkAllocateMemory(device_,
+      &memAlloc, nullptr, &mask_memory_));
+  VK_CHECK_RESULT(vkBindBufferMemory(device_, mask_buffer_, mask_memory_, 0));
+  void *mapped;
+  VK_CHECK_RESULT(vkMapMemory(device_, mask_memory_, 0,
+      VK_WHOLE_SIZE, 0, &mapped));
+  dirty_tiles_ = static_cast<const uint32_t *>(mapped);
+
+  // Descriptors
+  std::array<VkDescriptorSetLayoutBinding, 3> bindings = {};
+  for (uint32_t i = 0; i < bindings.size(); i++) {
+    bindings[i].binding = i;
+    bindings[i].descriptorType = i < 2 ?
+        VK_DESCRIPTOR_TYPE_STORAGE_IMAGE : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    bindings[i].descriptorCount = 1;
+    bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+  }
+  VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+  layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+  layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+  layoutInfo.pBindings = bindings.data();
+  VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device_,
+      &layoutInfo, nullptr, &descriptor_set_layout_));
+
+  std::array<VkDescriptorPoolSize, 2> poolSizes = {};
+  poolSizes[0].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+  poolSizes[0].descriptorCount = 2;
+  poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+  poolSizes[1].descriptorCount = 1;
+  VkDescriptorPoolCreateInfo poolInfo = {};
+  poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+  poolInfo.maxSets = 1;
+  poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+  poolInfo.pPoolSizes = poolSizes.data();
+  VK_CHECK_RESULT(vkCreateDescriptorPool(device_,
+      &poolInfo, nullptr, &descriptor_pool_));
+  VkDescriptorSetAllocateInfo allocInfo = {};
+  allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+  allocInfo.descriptorPool = descriptor_pool_;
+  allocInfo.descriptorSetCount = 1;
+  allocInfo.pSetLayouts = &descriptor_set_layout_;
+  VK_CHECK_RESULT(vkAllocateDescriptorSets(device_,
+      &allocInfo, &descriptor_set_));
+
+  VkDescriptorImageInfo imageInfos[2] = {};
+  imageInfos[0].imageView = color_view;
+  imageInfos[0].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+  imageInfos[1].imageView = history_view_;
+  imageInfos[1].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+  VkDescriptorBufferInfo bufferInfo = { mask_buffer_, 0, VK_WHOLE_SIZE };
+  std::array<VkWriteDescriptorSet, 3> writes = {};
+  for (uint32_t i = 0; i < writes.size(); i++) {
+    writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    writes[i].dstSet = descriptor_set_;
+    writes[i].dstBinding = i;
+    writes[i].descriptorCount = 1;
+    writes[i].descriptorType = bindings[i].descriptorType;
+  }
+  writes[0].pImageInfo = &imageInfos[0];
+  writes[1].pImageInfo = &imageInfos[1];
+  writes[2].pBufferInfo = &bufferInfo;
+  vkUpdateDescriptorSets(device_,
+      static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+
+  // Pipeline, the tile size is a specialization constant
+  VkPipelineLayoutCreateInfo pipelineLayoutInfo =
+      CreatePipelineLayoutCreateInfo(&descriptor_set_layout_, 1);
+  VK_CHECK_RESULT(vkCreatePipelineLayout(device_,
+      &pipelineLayoutInfo, nullptr, &pipeline_layout_));
+  int32_t tileSize = static_cast<int32_t>(tile_size);
+  VkSpecializationMapEntry entry = { 0, 0, sizeof(int32_t) };
+  VkSpecializationInfo specialization = {};
+  specialization.mapEntryCount = 1;
+  specialization.pMapEntries = &entry;
+  specialization.dataSize = sizeof(int32_t);
+  specialization.pData = &tileSize;
+  VkComputePipelineCreateInfo pipelineInfo = {};
+  pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+  pipelineInfo.stage.sType =
+      VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+  pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+  pipelineInfo.stage.module = shader;
+  pipelineInfo.stage.pName = "main";
+  pipelineInfo.stage.pSpecializationInfo = &specialization;
+  pipelineInfo.layout = pipeline_layout_;
+  return vkCreateComputePipelines(device_, cache, 1,
+      &pipelineInfo, nullptr, &pipeline_) == VK_SUCCESS;
+}
+
+void TileDiff::Record(VkCommandBuffer command_buffer) {
+  vkCmdFillBuffer(command_buffer, mask_buffer_, 0, VK_WHOLE_SIZE, 0);
+  VkBufferMemoryBarrier barrier = {};
+  barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+  barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT |
+      VK_ACCESS_SHADER_WRITE_BIT;
+  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.buffer = mask_buffer_;
+  barrier.offset = 0;
+  barrier.size = VK_WHOLE_SIZE;
+  vkCmdPipelineBarrier(command_buffer,
+      VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+      0, 0, nullptr, 1, &barrier, 0, nullptr);
+
+  vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+      pipeline_);
+  vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+      pipeline_layout_, 0, 1, &descriptor_set_, 0, nullptr);
+  vkCmdDispatch(command_buffer, columns_, rows_, 1);
+
+  // Make the bitmask visible to the host
+  barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+  vkCmdPipelineBarrier(command_buffer,
+      VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_HOST_BIT,
+      0, 0, nullptr, 1, &barrier, 0, nullptr);
+}
+
+void TileDiff::Destroy() {
+  if (device_ == VK_NULL_HANDLE) return;
+  vkDestroyPipeline(device_, pipeline_, nullptr);
+  vkDestroyPipelineLayout(device_, pipeline_layout_, nullptr);
+  vkDestroyDescriptorPool(device_, descriptor_pool_, nullptr);
+  vkDestroyDescriptorSetLayout(device_, descriptor_set_layout_, nullptr);
+  if (mask_memory_ != VK_NULL_HANDLE) {
+    vkUnmapMemory(device_, mask_memory_);
+  }
+  vkDestroyBuffer(device_, mask_buffer_, nullptr);
+  vkFreeMemory(device_, mask_memory_, nullptr);
+  vkDestroyImageView(device_, history_view_, nullptr);
+  vkDestroyImage(device_, history_image_, nullptr);
+  vkFreeMemory(device_, history_memory_, nullptr);
+  dirty_tiles_ = nullptr;
+  device_ = VK_NULL_HANDLE;
+}
+
+}  // namespace rigel
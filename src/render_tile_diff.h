@@ -0,0 +1,53 @@
+
+#ifndef RIGEL_GRAPHICS_RENDER_TILE_DIFF_H_
+#define RIGEL_GRAPHICS_RENDER_TILE_DIFF_H_
+
+#include <cstdint>
+
+#include <vulkan/vulkan.h>
+
+namespace rigel {
+
+// Compute pass comparing the color target with the previous frame tile
+// by tile. The result is a host visible bitmask with one bit per tile,
+// readable once the command buffer recorded by Record has completed.
+class TileDiff {
+ public:
+  TileDiff();
+  explicit TileDiff(const TileDiff &) = delete;
+  ~TileDiff();
+
+  // color_view must be usable as a storage image
+  bool Initialize(VkPhysicalDevice physical_device, VkDevice device,
+      VkPipelineCache cache, VkShaderModule shader, VkImageView color_view,
+      uint32_t width, uint32_t height, uint32_t tile_size);
+  // both images are expected in VK_IMAGE_LAYOUT_GENERAL
+  void Record(VkCommandBuffer command_buffer);
+  void Destroy();
+
+  VkImage GetHistoryImage() const { return history_image_; }
+  const uint32_t *GetDirtyTiles() const { return dirty_tiles_; }
+  uint32_t GetColumns() const { return columns_; }
+  uint32_t GetRows() const { return rows_; }
+  uint32_t GetMaskWords() const { return (columns_ * rows_ + 31) / 32; }
+
+ private:
+  VkDevice device_;
+  VkImage history_image_;
+  VkDeviceMemory history_memory_;
+  VkImageView history_view_;
+  VkBuffer mask_buffer_;
+  VkDeviceMemory mask_memory_;
+  VkDescriptorSetLayout descriptor_set_layout_;
+  VkDescriptorPool descriptor_pool_;
+  VkDescriptorSet descriptor_set_;
+  VkPipelineLayout pipeline_layout_;
+  VkPipeline pipeline_;
+  const uint32_t *dirty_tiles_;
+  uint32_t columns_;
+  uint32_t rows_;
+};
+
+}  // namespace rigel
+
+#endif  // RIGEL_GRAPHICS_RENDER_TILE_DIFF_H_
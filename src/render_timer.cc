@@ -6,6 +6,7 @@
 #include <boost/bind.hpp>
 #include <boost/scoped_ptr.hpp>
 #include <iostream>
+#include <algorithm>
 
 extern "C" {
 #include <time.h>
@@ -14,13 +15,15 @@ void *RGLIntervalTimerThreadEntry(void *state);
 }
 
 constexpr uint64_t NSEC_PER_SEC = 1000000000L;
+// early ticks keep at least this fraction of the interval
+constexpr double kMinSpacingRatio = 0.5;
 
-static inline void RGLAbsoluteSleep(uint64_t nsec) {
+static inline timespec RGLTimespec(uint64_t nsec) {
   timespec t {
     static_cast<time_t>(nsec / NSEC_PER_SEC),
     static_cast<__syscall_slong_t>(nsec % NSEC_PER_SEC)
   };
-  clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &t, NULL);
+  return t;
 }
 
 static inline uint64_t RGLGetTime() {
@@ -37,15 +40,36 @@ class IntervalTimerState {
   IntervalTimerState(double interval_sec,
       std::function<void(double)> f)
       : handle_(f), interval_(interval_sec * static_cast<double>(NSEC_PER_SEC)),
+        min_spacing_(interval_ * kMinSpacingRatio), triggered_(false),
+        early_(false),
         frame_counter_(0), frame_count_since_(0) {
+    // sleeps on the monotonic clock like the ticks are measured
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&cond_, &attr);
+    pthread_condattr_destroy(&attr);
+    pthread_mutex_init(&mutex_, nullptr);
     // isolate thread
     running_ = true;
     pthread_create(&thread_, nullptr, RGLIntervalTimerThreadEntry, this);
   }
 
   ~IntervalTimerState() {
+    pthread_mutex_lock(&mutex_);
     running_ = false;
+    pthread_cond_signal(&cond_);
+    pthread_mutex_unlock(&mutex_);
     pthread_join(thread_, NULL);
+    pthread_cond_destroy(&cond_);
+    pthread_mutex_destroy(&mutex_);
+  }
+
+  void Trigger() {
+    pthread_mutex_lock(&mutex_);
+    triggered_ = true;
+    pthread_cond_signal(&cond_);
+    pthread_mutex_unlock(&mutex_);
   }
 
   void Run() {
@@ -66,16 +90,55 @@ class IntervalTimerState {
         // processing
         handle_(local_time * 1.0e-9);
       }
-      RGLAbsoluteSleep(global_time + interval_);
+      Wait(global_time);
     }
   }
 
+  // Sleeps until the next tick of the cadence started at since_, or
+  // until a trigger arrived and the spacing elapsed. Ticks stay at
+  // least the minimum spacing apart, and a full interval after an
+  // early tick, so the rate never exceeds the cadence by more than
+  // the early tick itself. A late tick or an early one skips the grid
+  // point too close to it
+  void Wait(uint64_t tick_time) {
+    const int64_t spacing = early_ ? interval_ : min_spacing_;
+    const uint64_t grid_deadline = NextGridTime(tick_time + spacing);
+    uint64_t deadline = grid_deadline;
+    pthread_mutex_lock(&mutex_);
+    while (running_) {
+      if (triggered_) {
+        deadline = std::min(deadline, tick_time + spacing);
+      }
+      if (RGLGetTime() >= deadline) break;
+      timespec t = RGLTimespec(deadline);
+      pthread_cond_timedwait(&cond_, &mutex_, &t);
+    }
+    triggered_ = false;
+    pthread_mutex_unlock(&mutex_);
+    early_ = deadline < grid_deadline;
+  }
+
  private:
+  // the first tick of the cadence at or after time
+  uint64_t NextGridTime(uint64_t time) const {
+    const uint64_t interval = static_cast<uint64_t>(interval_);
+    const uint64_t ticks = (time - since_ + interval - 1) / interval;
+    return since_ + ticks * interval;
+  }
+
   pthread_t thread_;
+  pthread_mutex_t mutex_;
+  pthread_cond_t cond_;
   // internal state
   volatile bool running_;
   std::function<void(double)> handle_;
   int64_t interval_;
+  int64_t min_spacing_;
+  // guarded by mutex_
+  bool triggered_;
+  // the last tick ran ahead of the cadence, only used by the timer thread
+  bool early_;
+  // start of the cadence, only used by the timer thread
   uint64_t since_;
 
   int64_t frame_counter_;
@@ -89,6 +152,10 @@ IntervalTimer::~IntervalTimer() {
   delete state_;
 }
 
+void IntervalTimer::Trigger() {
+  state_->Trigger();
+}
+
 }  // namespace rigel
 
 void *RGLIntervalTimerThreadEntry(void *state) {
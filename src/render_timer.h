@@ -8,12 +8,19 @@ namespace rigel {
 
 class IntervalTimerState;
 
+// Calls f every delay_sec on a dedicated thread. Trigger runs the next
+// tick early, but never closer than half an interval to the previous
+// one, and the tick after an early one waits a full interval, so the
+// rate stays within the cadence but for a single tick. Untriggered
+// ticks return to the original cadence.
 class IntervalTimer {
  private:
   IntervalTimerState *state_;
  public:
   IntervalTimer(double delay_sec, std::function<void(double)> f);
   ~IntervalTimer();
+  // safe to call from any thread
+  void Trigger();
 };
 
 }  // namespace rigel
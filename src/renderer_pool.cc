@@ -0,0 +1,168 @@
+
+#include "renderer_pool.h"
+#include "render_engine.h"
+#include "logging.inc"
+
+#include <deque>
+
+extern "C" {
+#include <pthread.h>
+void *RGLGraphicsRendererPoolThreadEntry(void *state);
+}
+
+namespace rigel {
+
+namespace {
+
+// frames summarized by the frame time of the stats
+constexpr uint64_t kFrameTimeWindow = 300;
+
+}  // unnamed namespace
+
+class GraphicsRendererPoolState {
+ public:
+  GraphicsRendererPoolState(size_t target_size, uint32_t device_index)
+      : device_index_(device_index), target_size_(target_size), claims_(0),
+        misses_(0), frame_time_summary_(), frames_(0),
+        running_(true) {
+    pthread_mutex_init(&mutex_, nullptr);
+    pthread_cond_init(&cond_, nullptr);
+    pthread_create(&thread_, nullptr, RGLGraphicsRendererPoolThreadEntry,
+        this);
+  }
+
+  ~GraphicsRendererPoolState() {
+    pthread_mutex_lock(&mutex_);
+    running_ = false;
+    pthread_cond_signal(&cond_);
+    pthread_mutex_unlock(&mutex_);
+    // waits for a construction in progress
+    pthread_join(thread_, nullptr);
+    pthread_cond_destroy(&cond_);
+    pthread_mutex_destroy(&mutex_);
+  }
+
+  std::unique_ptr<GraphicsRenderer> Claim() {
+    pthread_mutex_lock(&mutex_);
+    claims_++;
+    if (ready_.empty()) {
+      misses_++;
+      pthread_mutex_unlock(&mutex_);
+      RGL_WARN("renderer pool empty, constructing in place");
+      return std::unique_ptr<GraphicsRenderer>(
+          new GraphicsRenderer(device_index_));
+    }
+    std::unique_ptr<GraphicsRenderer> renderer = std::move(ready_.front());
+    ready_.pop_front();
+    pthread_cond_signal(&cond_);
+    pthread_mutex_unlock(&mutex_);
+    return renderer;
+  }
+
+  void SetTargetSize(size_t target_size) {
+    pthread_mutex_lock(&mutex_);
+    target_size_ = target_size;
+    // surplus renderers are released outside the lock
+    std::deque<std::unique_ptr<GraphicsRenderer>> surplus;
+    while (ready_.size() > target_size_) {
+      surplus.push_back(std::move(ready_.back()));
+      ready_.pop_back();
+    }
+    pthread_cond_signal(&cond_);
+    pthread_mutex_unlock(&mutex_);
+  }
+
+  uint32_t DeviceIndex() const { return device_index_; }
+
+  void RecordFrameTime(int64_t frame_time_us) {
+    pthread_mutex_lock(&mutex_);
+    frame_time_.Add(frame_time_us);
+    // the last full window is reported, so old load fades out
+    if (frame_time_.Count() >= kFrameTimeWindow) {
+      frame_time_summary_ = frame_time_.Summarize();
+      frame_time_.Reset();
+    }
+    frames_++;
+    pthread_mutex_unlock(&mutex_);
+  }
+
+  GraphicsRendererPoolStats GetStats() {
+    pthread_mutex_lock(&mutex_);
+    GraphicsRendererPoolStats stats;
+    stats.ready = ready_.size();
+    stats.claims = claims_;
+    stats.misses = misses_;
+    stats.frame_time = frame_time_summary_.count > 0 ?
+        frame_time_summary_ : frame_time_.Summarize();
+    stats.frames = frames_;
+    pthread_mutex_unlock(&mutex_);
+    return stats;
+  }
+
+  void Run() {
+    pthread_mutex_lock(&mutex_);
+    while (true) {
+      while (running_ && ready_.size() >= target_size_) {
+        pthread_cond_wait(&cond_, &mutex_);
+      }
+      if (!running_) break;
+      pthread_mutex_unlock(&mutex_);
+      // constructing takes long, claims go on meanwhile
+      std::unique_ptr<GraphicsRenderer> renderer(
+          new GraphicsRenderer(device_index_));
+      pthread_mutex_lock(&mutex_);
+      ready_.push_back(std::move(renderer));
+    }
+    std::deque<std::unique_ptr<GraphicsRenderer>> ready = std::move(ready_);
+    pthread_mutex_unlock(&mutex_);
+  }
+
+ private:
+  const uint32_t device_index_;
+  pthread_t thread_;
+  pthread_mutex_t mutex_;
+  pthread_cond_t cond_;
+  std::deque<std::unique_ptr<GraphicsRenderer>> ready_;
+  size_t target_size_;
+  uint64_t claims_;
+  uint64_t misses_;
+  LatencyHistogram frame_time_;
+  LatencySummary frame_time_summary_;
+  uint64_t frames_;
+  bool running_;
+};
+
+GraphicsRendererPool::GraphicsRendererPool(size_t target_size,
+    uint32_t device_index)
+    : state_(new GraphicsRendererPoolState(target_size, device_index)) {}
+
+GraphicsRendererPool::~GraphicsRendererPool() {
+  delete state_;
+}
+
+std::unique_ptr<GraphicsRenderer> GraphicsRendererPool::Claim() {
+  return state_->Claim();
+}
+
+void GraphicsRendererPool::SetTargetSize(size_t target_size) {
+  state_->SetTargetSize(target_size);
+}
+
+uint32_t GraphicsRendererPool::DeviceIndex() const {
+  return state_->DeviceIndex();
+}
+
+void GraphicsRendererPool::RecordFrameTime(int64_t frame_time_us) {
+  state_->RecordFrameTime(frame_time_us);
+}
+
+GraphicsRendererPoolStats GraphicsRendererPool::GetStats() const {
+  return state_->GetStats();
+}
+
+}  // namespace rigel
+
+void *RGLGraphicsRendererPoolThreadEntry(void *state) {
+  static_cast<rigel::GraphicsRendererPoolState *>(state)->Run();
+  return 0;
+}
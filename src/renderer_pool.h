@@ -0,0 +1,55 @@
+
+#ifndef RIGEL_GRAPHICS_RENDERER_POOL_H_
+#define RIGEL_GRAPHICS_RENDERER_POOL_H_
+
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+
+#include "frame_trace.h"
+
+namespace rigel {
+
+class GraphicsRenderer;
+class GraphicsRendererPoolState;
+
+struct GraphicsRendererPoolStats {
+  // renderers constructed and waiting to be claimed
+  size_t ready;
+  uint64_t claims;
+  // claims that found the pool empty and constructed in place
+  uint64_t misses;
+  // time of the recent ticks of every renderer claimed from the pool,
+  // from the start of rendering to the delivery of the frame
+  LatencySummary frame_time;
+  // ticks recorded so far, by every claimed renderer
+  uint64_t frames;
+};
+
+// Renderers constructed ahead of time on a background thread, so a new
+// session does not wait for the Vulkan device and pipelines to be set
+// up. Claimed renderers are replaced in the background until the pool
+// holds target_size of them again. A pool serves a single device.
+class GraphicsRendererPool {
+ public:
+  explicit GraphicsRendererPool(size_t target_size,
+      uint32_t device_index = 0);
+  explicit GraphicsRendererPool(const GraphicsRendererPool &) = delete;
+  ~GraphicsRendererPool();
+
+  // a ready renderer, or one constructed on the calling thread when
+  // none is. Safe to call from any thread
+  std::unique_ptr<GraphicsRenderer> Claim();
+  void SetTargetSize(size_t target_size);
+  uint32_t DeviceIndex() const;
+  // called by the claiming instances every frame, from any thread
+  void RecordFrameTime(int64_t frame_time_us);
+  GraphicsRendererPoolStats GetStats() const;
+
+ private:
+  GraphicsRendererPoolState *state_;
+};
+
+}  // namespace rigel
+
+#endif  // RIGEL_GRAPHICS_RENDERER_POOL_H_
@@ -0,0 +1,73 @@
+
+#ifndef RIGEL_RTC_OPTIONS_H_
+#define RIGEL_RTC_OPTIONS_H_
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <cstddef>
+
+#include "bitrate_policy.h"
+
+namespace rigel {
+
+enum EncoderContent {
+  // rendered 3D content, favors encode speed
+  kEncoderContentRealtime = 0,
+  // text and UI, favors sharpness and tolerates frame drops
+  kEncoderContentScreen,
+};
+
+struct EncoderOptions {
+  EncoderOptions();
+
+  // SDP codec names, most preferred first. Codecs the built-in factory
+  // supports but that are not listed are offered after them
+  std::vector<std::string> codec_preference;
+  // encoder threads shared by all sessions of the process,
+  // 0 for one per online processor. The first factory sets it
+  int thread_budget;
+  // encoders expected to run at once, each takes this share of the
+  // thread budget for its lifetime
+  int max_encoders;
+  EncoderContent content;
+};
+
+enum RTCThreadAssignment {
+  // groups take new sessions in turn
+  kRTCThreadAssignmentRoundRobin = 0,
+  // the group with the fewest channels takes a new session
+  kRTCThreadAssignmentLeastLoaded,
+};
+
+struct RTCThreadOptions {
+  RTCThreadOptions();
+
+  // 0 for one per two online processors
+  size_t groups;
+  RTCThreadAssignment assignment;
+  // binds the network and worker threads of each group to a processor
+  bool pin_threads;
+  // Threads setting up and tearing down sessions. A setup constructs
+  // the renderer when the warm pool is empty, which holds its thread
+  // for a while. 0 for one per online processor, at least 4
+  size_t setup_threads;
+};
+
+// Configuration of the RTC side of the server, set by the operator and
+// handed from the signaling context to every instance it creates.
+struct RTCOptions {
+  RTCOptions() : requestable_tiers({ "basic", "standard" }) {}
+
+  EncoderOptions encoder;
+  RTCThreadOptions threads;
+  // policies by tier, replacing the built-in ones of the same name
+  std::unordered_map<std::string, BitratePolicy> bitrate_policies;
+  // Tiers a client may ask for in "start", which is not authenticated.
+  // Other tiers fall back to the default one
+  std::vector<std::string> requestable_tiers;
+};
+
+}  // namespace rigel
+
+#endif  // RIGEL_RTC_OPTIONS_H_
@@ -0,0 +1,320 @@
+
+#include "session_admission.h"
+#include "logging.inc"
+
+#include <deque>
+#include <unordered_map>
+
+extern "C" {
+#include <pthread.h>
+}
+
+namespace rigel {
+
+namespace {
+
+struct AdmittedSession {
+  size_t device;
+  size_t peers;
+};
+
+struct QueuedRequest {
+  std::string peer;
+  SessionOptions options;
+};
+
+// frames each session of a device renders before it takes another one
+constexpr uint64_t kSettlingFrames = 10;
+
+}  // unnamed namespace
+
+SessionAdmissionLimits::SessionAdmissionLimits()
+    : max_sessions(8),
+      session_memory_bytes(256ull * 1024 * 1024),
+      memory_reserve(0.1),
+      // frames are due every 33ms
+      frame_budget_us(25000),
+      max_queue(16) {}
+
+class SessionAdmissionState {
+ public:
+  SessionAdmissionState(RenderDeviceMonitorInterface *monitor,
+      const SessionAdmissionLimits &limits)
+      : monitor_(monitor), limits_(limits),
+        device_sessions_(monitor->DeviceCount(), 0),
+        settling_(monitor->DeviceCount(), false),
+        settling_frames_(monitor->DeviceCount(), 0) {
+    pthread_mutex_init(&mutex_, nullptr);
+  }
+
+  ~SessionAdmissionState() {
+    pthread_mutex_destroy(&mutex_);
+  }
+
+  SessionAdmission Request(const std::string &peer,
+      const SessionOptions &options) {
+    pthread_mutex_lock(&mutex_);
+    SessionAdmission admission = Decide(peer, options);
+    pthread_mutex_unlock(&mutex_);
+    if (admission.result == kSessionQueued) {
+      RGL_INFO(peer + " queued at " + std::to_string(admission.position) +
+          ", " + admission.reason);
+    } else if (admission.result == kSessionRejected) {
+      RGL_WARN(peer + " rejected, " + admission.reason);
+    }
+    return admission;
+  }
+
+  std::vector<SessionAdmissionUpdate> Release(const std::string &peer) {
+    pthread_mutex_lock(&mutex_);
+    bool changed = false;
+    const auto it = peers_.find(peer);
+    if (it != peers_.end()) {
+      const auto session = sessions_.find(it->second);
+      if (--session->second.peers == 0) {
+        const size_t device = session->second.device;
+        // an idle device renders no frames
+        if (--device_sessions_[device] == 0) settling_[device] = false;
+        sessions_.erase(session);
+      }
+      peers_.erase(it);
+    } else {
+      for (auto queued = queue_.begin(); queued != queue_.end(); ++queued) {
+        if (queued->peer == peer) {
+          queue_.erase(queued);
+          changed = true;
+          break;
+        }
+      }
+    }
+    std::vector<SessionAdmissionUpdate> updates = Drain(changed);
+    pthread_mutex_unlock(&mutex_);
+    return updates;
+  }
+
+  std::vector<SessionAdmissionUpdate> Poll() {
+    pthread_mutex_lock(&mutex_);
+    std::vector<SessionAdmissionUpdate> updates = Drain(false);
+    pthread_mutex_unlock(&mutex_);
+    return updates;
+  }
+
+  bool Admitted(const std::string &peer) {
+    pthread_mutex_lock(&mutex_);
+    const bool admitted = peers_.count(peer) > 0;
+    pthread_mutex_unlock(&mutex_);
+    return admitted;
+  }
+
+  size_t QueueLength() {
+    pthread_mutex_lock(&mutex_);
+    size_t length = queue_.size();
+    pthread_mutex_unlock(&mutex_);
+    return length;
+  }
+
+ private:
+  // must hold the lock
+  SessionAdmission Decide(const std::string &peer,
+      const SessionOptions &options) {
+    SessionAdmission admission;
+    admission.position = 0;
+    admission.options = options;
+    // a repeated start keeps its place
+    const auto admitted = peers_.find(peer);
+    if (admitted != peers_.end()) {
+      admission.result = kSessionAdmitted;
+      admission.options.device = sessions_[admitted->second].device;
+      return admission;
+    }
+    for (size_t i = 0; i < queue_.size(); i++) {
+      if (queue_[i].peer == peer) {
+        admission.result = kSessionQueued;
+        admission.position = i + 1;
+        admission.reason = "queue";
+        return admission;
+      }
+    }
+    // requests already waiting go first, unless joining
+    const bool joining = sessions_.count(options.SessionFor(peer)) > 0;
+    if ((joining || queue_.empty()) && TryAdmit(peer, &admission.options,
+        &admission.reason)) {
+      admission.result = kSessionAdmitted;
+      return admission;
+    }
+    if (admission.reason.empty()) admission.reason = "queue";
+    if (queue_.size() >= limits_.max_queue) {
+      admission.result = kSessionRejected;
+      if (limits_.max_queue > 0) admission.reason = "queue";
+      return admission;
+    }
+    queue_.push_back(QueuedRequest { peer, options });
+    admission.result = kSessionQueued;
+    admission.position = queue_.size();
+    return admission;
+  }
+
+  // must hold the lock
+  bool TryAdmit(const std::string &peer, SessionOptions *options,
+      std::string *reason) {
+    const std::string session = options->SessionFor(peer);
+    auto joined = sessions_.find(session);
+    if (joined != sessions_.end()) {
+      // joining adds no rendering
+      joined->second.peers++;
+      options->device = joined->second.device;
+      peers_[peer] = session;
+      return true;
+    }
+    size_t device = 0;
+    if (!SelectDevice(&device, reason)) return false;
+    device_sessions_[device]++;
+    settling_[device] = true;
+    settling_frames_[device] = monitor_->GetDeviceStatus(device).frames +
+        kSettlingFrames * device_sessions_[device];
+    sessions_[session] = AdmittedSession { device, 1 };
+    options->device = device;
+    peers_[peer] = session;
+    return true;
+  }
+
+  // must hold the lock. The least loaded device with room, otherwise
+  // reason is the limit the least loaded one reached
+  bool SelectDevice(size_t *device, std::string *reason) {
+    bool found = false;
+    size_t least_sessions = 0;
+    for (size_t i = 0; i < device_sessions_.size(); i++) {
+      const size_t sessions = device_sessions_[i];
+      if (found && sessions >= least_sessions) continue;
+      const char *limit = nullptr;
+      if (Settling(i)) {
+        limit = "frame_time";
+      } else {
+        limit = LimitReached(i);
+      }
+      if (limit != nullptr) {
+        if (!found && (reason->empty() || sessions < least_sessions)) {
+          *reason = limit;
+          least_sessions = sessions;
+        }
+        continue;
+      }
+      found = true;
+      least_sessions = sessions;
+      *device = i;
+    }
+    return found;
+  }
+
+  // must hold the lock. A device settles from admitting a session until
+  // each of its sessions rendered a few frames, so a burst of requests
+  // is spread out and the frame time catches up with the new load
+  bool Settling(size_t device) {
+    if (!settling_[device]) return false;
+    const RenderDeviceStatus status = monitor_->GetDeviceStatus(device);
+    if (status.frames >= settling_frames_[device]) {
+      settling_[device] = false;
+    }
+    return settling_[device];
+  }
+
+  // must hold the lock, null when the device takes another session
+  const char *LimitReached(size_t device) {
+    const size_t sessions = device_sessions_[device];
+    if (sessions >= limits_.max_sessions) return "sessions";
+    const RenderDeviceStatus status = monitor_->GetDeviceStatus(device);
+    if (status.memory_bytes > 0) {
+      const double usable =
+          status.memory_bytes * (1.0 - limits_.memory_reserve);
+      if ((sessions + 1) * limits_.session_memory_bytes > usable) {
+        return "memory";
+      }
+    }
+    // an idle device reports the load of sessions long closed
+    if (sessions > 0 && status.frame_time.count > 0 &&
+        status.frame_time.p95_us > limits_.frame_budget_us) {
+      return "frame_time";
+    }
+    return nullptr;
+  }
+
+  // must hold the lock. Admits waiting requests in order while they
+  // fit, and tells the others their position when the queue moved
+  std::vector<SessionAdmissionUpdate> Drain(bool changed) {
+    std::vector<SessionAdmissionUpdate> updates;
+    while (!queue_.empty()) {
+      QueuedRequest &request = queue_.front();
+      SessionAdmissionUpdate update;
+      update.peer = request.peer;
+      update.admission.options = request.options;
+      update.admission.position = 0;
+      if (!TryAdmit(request.peer, &update.admission.options,
+          &update.admission.reason)) {
+        break;
+      }
+      update.admission.result = kSessionAdmitted;
+      update.admission.reason.clear();
+      RGL_INFO(request.peer + " admitted from the queue");
+      updates.push_back(std::move(update));
+      queue_.pop_front();
+      changed = true;
+    }
+    if (!changed) return updates;
+    for (size_t i = 0; i < queue_.size(); i++) {
+      SessionAdmissionUpdate update;
+      update.peer = queue_[i].peer;
+      update.admission.result = kSessionQueued;
+      update.admission.position = i + 1;
+      update.admission.reason = "queue";
+      update.admission.options = queue_[i].options;
+      updates.push_back(std::move(update));
+    }
+    return updates;
+  }
+
+  RenderDeviceMonitorInterface *monitor_;
+  const SessionAdmissionLimits limits_;
+  pthread_mutex_t mutex_;
+  // admitted peers and the session they are in
+  std::unordered_map<std::string, std::string> peers_;
+  std::unordered_map<std::string, AdmittedSession> sessions_;
+  std::vector<size_t> device_sessions_;
+  // see Settling
+  std::vector<bool> settling_;
+  // frame count of the device at which settling ends
+  std::vector<uint64_t> settling_frames_;
+  std::deque<QueuedRequest> queue_;
+};
+
+SessionAdmissionController::SessionAdmissionController(
+    RenderDeviceMonitorInterface *monitor,
+    const SessionAdmissionLimits &limits)
+    : state_(new SessionAdmissionState(monitor, limits)) {}
+
+SessionAdmissionController::~SessionAdmissionController() {
+  delete state_;
+}
+
+SessionAdmission SessionAdmissionController::Request(
+    const std::string &peer, const SessionOptions &options) {
+  return state_->Request(peer, options);
+}
+
+std::vector<SessionAdmissionUpdate> SessionAdmissionController::Release(
+    const std::string &peer) {
+  return state_->Release(peer);
+}
+
+std::vector<SessionAdmissionUpdate> SessionAdmissionController::Poll() {
+  return state_->Poll();
+}
+
+bool SessionAdmissionController::Admitted(const std::string &peer) const {
+  return state_->Admitted(peer);
+}
+
+size_t SessionAdmissionController::QueueLength() const {
+  return state_->QueueLength();
+}
+
+}  // namespace rigel
@@ -0,0 +1,88 @@
+
+#ifndef RIGEL_BASE_SESSION_ADMISSION_H_
+#define RIGEL_BASE_SESSION_ADMISSION_H_
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#include "channel.h"
+#include "render.h"
+
+namespace rigel {
+
+class SessionAdmissionState;
+
+// what a single GPU may take before new sessions wait
+struct SessionAdmissionLimits {
+  SessionAdmissionLimits();
+
+  size_t max_sessions;
+  // device memory a session is expected to hold
+  uint64_t session_memory_bytes;
+  // share of the device memory never planned for sessions
+  double memory_reserve;
+  // p95 frame time of the device above which it takes no new session
+  int64_t frame_budget_us;
+  // requests waiting for capacity, further ones are rejected
+  size_t max_queue;
+};
+
+enum SessionAdmissionResult {
+  kSessionAdmitted = 0,
+  kSessionQueued,
+  kSessionRejected,
+};
+
+// answer to a "start" request, sent to the peer unless admitted at once
+struct SessionAdmission {
+  SessionAdmissionResult result;
+  // 1 for the next to be admitted, when queued
+  size_t position;
+  // the limit that was reached, when queued or rejected
+  std::string reason;
+  // the request, with the device assigned once admitted
+  SessionOptions options;
+};
+
+// a change to a queued request, for the peer that made it
+struct SessionAdmissionUpdate {
+  std::string peer;
+  SessionAdmission admission;
+};
+
+// Decides which GPU renders a new session and whether it may start now.
+// A device takes sessions while it is under the session count, the
+// memory planned for them fits and its measured frame time is within
+// budget; the least loaded of those is chosen. Peers joining a running
+// session are always admitted since they add no rendering. Requests
+// that fit nowhere wait in order, and are admitted as sessions close or
+// the frame time recovers. All methods are safe to call from any thread.
+class SessionAdmissionController {
+ public:
+  SessionAdmissionController(RenderDeviceMonitorInterface *monitor,
+      const SessionAdmissionLimits &limits = SessionAdmissionLimits());
+  explicit SessionAdmissionController(
+      const SessionAdmissionController &) = delete;
+  ~SessionAdmissionController();
+
+  SessionAdmission Request(const std::string &peer,
+      const SessionOptions &options);
+  // the peer closed or left the queue, requests it made room for are
+  // admitted, and the ones still waiting learn their new position
+  std::vector<SessionAdmissionUpdate> Release(const std::string &peer);
+  // admits the waiting requests that fit now
+  std::vector<SessionAdmissionUpdate> Poll();
+
+  // false once the peer is released
+  bool Admitted(const std::string &peer) const;
+  size_t QueueLength() const;
+
+ private:
+  SessionAdmissionState *state_;
+};
+
+}  // namespace rigel
+
+#endif  // RIGEL_BASE_SESSION_ADMISSION_H_
@@ -0,0 +1,65 @@
+
+#include "session_rtc.h"
+#include "logging.inc"
+
+namespace rigel {
+
+RTCSession::RTCSession(const std::string &identifier, RTCThreadGroup *group,
+    const rtc::scoped_refptr<webrtc::PeerConnectionFactoryInterface> &factory,
+    const BitratePolicy &policy,
+    RenderInstanceFactoryInterface *render_instance_factory, size_t device)
+    : identifier_(identifier), group_(group), factory_(factory),
+      policy_(policy), rendering_(false) {
+  RGL_INFO("Creating RTCSession " + identifier + " on thread group " +
+      std::to_string(group->Index()) + ", GPU " + std::to_string(device));
+  // video capturer
+  video_capturer_ = new VideoCapturer();
+  // renderer
+  render_instance_ = render_instance_factory->CreateInstance(video_capturer_,
+      device);
+  // capture source
+  std::unique_ptr<
+      rtc::VideoSourceInterface<webrtc::VideoFrame>> source(video_capturer_);
+  track_source_ = CapturerTrackSource::Create(std::move(source));
+}
+
+RTCSession::~RTCSession() {
+  RGL_INFO("Releasing RTCSession " + identifier_);
+  render_instance_->StopRendering();
+  render_instance_ = nullptr;
+  track_source_ = nullptr;
+  factory_ = nullptr;
+}
+
+void RTCSession::Acquire() {
+  rtc::CritScope lock(&acquire_lock_);
+  if (rendering_) return;
+  video_capturer_->Initialize();
+  render_instance_->StartRendering();
+  rendering_ = true;
+}
+
+void RTCSession::RepeatLastFrame() {
+  video_capturer_->RepeatLastFrame();
+}
+
+std::shared_ptr<RTCSession> RTCSessionRegistry::Find(
+    const std::string &identifier) {
+  // drop the sessions whose last peer has left
+  for (auto it = sessions_.begin(); it != sessions_.end();) {
+    if (it->second.expired()) {
+      it = sessions_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  auto it = sessions_.find(identifier);
+  if (it == sessions_.end()) return nullptr;
+  return it->second.lock();
+}
+
+void RTCSessionRegistry::Add(const std::shared_ptr<RTCSession> &session) {
+  sessions_[session->Identifier()] = session;
+}
+
+}  // namespace rigel
@@ -0,0 +1,82 @@
+
+#ifndef RIGEL_RTC_SESSION_H_
+#define RIGEL_RTC_SESSION_H_
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#include "api/scoped_refptr.h"
+#include "api/peer_connection_interface.h"
+#include "rtc_base/critical_section.h"
+
+#include "capture_rtc.h"
+#include "capture_track_source.h"
+#include "render.h"
+#include "bitrate_policy.h"
+#include "thread_group_rtc.h"
+
+namespace rigel {
+
+// A renderer and the capturer it draws into, watched by every peer
+// that joined the session. Each peer track is another sink of the
+// capturer, so the view is rendered and converted once however many
+// peers watch it. The connections of the peers are created by the
+// factory of the session, which decides how their video is encoded.
+class RTCSession {
+ public:
+  RTCSession(const std::string &identifier, RTCThreadGroup *group,
+      const rtc::scoped_refptr<webrtc::PeerConnectionFactoryInterface> &,
+      const BitratePolicy &policy,
+      RenderInstanceFactoryInterface *render_instance_factory,
+      size_t device);
+  explicit RTCSession(const RTCSession &) = delete;
+  ~RTCSession();
+
+  const std::string &Identifier() const { return identifier_; }
+  RTCThreadGroup *Group() { return group_; }
+  rtc::scoped_refptr<webrtc::PeerConnectionFactoryInterface> &Factory() {
+    return factory_;
+  }
+  rtc::scoped_refptr<CapturerTrackSource> &TrackSource() {
+    return track_source_;
+  }
+  RenderInstanceInterface *Renderer() { return render_instance_.get(); }
+  // applied to every peer of the session
+  const BitratePolicy &Policy() const { return policy_; }
+
+  // starts rendering on the first call, from any of the peers
+  void Acquire();
+  // hands the last rendered frame again to every peer of the session
+  void RepeatLastFrame();
+
+ private:
+  std::string identifier_;
+  RTCThreadGroup *group_;
+  rtc::scoped_refptr<webrtc::PeerConnectionFactoryInterface> factory_;
+  BitratePolicy policy_;
+  rtc::scoped_refptr<CapturerTrackSource> track_source_;
+  VideoCapturer *video_capturer_;
+  std::unique_ptr<RenderInstanceInterface> render_instance_;
+  rtc::CriticalSection acquire_lock_;
+  bool rendering_;
+};
+
+// Sessions by identifier. The channels of the peers hold the sessions,
+// which end when the last of them is closed.
+class RTCSessionRegistry {
+ public:
+  RTCSessionRegistry() = default;
+  explicit RTCSessionRegistry(const RTCSessionRegistry &) = delete;
+
+  // nullptr when no peer watches a session of that identifier
+  std::shared_ptr<RTCSession> Find(const std::string &identifier);
+  void Add(const std::shared_ptr<RTCSession> &session);
+
+ private:
+  std::unordered_map<std::string, std::weak_ptr<RTCSession>> sessions_;
+};
+
+}  // namespace rigel
+
+#endif  // RIGEL_RTC_SESSION_H_
@@ -0,0 +1,164 @@
+
+#include "setup_executor.h"
+
+#include <deque>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+
+extern "C" {
+#include <pthread.h>
+void *RGLSetupExecutorThreadEntry(void *state);
+}
+
+namespace rigel {
+
+namespace {
+
+struct SetupTask {
+  std::function<void()> function;
+  int64_t posted_us;
+};
+
+}  // unnamed namespace
+
+class SetupExecutorState {
+ public:
+  explicit SetupExecutorState(size_t thread_count)
+      : depth_(0), max_depth_(0), executed_(0), running_(true) {
+    pthread_mutex_init(&mutex_, nullptr);
+    pthread_cond_init(&cond_, nullptr);
+    threads_.resize(std::max<size_t>(1, thread_count));
+    for (auto &thread : threads_) {
+      pthread_create(&thread, nullptr, RGLSetupExecutorThreadEntry, this);
+    }
+  }
+
+  ~SetupExecutorState() {
+    Stop();
+    pthread_cond_destroy(&cond_);
+    pthread_mutex_destroy(&mutex_);
+  }
+
+  void Stop() {
+    pthread_mutex_lock(&mutex_);
+    running_ = false;
+    pthread_cond_broadcast(&cond_);
+    std::vector<pthread_t> threads = std::move(threads_);
+    threads_.clear();
+    pthread_mutex_unlock(&mutex_);
+    for (auto &thread : threads) {
+      pthread_join(thread, nullptr);
+    }
+  }
+
+  void Post(const std::string &key, std::function<void()> function) {
+    pthread_mutex_lock(&mutex_);
+    if (!running_) {
+      pthread_mutex_unlock(&mutex_);
+      return;
+    }
+    // a key stays scheduled while one of its tasks runs, so the next
+    // one is only picked up after it
+    auto it = queues_.find(key);
+    if (it == queues_.end()) {
+      it = queues_.emplace(key, std::deque<SetupTask>()).first;
+      ready_.push_back(key);
+      pthread_cond_signal(&cond_);
+    }
+    it->second.push_back(SetupTask { std::move(function),
+        FrameTraceNowMicros() });
+    depth_++;
+    max_depth_ = std::max(max_depth_, depth_);
+    pthread_mutex_unlock(&mutex_);
+  }
+
+  SetupExecutorStats GetStats() {
+    pthread_mutex_lock(&mutex_);
+    SetupExecutorStats stats;
+    stats.depth = depth_;
+    stats.max_depth = max_depth_;
+    stats.executed = executed_;
+    stats.wait = wait_.Summarize();
+    stats.latency = latency_.Summarize();
+    pthread_mutex_unlock(&mutex_);
+    return stats;
+  }
+
+  void Run() {
+    pthread_mutex_lock(&mutex_);
+    while (true) {
+      while (running_ && ready_.empty()) {
+        pthread_cond_wait(&cond_, &mutex_);
+      }
+      if (!running_) break;
+      std::string key = std::move(ready_.front());
+      ready_.pop_front();
+      SetupTask task = std::move(queues_[key].front());
+      queues_[key].pop_front();
+      const int64_t started_us = FrameTraceNowMicros();
+      wait_.Add(started_us - task.posted_us);
+      pthread_mutex_unlock(&mutex_);
+
+      task.function();
+      const int64_t finished_us = FrameTraceNowMicros();
+      // released outside the lock, it may own a session
+      task.function = nullptr;
+
+      pthread_mutex_lock(&mutex_);
+      latency_.Add(finished_us - task.posted_us);
+      executed_++;
+      depth_--;
+      auto it = queues_.find(key);
+      if (it->second.empty()) {
+        queues_.erase(it);
+      } else {
+        ready_.push_back(std::move(key));
+        pthread_cond_signal(&cond_);
+      }
+    }
+    pthread_mutex_unlock(&mutex_);
+  }
+
+ private:
+  std::vector<pthread_t> threads_;
+  pthread_mutex_t mutex_;
+  pthread_cond_t cond_;
+  // pending tasks of every scheduled key
+  std::unordered_map<std::string, std::deque<SetupTask>> queues_;
+  // keys with a task to run and none running
+  std::deque<std::string> ready_;
+  size_t depth_;
+  size_t max_depth_;
+  uint64_t executed_;
+  LatencyHistogram wait_;
+  LatencyHistogram latency_;
+  bool running_;
+};
+
+SetupExecutor::SetupExecutor(size_t thread_count)
+    : state_(new SetupExecutorState(thread_count)) {}
+
+SetupExecutor::~SetupExecutor() {
+  delete state_;
+}
+
+void SetupExecutor::Post(const std::string &key,
+    std::function<void()> task) {
+  state_->Post(key, std::move(task));
+}
+
+void SetupExecutor::Stop() {
+  state_->Stop();
+}
+
+SetupExecutorStats SetupExecutor::GetStats() const {
+  return state_->GetStats();
+}
+
+}  // namespace rigel
+
+void *RGLSetupExecutorThreadEntry(void *state) {
+  static_cast<rigel::SetupExecutorState *>(state)->Run();
+  return 0;
+}
@@ -0,0 +1,50 @@
+
+#ifndef RIGEL_BASE_SETUP_EXECUTOR_H_
+#define RIGEL_BASE_SETUP_EXECUTOR_H_
+
+#include <string>
+#include <functional>
+#include <cstdint>
+#include <cstddef>
+
+#include "frame_trace.h"
+
+namespace rigel {
+
+class SetupExecutorState;
+
+struct SetupExecutorStats {
+  // tasks posted and not finished yet, running ones included
+  size_t depth;
+  size_t max_depth;
+  uint64_t executed;
+  // from posting to the start of the task
+  LatencySummary wait;
+  // from posting to the end of the task
+  LatencySummary latency;
+};
+
+// Runs session setup and teardown away from the signaling I/O thread.
+// Tasks posted with the same key run one at a time in posting order,
+// tasks of different keys run in parallel on the executor threads.
+class SetupExecutor {
+ public:
+  explicit SetupExecutor(size_t thread_count);
+  explicit SetupExecutor(const SetupExecutor &) = delete;
+  // stops first when not stopped yet
+  ~SetupExecutor();
+
+  // safe to call from any thread, including a task
+  void Post(const std::string &key, std::function<void()> task);
+  // drops the tasks not started yet and waits for the running ones,
+  // which may still post. Later tasks are dropped too
+  void Stop();
+  SetupExecutorStats GetStats() const;
+
+ private:
+  SetupExecutorState *state_;
+};
+
+}  // namespace rigel
+
+#endif  // RIGEL_BASE_SETUP_EXECUTOR_H_
@@ -9,8 +9,10 @@ using DefaultSignalingStrategy = ::rigel::SignalingStrategyWebSocket;
 
 SignalingContext::SignalingContext(const std::string &hostname,
                                    const std::string &port,
-                                   const std::string &path)
-    : strategy_(new DefaultSignalingStrategy(this, hostname, port, path)) {}
+                                   const std::string &path,
+                                   const RTCOptions &rtc_options)
+    : rtc_options_(rtc_options),
+      strategy_(new DefaultSignalingStrategy(this, hostname, port, path)) {}
 
 SignalingContext::~SignalingContext() {}
 
@@ -21,7 +23,7 @@ void SignalingContext::Run() {
 std::unique_ptr<SignalingInstanceInterface> SignalingContext::CreateInstance(
     std::unique_ptr<SignalingControlInterface> control) {
   return std::unique_ptr<SignalingInstanceInterface>(
-    new SignalingInstance(std::move(control)));
+    new SignalingInstance(std::move(control), rtc_options_));
 }
 
 }  // namespace rigel
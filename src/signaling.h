@@ -7,13 +7,16 @@
 
 #include "signaling_strategy.h"
 #include "signaling_sink.h"
+#include "rtc_options.h"
 
 namespace rigel {
 
 class SignalingContext : public SignalingInstanceFactoryInterface {
  public:
+  // every instance it creates runs with rtc_options
   SignalingContext(const std::string &hostname,
-      const std::string &port, const std::string &path);
+      const std::string &port, const std::string &path,
+      const RTCOptions &rtc_options = RTCOptions());
   explicit SignalingContext(const SignalingContext &) = delete;
   ~SignalingContext();
 
@@ -23,6 +26,7 @@ class SignalingContext : public SignalingInstanceFactoryInterface {
       std::unique_ptr<SignalingControlInterface> control) override;
 
  private:
+  const RTCOptions rtc_options_;
   std::unique_ptr<SignalingStrategy> strategy_;
 };
 
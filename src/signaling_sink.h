@@ -4,6 +4,7 @@
 
 #include <string>
 #include <memory>
+#include <cstddef>
 
 namespace rigel {
 
@@ -15,7 +16,8 @@ struct SignalingControlInterface {
 struct SignalingInstanceInterface {
   virtual ~SignalingInstanceInterface() = default;
   virtual void Initialize() = 0;
-  virtual void ReceiveMessage(const std::string &message) = 0;
+  // message is valid during the call only, and may be modified in place
+  virtual void ReceiveMessage(char *message, size_t size) = 0;
 };
 
 struct SignalingInstanceFactoryInterface {
@@ -33,12 +33,12 @@ void SignalingStrategyWebSocket::OnHandshake(WebSocketInterface *ws)  {
 
 void SignalingStrategyWebSocket::OnReceiveMessage(
     WebSocketInterface *connection,
-    const std::string &message) {
+    char *message, size_t size) {
   if (!instance_) {
     RGL_WARN("instance not found");
     return;
   }
-  instance_->ReceiveMessage(message);
+  instance_->ReceiveMessage(message, size);
 }
 
 void SignalingStrategyWebSocket::OnRelease(WebSocketInterface *connection) {
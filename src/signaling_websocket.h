@@ -31,7 +31,7 @@ class SignalingStrategyWebSocket : public SignalingStrategy,
   // WebSocketSink
   void OnHandshake(WebSocketInterface *ws) override;
   void OnReceiveMessage(WebSocketInterface *connection,
-      const std::string &message) override;
+      char *message, size_t size) override;
   void OnRelease(WebSocketInterface *connection) override;
 
  private:
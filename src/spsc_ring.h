@@ -0,0 +1,75 @@
+
+#ifndef RIGEL_BASE_SPSC_RING_H_
+#define RIGEL_BASE_SPSC_RING_H_
+
+#include <atomic>
+#include <cstddef>
+
+namespace rigel {
+
+// Fixed-capacity ring for exactly one producer thread and one consumer
+// thread. Push and Pop never allocate or block; Push fails when the ring
+// is full. Each side caches the other side's index and only reloads it
+// when the ring looks full or empty, and the indices live on separate
+// cache lines.
+template <typename T, size_t Capacity>
+class SpscRing {
+  static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0,
+      "SpscRing capacity must be a power of two");
+
+ public:
+  SpscRing() : head_(0), tail_cache_(0), tail_(0), head_cache_(0) {}
+  explicit SpscRing(const SpscRing &) = delete;
+
+  static constexpr size_t kCapacity = Capacity;
+
+  // producer only
+  bool Push(const T &value) {
+    const size_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail - head_cache_ == Capacity) {
+      head_cache_ = head_.load(std::memory_order_acquire);
+      if (tail - head_cache_ == Capacity) return false;
+    }
+    items_[tail & (Capacity - 1)] = value;
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  // consumer only
+  bool Pop(T *value) {
+    const size_t head = head_.load(std::memory_order_relaxed);
+    if (head == tail_cache_) {
+      tail_cache_ = tail_.load(std::memory_order_acquire);
+      if (head == tail_cache_) return false;
+    }
+    *value = items_[head & (Capacity - 1)];
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  // approximate when called while the other side is running
+  size_t Size() const {
+    return tail_.load(std::memory_order_acquire) -
+        head_.load(std::memory_order_acquire);
+  }
+
+ private:
+  static constexpr size_t kCacheLine = 64;
+
+  // consumer side
+  std::atomic<size_t> head_;
+  size_t tail_cache_;
+  char consumer_padding_[kCacheLine - sizeof(size_t) * 2];
+  // producer side
+  std::atomic<size_t> tail_;
+  size_t head_cache_;
+  char producer_padding_[kCacheLine - sizeof(size_t) * 2];
+  T items_[Capacity];
+};
+
+template <typename T, size_t Capacity>
+constexpr size_t SpscRing<T, Capacity>::kCapacity;
+
+}  // namespace rigel
+
+#endif  // RIGEL_BASE_SPSC_RING_H_
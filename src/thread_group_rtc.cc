@@ -0,0 +1,94 @@
+
+#include "thread_group_rtc.h"
+#include "logging.inc"
+
+#include <string>
+
+#include "api/create_peerconnection_factory.h"
+#include "api/video_codecs/builtin_video_decoder_factory.h"
+#include "api/audio_codecs/builtin_audio_encoder_factory.h"
+#include "api/audio_codecs/builtin_audio_decoder_factory.h"
+#include "rtc_base/location.h"
+
+extern "C" {
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+}
+
+namespace rigel {
+
+namespace {
+
+void PinThread(rtc::Thread *thread, int cpu) {
+  const long processors = sysconf(_SC_NPROCESSORS_ONLN);
+  if (cpu < 0 || processors <= 0) return;
+  cpu %= static_cast<int>(processors);
+  // the affinity is set by the thread itself
+  thread->Invoke<void>(RTC_FROM_HERE, [cpu] {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0) {
+      RGL_WARN("failed to pin thread to cpu " + std::to_string(cpu));
+    }
+  });
+}
+
+}  // unnamed namespace
+
+RTCThreadOptions::RTCThreadOptions()
+    : groups(0),
+      assignment(kRTCThreadAssignmentLeastLoaded),
+      pin_threads(false),
+      setup_threads(0) {}
+
+RTCThreadGroup::RTCThreadGroup(size_t index,
+    const EncoderOptions &encoder_options, int pin_cpu)
+    : index_(index), channels_(0) {
+  const std::string suffix = "_" + std::to_string(index);
+  // Network Thread
+  network_thread_ = rtc::Thread::CreateWithSocketServer();
+  network_thread_->SetName("rigel_network" + suffix, nullptr);
+  network_thread_->Start();
+  // Worker Thread
+  worker_thread_ = rtc::Thread::Create();
+  worker_thread_->SetName("rigel_worker" + suffix, nullptr);
+  worker_thread_->Start();
+  // Signaling Thread
+  signaling_thread_ = rtc::Thread::Create();
+  signaling_thread_->SetName("rigel_signaling" + suffix, nullptr);
+  signaling_thread_->Start();
+  if (pin_cpu >= 0) {
+    PinThread(network_thread_.get(), pin_cpu);
+    PinThread(worker_thread_.get(), pin_cpu + 1);
+  }
+  // Peer Connection
+  factory_ = CreateFactory(std::unique_ptr<webrtc::VideoEncoderFactory>(
+      new RigelVideoEncoderFactory(encoder_options)));
+}
+
+RTCThreadGroup::~RTCThreadGroup() {
+  factory_ = nullptr;
+  network_thread_->Stop();
+  worker_thread_->Stop();
+  signaling_thread_->Stop();
+}
+
+rtc::scoped_refptr<webrtc::PeerConnectionFactoryInterface>
+RTCThreadGroup::CreateFactory(
+    std::unique_ptr<webrtc::VideoEncoderFactory> video_encoder_factory) {
+  return webrtc::CreatePeerConnectionFactory(
+    network_thread_.get(),
+    worker_thread_.get(),
+    signaling_thread_.get(),
+    nullptr,
+    webrtc::CreateBuiltinAudioEncoderFactory(),
+    webrtc::CreateBuiltinAudioDecoderFactory(),
+    std::move(video_encoder_factory),
+    webrtc::CreateBuiltinVideoDecoderFactory(),
+    nullptr,
+    nullptr);
+}
+
+}  // namespace rigel
@@ -0,0 +1,58 @@
+
+#ifndef RIGEL_RTC_THREAD_GROUP_H_
+#define RIGEL_RTC_THREAD_GROUP_H_
+
+#include <atomic>
+#include <memory>
+#include <cstddef>
+
+#include "api/scoped_refptr.h"
+#include "api/peer_connection_interface.h"
+#include "api/video_codecs/video_encoder_factory.h"
+#include "rtc_base/thread.h"
+
+#include "encoder_rtc.h"
+#include "rtc_options.h"
+
+namespace rigel {
+
+// A network, a worker and a signaling thread with the factory of the
+// peer connections running on them. The SRTP, pacing and RTCP work of
+// a connection stays on the threads of its group, so more groups let
+// that work spread over more processors.
+class RTCThreadGroup {
+ public:
+  // pin_cpu is the processor of the network thread, the worker takes
+  // the next one. Negative for no pinning
+  RTCThreadGroup(size_t index, const EncoderOptions &encoder_options,
+      int pin_cpu);
+  explicit RTCThreadGroup(const RTCThreadGroup &) = delete;
+  ~RTCThreadGroup();
+
+  size_t Index() const { return index_; }
+  rtc::scoped_refptr<webrtc::PeerConnectionFactoryInterface> &Factory() {
+    return factory_;
+  }
+  // where the tracks of the group add and remove their sinks
+  rtc::Thread *WorkerThread() { return worker_thread_.get(); }
+  // a factory of its own sharing the threads of the group
+  rtc::scoped_refptr<webrtc::PeerConnectionFactoryInterface> CreateFactory(
+      std::unique_ptr<webrtc::VideoEncoderFactory> video_encoder_factory);
+
+  // peer channels running on the group
+  void AddChannel() { channels_++; }
+  void RemoveChannel() { channels_--; }
+  int Channels() const { return channels_; }
+
+ private:
+  size_t index_;
+  std::unique_ptr<rtc::Thread> network_thread_;
+  std::unique_ptr<rtc::Thread> worker_thread_;
+  std::unique_ptr<rtc::Thread> signaling_thread_;
+  rtc::scoped_refptr<webrtc::PeerConnectionFactoryInterface> factory_;
+  std::atomic<int> channels_;
+};
+
+}  // namespace rigel
+
+#endif  // RIGEL_RTC_THREAD_GROUP_H_
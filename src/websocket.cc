@@ -251,12 +251,12 @@ public:
             timer_.cancel();
             return fail(ec, "read");
         }
-        //
-        auto string = beast::buffers_to_string(buffer_.data());
+        // the sink reads the message in place, it may modify it
+        net::mutable_buffer message = buffer_.data();
+        sink_->OnReceiveMessage(this,
+            static_cast<char *>(message.data()), message.size());
         // Clear the buffer
         buffer_.consume(buffer_.size());
-        // notify the sink
-        sink_->OnReceiveMessage(this, string);
 
         // read another
         ws_.async_read(
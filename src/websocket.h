@@ -4,6 +4,7 @@
 
 #include <string>
 #include <memory>
+#include <cstddef>
 
 namespace rigel {
 
@@ -13,8 +14,9 @@ struct WebSocketInterface {
 
 struct WebSocketSink {
   virtual void OnHandshake(WebSocketInterface *connection) = 0;
+  // message is valid during the call only, and may be modified in place
   virtual void OnReceiveMessage(WebSocketInterface *connection,
-      const std::string &message) = 0;
+      char *message, size_t size) = 0;
   virtual void OnRelease(WebSocketInterface *connection) = 0;
 };
 
@@ -0,0 +1,168 @@
+
+#include "worker_pool.h"
+
+#include <atomic>
+#include <deque>
+#include <vector>
+#include <algorithm>
+
+extern "C" {
+#include <pthread.h>
+#include <unistd.h>
+void *RGLWorkerPoolThreadEntry(void *state);
+}
+
+namespace rigel {
+
+namespace {
+
+struct WorkerPoolJob {
+  const std::function<void(size_t)> *function;
+  size_t count;
+  std::atomic<size_t> next;
+  // guarded by the pool mutex
+  size_t finished;
+  size_t active;
+};
+
+}  // unnamed namespace
+
+class WorkerPoolState {
+ public:
+  explicit WorkerPoolState(size_t thread_count) : running_(true) {
+    pthread_mutex_init(&mutex_, nullptr);
+    pthread_cond_init(&job_cond_, nullptr);
+    pthread_cond_init(&done_cond_, nullptr);
+    threads_.resize(thread_count);
+    for (auto &thread : threads_) {
+      pthread_create(&thread, nullptr, RGLWorkerPoolThreadEntry, this);
+    }
+  }
+
+  ~WorkerPoolState() {
+    pthread_mutex_lock(&mutex_);
+    running_ = false;
+    pthread_cond_broadcast(&job_cond_);
+    pthread_mutex_unlock(&mutex_);
+    for (auto &thread : threads_) {
+      pthread_join(thread, nullptr);
+    }
+    pthread_cond_destroy(&done_cond_);
+    pthread_cond_destroy(&job_cond_);
+    pthread_mutex_destroy(&mutex_);
+  }
+
+  size_t Concurrency() const {
+    return threads_.size() + 1;
+  }
+
+  void ParallelFor(size_t count,
+      const std::function<void(size_t)> &function) {
+    if (count == 0) return;
+    if (count == 1 || threads_.empty()) {
+      for (size_t i = 0; i < count; i++) function(i);
+      return;
+    }
+    WorkerPoolJob job;
+    job.function = &function;
+    job.count = count;
+    job.next = 0;
+    job.finished = 0;
+    job.active = 0;
+    pthread_mutex_lock(&mutex_);
+    jobs_.push_back(&job);
+    pthread_cond_broadcast(&job_cond_);
+    pthread_mutex_unlock(&mutex_);
+
+    size_t finished = 0;
+    size_t index;
+    while ((index = job.next.fetch_add(1)) < count) {
+      function(index);
+      finished++;
+    }
+
+    pthread_mutex_lock(&mutex_);
+    Retire(&job);
+    job.finished += finished;
+    // workers may still be running tasks or holding the job
+    while (job.finished < count || job.active > 0) {
+      pthread_cond_wait(&done_cond_, &mutex_);
+    }
+    pthread_mutex_unlock(&mutex_);
+  }
+
+  void Run() {
+    pthread_mutex_lock(&mutex_);
+    while (true) {
+      while (running_ && jobs_.empty()) {
+        pthread_cond_wait(&job_cond_, &mutex_);
+      }
+      if (!running_) break;
+      WorkerPoolJob *job = jobs_.front();
+      job->active++;
+      pthread_mutex_unlock(&mutex_);
+
+      size_t finished = 0;
+      size_t index;
+      while ((index = job->next.fetch_add(1)) < job->count) {
+        (*job->function)(index);
+        finished++;
+      }
+
+      pthread_mutex_lock(&mutex_);
+      Retire(job);
+      job->finished += finished;
+      job->active--;
+      if (job->finished == job->count && job->active == 0) {
+        pthread_cond_broadcast(&done_cond_);
+      }
+    }
+    pthread_mutex_unlock(&mutex_);
+  }
+
+ private:
+  // no more tasks to hand out, must hold the mutex
+  void Retire(WorkerPoolJob *job) {
+    auto it = std::find(jobs_.begin(), jobs_.end(), job);
+    if (it != jobs_.end()) jobs_.erase(it);
+  }
+
+  std::vector<pthread_t> threads_;
+  pthread_mutex_t mutex_;
+  pthread_cond_t job_cond_;
+  pthread_cond_t done_cond_;
+  std::deque<WorkerPoolJob *> jobs_;
+  bool running_;
+};
+
+WorkerPool::WorkerPool(size_t thread_count)
+    : state_(new WorkerPoolState(thread_count)) {}
+
+WorkerPool::~WorkerPool() {
+  delete state_;
+}
+
+WorkerPool *WorkerPool::Shared() {
+  static WorkerPool *pool = [] {
+    long processors = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t count = processors > 1 ? static_cast<size_t>(processors - 1) : 0;
+    return new WorkerPool(count);
+  }();
+  return pool;
+}
+
+size_t WorkerPool::Concurrency() const {
+  return state_->Concurrency();
+}
+
+void WorkerPool::ParallelFor(size_t count,
+    const std::function<void(size_t)> &function) {
+  state_->ParallelFor(count, function);
+}
+
+}  // namespace rigel
+
+void *RGLWorkerPoolThreadEntry(void *state) {
+  static_cast<rigel::WorkerPoolState *>(state)->Run();
+  return 0;
+}
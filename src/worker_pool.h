@@ -0,0 +1,35 @@
+
+#ifndef RIGEL_BASE_WORKER_POOL_H_
+#define RIGEL_BASE_WORKER_POOL_H_
+
+#include <functional>
+#include <cstddef>
+
+namespace rigel {
+
+class WorkerPoolState;
+
+// Fixed set of threads shared by every session of the process.
+// ParallelFor runs indexed tasks on the workers and on the calling
+// thread, which keeps taking tasks of its own call until all of them
+// are finished, so a call from inside a task cannot deadlock.
+class WorkerPool {
+ public:
+  explicit WorkerPool(size_t thread_count);
+  explicit WorkerPool(const WorkerPool &) = delete;
+  ~WorkerPool();
+
+  // one worker per online processor besides the calling thread
+  static WorkerPool *Shared();
+
+  // number of threads that can run tasks of a single call
+  size_t Concurrency() const;
+  void ParallelFor(size_t count, const std::function<void(size_t)> &function);
+
+ private:
+  WorkerPoolState *state_;
+};
+
+}  // namespace rigel
+
+#endif  // RIGEL_BASE_WORKER_POOL_H_
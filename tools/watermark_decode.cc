@@ -0,0 +1,64 @@
+/**
+  Reads the input watermark of every frame of a Y4M recording of the
+  stream and prints the frame index at which each input sequence number
+  appears first. Together with the send times logged by the client this
+  gives the input-to-photon latency of every event.
+    tools/watermark_decode recording.y4m
+ */
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "input_watermark.h"
+
+int main(int argc, char *argv[]) {
+  if (argc < 2) {
+    std::cerr << "usage: " << argv[0] << " recording.y4m" << std::endl;
+    return 1;
+  }
+  std::ifstream in(argv[1], std::ios::binary);
+  std::string header;
+  if (!std::getline(in, header) || header.compare(0, 9, "YUV4MPEG2") != 0) {
+    std::cerr << "not a Y4M file" << std::endl;
+    return 1;
+  }
+  int width = 0;
+  int height = 0;
+  std::istringstream tokens(header);
+  std::string token;
+  while (tokens >> token) {
+    if (token[0] == 'W') width = std::stoi(token.substr(1));
+    if (token[0] == 'H') height = std::stoi(token.substr(1));
+  }
+  if (width <= 0 || height <= 0) {
+    std::cerr << "missing frame size" << std::endl;
+    return 1;
+  }
+  // 4:2:0 frames, only the luma plane is read
+  const size_t luma_size = static_cast<size_t>(width) * height;
+  const size_t chroma_size =
+      static_cast<size_t>((width + 1) / 2) * ((height + 1) / 2) * 2;
+  std::vector<uint8_t> luma(luma_size);
+  uint32_t last = 0;
+  bool found = false;
+  std::string frame_header;
+  for (uint64_t frame = 0; std::getline(in, frame_header); frame++) {
+    if (!in.read(reinterpret_cast<char *>(luma.data()), luma_size)) break;
+    in.ignore(chroma_size);
+    uint32_t sequence;
+    if (!rigel::DecodeInputWatermark(luma.data(), width, width, height,
+        &sequence)) {
+      continue;
+    }
+    if (!found || sequence != last) {
+      std::cout << frame << " " << sequence << std::endl;
+      last = sequence;
+      found = true;
+    }
+  }
+  return 0;
+}